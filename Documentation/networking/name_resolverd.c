@@ -0,0 +1,341 @@
+/* name_resolverd.c
+ *
+ * Stand-in resolver daemon for AF_NAME sockets.  It registers with the
+ * NAME_RESOLVER generic netlink family and answers the kernel's batched
+ * queries from a file in /etc/hosts format, which makes it useful for
+ * testing the resolver upcall without a DNS server.
+ *
+ * Compile with
+ *	gcc -I/usr/src/linux/include name_resolverd.c -o name_resolverd
+ *
+ * Run as root:
+ *	name_resolverd [-t ttl] [-v] [hosts-file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/name_resolver.h>
+
+/*
+ * Generic macros for dealing with netlink sockets. Might be duplicated
+ * elsewhere. It is recommended that commercial grade applications use
+ * libnl or libnetlink and use the interfaces provided by the library
+ */
+#define GENLMSG_DATA(glh)	((void *)(NLMSG_DATA(glh) + GENL_HDRLEN))
+#define GENLMSG_PAYLOAD(glh)	(NLMSG_PAYLOAD(glh, 0) - GENL_HDRLEN)
+#define NLA_DATA(na)		((void *)((char *)(na) + NLA_HDRLEN))
+#define NLA_PAYLOAD(len)	(len - NLA_HDRLEN)
+#define NLA_NEXT(na)		((struct nlattr *)((char *)(na) + \
+					NLA_ALIGN((na)->nla_len)))
+#define NLA_OK(na, rem)		((rem) >= (int)sizeof(struct nlattr) && \
+				 (na)->nla_len >= sizeof(struct nlattr) && \
+				 (na)->nla_len <= (rem))
+
+#define err(code, fmt, arg...)			\
+	do {					\
+		fprintf(stderr, fmt, ##arg);	\
+		exit(code);			\
+	} while (0)
+
+#define MAX_MSG_SIZE	65536
+
+struct msgtemplate {
+	struct nlmsghdr n;
+	struct genlmsghdr g;
+	char buf[MAX_MSG_SIZE];
+};
+
+struct host {
+	char name[256];
+	int family;
+	unsigned char addr[16];
+};
+
+static struct host *hosts;
+static int nhosts;
+static unsigned int ttl = 60;
+static int verbose;
+
+static void load_hosts(const char *path)
+{
+	char line[1024], *p, *tok, *save;
+	unsigned char addr[16];
+	int family;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		err(1, "cannot open %s: %s\n", path, strerror(errno));
+
+	while (fgets(line, sizeof(line), f)) {
+		p = strchr(line, '#');
+		if (p)
+			*p = '\0';
+		tok = strtok_r(line, " \t\n", &save);
+		if (!tok)
+			continue;
+		if (inet_pton(AF_INET, tok, addr) == 1)
+			family = AF_INET;
+		else if (inet_pton(AF_INET6, tok, addr) == 1)
+			family = AF_INET6;
+		else
+			continue;
+
+		while ((tok = strtok_r(NULL, " \t\n", &save))) {
+			hosts = realloc(hosts, (nhosts + 1) * sizeof(*hosts));
+			if (!hosts)
+				err(1, "out of memory\n");
+			snprintf(hosts[nhosts].name, sizeof(hosts[nhosts].name),
+				 "%s", tok);
+			hosts[nhosts].family = family;
+			memcpy(hosts[nhosts].addr, addr, sizeof(addr));
+			nhosts++;
+		}
+	}
+	fclose(f);
+}
+
+static int send_msg(int sd, __u16 nlmsg_type, __u8 cmd, void *payload,
+		    int len)
+{
+	struct sockaddr_nl nladdr;
+	struct msgtemplate msg;
+	char *buf;
+	int r, buflen;
+
+	msg.n.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN) + len;
+	msg.n.nlmsg_type = nlmsg_type;
+	msg.n.nlmsg_flags = NLM_F_REQUEST;
+	msg.n.nlmsg_seq = 0;
+	msg.n.nlmsg_pid = getpid();
+	msg.g.cmd = cmd;
+	msg.g.version = 0x1;
+	memcpy(GENLMSG_DATA(&msg), payload, len);
+
+	buf = (char *)&msg;
+	buflen = msg.n.nlmsg_len;
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+	while ((r = sendto(sd, buf, buflen, 0, (struct sockaddr *)&nladdr,
+			   sizeof(nladdr))) < buflen) {
+		if (r > 0) {
+			buf += r;
+			buflen -= r;
+		} else if (errno != EAGAIN)
+			return -1;
+	}
+	return 0;
+}
+
+static char *put_attr(char *p, int type, const void *data, int len)
+{
+	struct nlattr *na = (struct nlattr *)p;
+
+	na->nla_type = type;
+	na->nla_len = NLA_HDRLEN + len;
+	memcpy(NLA_DATA(na), data, len);
+	return p + NLA_ALIGN(na->nla_len);
+}
+
+static char *put_u32(char *p, int type, __u32 value)
+{
+	return put_attr(p, type, &value, sizeof(value));
+}
+
+/*
+ * Open the nest at @p; close it with end_nest() once its contents are in.
+ */
+static char *start_nest(char *p, int type)
+{
+	((struct nlattr *)p)->nla_type = type | NLA_F_NESTED;
+	return p + NLA_HDRLEN;
+}
+
+static void end_nest(char *start, char *end)
+{
+	((struct nlattr *)start)->nla_len = end - start;
+}
+
+static int get_family_id(int sd)
+{
+	static struct msgtemplate ans;
+	char payload[64], *p;
+	struct nlattr *na;
+	int id = 0, rep_len;
+
+	p = put_attr(payload, CTRL_ATTR_FAMILY_NAME, NAME_RESOLVER_GENL_NAME,
+		     strlen(NAME_RESOLVER_GENL_NAME) + 1);
+	if (send_msg(sd, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, payload,
+		     p - payload) < 0)
+		return 0;
+
+	rep_len = recv(sd, &ans, sizeof(ans), 0);
+	if (ans.n.nlmsg_type == NLMSG_ERROR || rep_len < 0 ||
+	    !NLMSG_OK((&ans.n), rep_len))
+		return 0;
+
+	na = (struct nlattr *)GENLMSG_DATA(&ans);
+	na = NLA_NEXT(na);
+	if (na->nla_type == CTRL_ATTR_FAMILY_ID)
+		id = *(__u16 *)NLA_DATA(na);
+	return id;
+}
+
+/*
+ * Append the answer to one query to @p.
+ */
+static char *answer_query(char *p, __u32 id, const char *name)
+{
+	char *nest = p;
+	int i, found = 0;
+
+	p = start_nest(p, NAME_RESOLVER_A_ANSWER);
+	p = put_u32(p, NAME_RESOLVER_ANS_ID, id);
+	p = put_u32(p, NAME_RESOLVER_ANS_TTL, ttl);
+	for (i = 0; i < nhosts && found < 16; i++) {
+		if (strcasecmp(hosts[i].name, name))
+			continue;
+		if (hosts[i].family == AF_INET)
+			p = put_attr(p, NAME_RESOLVER_ANS_INADDR,
+				     hosts[i].addr, 4);
+		else
+			p = put_attr(p, NAME_RESOLVER_ANS_IN6ADDR,
+				     hosts[i].addr, 16);
+		found++;
+	}
+	p = put_u32(p, NAME_RESOLVER_ANS_STATUS, found ?
+		    NAME_RESOLVER_STATUS_OK : NAME_RESOLVER_STATUS_NXDOMAIN);
+	end_nest(nest, p);
+
+	if (verbose)
+		printf("%u %s: %d address(es)\n", id, name, found);
+	return p;
+}
+
+/*
+ * Answer a batch of queries with one batch of answers.
+ */
+static void handle_queries(int sd, int id, struct msgtemplate *msg)
+{
+	static char payload[MAX_MSG_SIZE];
+	struct nlattr *queries, *q, *a;
+	int rem, qrem, arem;
+	char *p, *answers;
+
+	queries = (struct nlattr *)GENLMSG_DATA(msg);
+	rem = GENLMSG_PAYLOAD(&msg->n);
+	if (!NLA_OK(queries, rem) ||
+	    (queries->nla_type & NLA_TYPE_MASK) != NAME_RESOLVER_A_QUERIES)
+		return;
+
+	answers = payload;
+	p = start_nest(answers, NAME_RESOLVER_A_ANSWERS);
+
+	qrem = NLA_PAYLOAD(queries->nla_len);
+	for (q = NLA_DATA(queries); NLA_OK(q, qrem);
+	     qrem -= NLA_ALIGN(q->nla_len), q = NLA_NEXT(q)) {
+		const char *name = NULL;
+		__u32 qid = 0;
+
+		arem = NLA_PAYLOAD(q->nla_len);
+		for (a = NLA_DATA(q); NLA_OK(a, arem);
+		     arem -= NLA_ALIGN(a->nla_len), a = NLA_NEXT(a)) {
+			if (a->nla_type == NAME_RESOLVER_Q_ID)
+				qid = *(__u32 *)NLA_DATA(a);
+			else if (a->nla_type == NAME_RESOLVER_Q_NAME)
+				name = NLA_DATA(a);
+		}
+		if (!qid || !name)
+			continue;
+
+		/* Flush before the message could overflow */
+		if (p - payload > MAX_MSG_SIZE - 512) {
+			end_nest(answers, p);
+			send_msg(sd, id, NAME_RESOLVER_CMD_ANSWER, payload,
+				 p - payload);
+			p = start_nest(answers, NAME_RESOLVER_A_ANSWERS);
+		}
+		p = answer_query(p, qid, name);
+	}
+
+	end_nest(answers, p);
+	if (send_msg(sd, id, NAME_RESOLVER_CMD_ANSWER, payload,
+		     p - payload) < 0)
+		fprintf(stderr, "error sending answers: %s\n", strerror(errno));
+}
+
+int main(int argc, char *argv[])
+{
+	static struct msgtemplate msg;
+	const char *path = "/etc/hosts";
+	struct sockaddr_nl local;
+	int c, sd, id, len;
+
+	while ((c = getopt(argc, argv, "t:v")) != -1) {
+		switch (c) {
+		case 't':
+			ttl = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			err(1, "usage: %s [-t ttl] [-v] [hosts-file]\n",
+			    argv[0]);
+		}
+	}
+	if (optind < argc)
+		path = argv[optind];
+	load_hosts(path);
+
+	sd = socket(AF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
+	if (sd < 0)
+		err(1, "error creating netlink socket: %s\n", strerror(errno));
+
+	memset(&local, 0, sizeof(local));
+	local.nl_family = AF_NETLINK;
+	if (bind(sd, (struct sockaddr *)&local, sizeof(local)) < 0)
+		err(1, "error binding netlink socket: %s\n", strerror(errno));
+
+	id = get_family_id(sd);
+	if (!id)
+		err(1, "NAME_RESOLVER family not found; is af-name loaded?\n");
+
+	if (send_msg(sd, id, NAME_RESOLVER_CMD_REGISTER, NULL, 0) < 0)
+		err(1, "error registering: %s\n", strerror(errno));
+
+	for (;;) {
+		len = recv(sd, &msg, sizeof(msg), 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			err(1, "recv: %s\n", strerror(errno));
+		}
+		if (!NLMSG_OK(&msg.n, len))
+			continue;
+		if (msg.n.nlmsg_type == NLMSG_ERROR) {
+			struct nlmsgerr *e = NLMSG_DATA(&msg.n);
+
+			if (e->error)
+				fprintf(stderr, "kernel: %s\n",
+					strerror(-e->error));
+			continue;
+		}
+		if (msg.n.nlmsg_type == id &&
+		    msg.g.cmd == NAME_RESOLVER_CMD_QUERY)
+			handle_queries(sd, id, &msg);
+	}
+	return 0;
+}
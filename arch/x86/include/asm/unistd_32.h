@@ -338,6 +338,8 @@
 #define __NR_dup3		330
 #define __NR_pipe2		331
 #define __NR_inotify_init1	332
+#define __NR_recvmmsg		333
+#define __NR_sendmmsg		334
 
 #ifdef __KERNEL__
 
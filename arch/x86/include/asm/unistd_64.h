@@ -653,6 +653,10 @@ __SYSCALL(__NR_dup3, sys_dup3)
 __SYSCALL(__NR_pipe2, sys_pipe2)
 #define __NR_inotify_init1			294
 __SYSCALL(__NR_inotify_init1, sys_inotify_init1)
+#define __NR_recvmmsg				295
+__SYSCALL(__NR_recvmmsg, sys_recvmmsg)
+#define __NR_sendmmsg				296
+__SYSCALL(__NR_sendmmsg, sys_sendmmsg)
 
 
 #ifndef __NO_STUBS
@@ -23,4 +23,16 @@ struct sockaddr_name {
     struct name_addr   sname_addr;
 };
 
+/* setsockopt(SOL_NAME, ...) options */
+#define NAME_MOBILITY	1	/* int: reconnect to the name on failure */
+#define NAME_POLICY	2	/* int: NAME_POLICY_*, spreads connects */
+#define NAME_POOL	3	/* int: idle connections to keep warm */
+
+/* How connects spread over the addresses of a name */
+#define NAME_POLICY_ORDER	0	/* resolver order, IPv6 first */
+#define NAME_POLICY_ROUND_ROBIN	1	/* next address for each connect */
+#define NAME_POLICY_WEIGHTED	2	/* at random, by record weight */
+#define NAME_POLICY_LEAST_CONN	3	/* fewest outstanding connections */
+#define NAME_POLICY_MAX		3
+
 #endif /* LINUX_INNAME_H */
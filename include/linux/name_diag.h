@@ -0,0 +1,82 @@
+/*
+ * Monitoring of AF_NAME sockets over NETLINK_NAME_ORIENTED_STACK, after
+ * the model of inet_diag.
+ *
+ * A NAME_DIAG_GETSOCK dump request, carrying a struct name_diag_req,
+ * returns a struct name_diag_msg for each AF_NAME socket of the
+ * requester's network namespace, followed by NAME_DIAG_* attributes.
+ * A NAME_DIAG_GETHIST dump returns, for each name connected to, a
+ * struct name_diag_hist and the latency histograms of the connects to it.
+ */
+#ifndef _LINUX_NAME_DIAG_H
+#define _LINUX_NAME_DIAG_H
+
+#include <linux/types.h>
+
+/* Message types */
+#define NAME_DIAG_GETSOCK	18
+#define NAME_DIAG_GETHIST	19
+
+/* Request structure */
+struct name_diag_req {
+	__u8	ndiag_type;		/* SOCK_STREAM, SOCK_DGRAM or 0 for all */
+	__u8	ndiag_pad[3];
+	__u32	ndiag_states;		/* States to dump, 1 << TCP_*; 0 for all */
+};
+
+/* Phases of a connect */
+enum {
+	NAME_DIAG_RESOLVE,		/* connect() to name resolved */
+	NAME_DIAG_CONNECT,		/* resolved to handshake completed */
+	NAME_DIAG_FIRST_BYTE,		/* handshake to first byte received */
+	NAME_DIAG_PHASES,
+};
+
+#define NAME_DIAG_NOTIME	(~0U)	/* phase not completed */
+
+/* Base info structure, one per socket */
+struct name_diag_msg {
+	__u8	ndiag_type;		/* SOCK_STREAM or SOCK_DGRAM */
+	__u8	ndiag_state;		/* TCP_* */
+	__u8	ndiag_protocol;		/* of the transport, IPPROTO_TCP or _UDP */
+	__u8	ndiag_family;		/* of the transport, 0 if none yet */
+	__be16	ndiag_sport;
+	__be16	ndiag_dport;
+	__be32	ndiag_dst[4];		/* address the name resolved to */
+	__u32	ndiag_uid;
+	__u32	ndiag_inode;
+	__u32	ndiag_phase_us[NAME_DIAG_PHASES];	/* or NAME_DIAG_NOTIME */
+};
+
+/* Attributes of a name_diag_msg */
+enum {
+	NAME_DIAG_NONE,
+	NAME_DIAG_NAME,			/* string: peer name */
+	NAME_DIAG_LOCAL_NAME,		/* string: name bound to */
+	__NAME_DIAG_MAX,
+};
+#define NAME_DIAG_MAX (__NAME_DIAG_MAX - 1)
+
+/*
+ * Latency histograms of a name.  Bucket 0 counts the phases that took
+ * less than a microsecond, bucket i > 0 those that took from 2^(i-1) up
+ * to 2^i microseconds, and the last bucket all longer ones.
+ */
+#define NAME_DIAG_HIST_BUCKETS	32
+
+struct name_diag_hist {
+	__u32	ndiag_count[NAME_DIAG_PHASES];	/* connects that completed each */
+};
+
+/* Attributes of a name_diag_hist */
+enum {
+	NAME_DIAG_HIST_NONE,
+	NAME_DIAG_HIST_NAME,		/* string */
+	NAME_DIAG_HIST_RESOLVE,		/* __u32[NAME_DIAG_HIST_BUCKETS] */
+	NAME_DIAG_HIST_CONNECT,		/* __u32[NAME_DIAG_HIST_BUCKETS] */
+	NAME_DIAG_HIST_FIRST_BYTE,	/* __u32[NAME_DIAG_HIST_BUCKETS] */
+	__NAME_DIAG_HIST_MAX,
+};
+#define NAME_DIAG_HIST_MAX (__NAME_DIAG_HIST_MAX - 1)
+
+#endif /* _LINUX_NAME_DIAG_H */
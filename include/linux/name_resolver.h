@@ -0,0 +1,71 @@
+/*
+ * Generic netlink protocol between the AF_NAME name resolver and the
+ * userspace daemons answering its queries.
+ *
+ * A daemon announces itself with NAME_RESOLVER_CMD_REGISTER.  The kernel
+ * then sends it NAME_RESOLVER_CMD_QUERY messages, each carrying a batch of
+ * names to resolve, and the daemon replies with NAME_RESOLVER_CMD_ANSWER
+ * messages, each of which may carry answers for any number of queries.
+ */
+#ifndef _LINUX_NAME_RESOLVER_H
+#define _LINUX_NAME_RESOLVER_H
+
+#define NAME_RESOLVER_GENL_NAME		"NAME_RESOLVER"
+#define NAME_RESOLVER_GENL_VERSION	1
+
+enum {
+	NAME_RESOLVER_CMD_UNSPEC,
+	NAME_RESOLVER_CMD_REGISTER,	/* daemon -> kernel */
+	NAME_RESOLVER_CMD_QUERY,	/* kernel -> daemon */
+	NAME_RESOLVER_CMD_ANSWER,	/* daemon -> kernel */
+	__NAME_RESOLVER_CMD_MAX,
+};
+#define NAME_RESOLVER_CMD_MAX (__NAME_RESOLVER_CMD_MAX - 1)
+
+/* Message attributes */
+enum {
+	NAME_RESOLVER_A_UNSPEC,
+	NAME_RESOLVER_A_QUERIES,	/* nest of NAME_RESOLVER_A_QUERY */
+	NAME_RESOLVER_A_ANSWERS,	/* nest of NAME_RESOLVER_A_ANSWER */
+	__NAME_RESOLVER_A_MAX,
+};
+#define NAME_RESOLVER_A_MAX (__NAME_RESOLVER_A_MAX - 1)
+
+/* Elements of the NAME_RESOLVER_A_QUERIES and _ANSWERS nests */
+enum {
+	NAME_RESOLVER_A_QUERY_UNSPEC,
+	NAME_RESOLVER_A_QUERY,		/* nest of NAME_RESOLVER_Q_* */
+	NAME_RESOLVER_A_ANSWER,		/* nest of NAME_RESOLVER_ANS_* */
+};
+
+/* Query attributes */
+enum {
+	NAME_RESOLVER_Q_UNSPEC,
+	NAME_RESOLVER_Q_ID,		/* u32: echoed in the answer */
+	NAME_RESOLVER_Q_NAME,		/* NUL-terminated string */
+	__NAME_RESOLVER_Q_MAX,
+};
+#define NAME_RESOLVER_Q_MAX (__NAME_RESOLVER_Q_MAX - 1)
+
+/* Answer attributes */
+enum {
+	NAME_RESOLVER_ANS_UNSPEC,
+	NAME_RESOLVER_ANS_ID,		/* u32: id of the query answered */
+	NAME_RESOLVER_ANS_STATUS,	/* u32: NAME_RESOLVER_STATUS_* */
+	NAME_RESOLVER_ANS_TTL,		/* u32: seconds */
+	NAME_RESOLVER_ANS_INADDR,	/* struct in_addr, may repeat */
+	NAME_RESOLVER_ANS_IN6ADDR,	/* struct in6_addr, may repeat */
+	NAME_RESOLVER_ANS_WEIGHT,	/* u32: of the preceding address */
+	__NAME_RESOLVER_ANS_MAX,
+};
+#define NAME_RESOLVER_ANS_MAX (__NAME_RESOLVER_ANS_MAX - 1)
+
+/* Answer status */
+enum {
+	NAME_RESOLVER_STATUS_OK,	/* addresses follow */
+	NAME_RESOLVER_STATUS_NXDOMAIN,	/* the name does not exist */
+	NAME_RESOLVER_STATUS_NODATA,	/* the name has no addresses */
+	NAME_RESOLVER_STATUS_SERVFAIL,	/* resolution failed */
+};
+
+#endif /* _LINUX_NAME_RESOLVER_H */
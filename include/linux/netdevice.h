@@ -182,6 +182,9 @@ struct netif_rx_stats
 	unsigned dropped;
 	unsigned time_squeeze;
 	unsigned cpu_collision;
+	unsigned received_rps;
+	unsigned recycle_hits;
+	unsigned recycle_misses;
 };
 
 DECLARE_PER_CPU(struct netif_rx_stats, netdev_rx_stat);
@@ -292,6 +295,71 @@ struct netdev_boot_setup {
 
 extern int __init netdev_boot_setup(char *str);
 
+/*
+ * CPUs that receive packet steering spreads the packets of a device
+ * over, selected among by the flow hash of each packet.
+ */
+struct rps_map {
+	unsigned int		len;
+	struct rcu_head		rcu;
+	u16			cpus[0];
+};
+#define RPS_MAP_SIZE(_num) (sizeof(struct rps_map) + ((_num) * sizeof(u16)))
+
+/*
+ * Where receive flow steering last sent a flow of a device: the CPU,
+ * and the tail of its backlog after the last packet of the flow.
+ */
+struct rps_dev_flow {
+	u16			cpu;
+	unsigned int		last_qtail;
+};
+
+struct rps_dev_flow_table {
+	unsigned int		mask;
+	struct rcu_head		rcu;
+	struct work_struct	free_work;
+	struct rps_dev_flow	flows[0];
+};
+#define RPS_DEV_FLOW_TABLE_SIZE(_num) (sizeof(struct rps_dev_flow_table) + \
+				       ((_num) * sizeof(struct rps_dev_flow)))
+
+/*
+ * The CPU each flow was last read from by its application, indexed by
+ * the flow hash of its socket.  Set by net.core.rps_sock_flow_entries.
+ */
+struct rps_sock_flow_table {
+	unsigned int		mask;
+	u16			ents[0];
+};
+#define RPS_SOCK_FLOW_TABLE_SIZE(_num) (sizeof(struct rps_sock_flow_table) + \
+					((_num) * sizeof(u16)))
+
+#define RPS_NO_CPU 0xffff
+
+static inline void rps_record_sock_flow(struct rps_sock_flow_table *table,
+					u32 hash)
+{
+	if (table && hash) {
+		unsigned int cpu, index = hash & table->mask;
+
+		/* We only give a hint, preemption can change cpu under us */
+		cpu = raw_smp_processor_id();
+
+		if (table->ents[index] != cpu)
+			table->ents[index] = cpu;
+	}
+}
+
+static inline void rps_reset_sock_flow(struct rps_sock_flow_table *table,
+				       u32 hash)
+{
+	if (table && hash)
+		table->ents[hash & table->mask] = RPS_NO_CPU;
+}
+
+extern struct rps_sock_flow_table *rps_sock_flow_table;
+
 /*
  * Structure for NAPI scheduling similar to tasklet but with weighting
  */
@@ -310,9 +378,10 @@ struct napi_struct {
 #ifdef CONFIG_NETPOLL
 	spinlock_t		poll_lock;
 	int			poll_owner;
+#endif
 	struct net_device	*dev;
 	struct list_head	dev_list;
-#endif
+	struct sk_buff		*gro_list;
 };
 
 enum
@@ -367,28 +436,8 @@ static inline int napi_reschedule(struct napi_struct *napi)
 	return 0;
 }
 
-/**
- *	napi_complete - NAPI processing complete
- *	@n: napi context
- *
- * Mark NAPI processing as complete.
- */
-static inline void __napi_complete(struct napi_struct *n)
-{
-	BUG_ON(!test_bit(NAPI_STATE_SCHED, &n->state));
-	list_del(&n->poll_list);
-	smp_mb__before_clear_bit();
-	clear_bit(NAPI_STATE_SCHED, &n->state);
-}
-
-static inline void napi_complete(struct napi_struct *n)
-{
-	unsigned long flags;
-
-	local_irq_save(flags);
-	__napi_complete(n);
-	local_irq_restore(flags);
-}
+extern void __napi_complete(struct napi_struct *n);
+extern void napi_complete(struct napi_struct *n);
 
 /**
  *	napi_disable - prevent NAPI from scheduling
@@ -450,8 +499,31 @@ struct netdev_queue {
 	spinlock_t		_xmit_lock;
 	int			xmit_lock_owner;
 	struct Qdisc		*qdisc_sleeping;
+#ifdef CONFIG_XPS
+	/* queues/tx-<n> of the device in sysfs */
+	struct kobject		kobj;
+#endif
 } ____cacheline_aligned_in_smp;
 
+#ifdef CONFIG_XPS
+/*
+ * TX queues a CPU transmits on, picked among by flow hash, as set by
+ * the xps_cpus of each queue.
+ */
+struct xps_map {
+	unsigned int		len;
+	u16			queues[0];
+};
+#define XPS_MAP_SIZE(_num) (sizeof(struct xps_map) + ((_num) * sizeof(u16)))
+
+struct xps_dev_maps {
+	struct rcu_head		rcu;
+	struct xps_map		*cpu_map[0];
+};
+#define XPS_DEV_MAPS_SIZE (sizeof(struct xps_dev_maps) + \
+			   (nr_cpu_ids * sizeof(struct xps_map *)))
+#endif /* CONFIG_XPS */
+
 /*
  *	The DEVICE structure.
  *	Actually, this whole structure is a big mistake.  It mixes I/O
@@ -496,9 +568,7 @@ struct net_device
 	unsigned long		state;
 
 	struct list_head	dev_list;
-#ifdef CONFIG_NETPOLL
 	struct list_head	napi_list;
-#endif
 	
 	/* The device initialization function. Called only once. */
 	int			(*init)(struct net_device *dev);
@@ -522,6 +592,7 @@ struct net_device
 #define NETIF_F_LLTX		4096	/* LockLess TX - deprecated. Please */
 					/* do not use LLTX in new drivers */
 #define NETIF_F_NETNS_LOCAL	8192	/* Does not change network namespaces */
+#define NETIF_F_GRO		16384	/* Generic receive offload */
 #define NETIF_F_LRO		32768	/* large receive offload */
 
 	/* Segmentation offload features */
@@ -641,6 +712,12 @@ struct net_device
 
 	struct netdev_queue	rx_queue;
 
+#ifdef CONFIG_RPS
+	/* CPUs received packets are steered to, see get_rps_cpu() */
+	struct rps_map		*rps_map;
+	struct rps_dev_flow_table *rps_flow_table;
+#endif
+
 	struct netdev_queue	*_tx ____cacheline_aligned_in_smp;
 
 	/* Number of TX queues allocated at alloc_netdev_mq() time  */
@@ -649,6 +726,12 @@ struct net_device
 	/* Number of TX queues currently active in device  */
 	unsigned int		real_num_tx_queues;
 
+#ifdef CONFIG_XPS
+	/* TX queues of each transmitting CPU, see get_xps_queue() */
+	struct xps_dev_maps	*xps_maps;
+	struct kset		*queues_kset;
+#endif
+
 	unsigned long		tx_queue_len;	/* Max frames per queue allowed */
 	spinlock_t		tx_global_lock;
 /*
@@ -859,22 +942,8 @@ static inline void *netdev_priv(const struct net_device *dev)
  * netif_napi_add() must be used to initialize a napi context prior to calling
  * *any* of the other napi related functions.
  */
-static inline void netif_napi_add(struct net_device *dev,
-				  struct napi_struct *napi,
-				  int (*poll)(struct napi_struct *, int),
-				  int weight)
-{
-	INIT_LIST_HEAD(&napi->poll_list);
-	napi->poll = poll;
-	napi->weight = weight;
-#ifdef CONFIG_NETPOLL
-	napi->dev = dev;
-	list_add(&napi->dev_list, &dev->napi_list);
-	spin_lock_init(&napi->poll_lock);
-	napi->poll_owner = -1;
-#endif
-	set_bit(NAPI_STATE_SCHED, &napi->state);
-}
+extern void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
+			   int (*poll)(struct napi_struct *, int), int weight);
 
 /**
  *  netif_napi_del - remove a napi context
@@ -882,12 +951,23 @@ static inline void netif_napi_add(struct net_device *dev,
  *
  *  netif_napi_del() removes a napi context from the network device napi list
  */
-static inline void netif_napi_del(struct napi_struct *napi)
-{
-#ifdef CONFIG_NETPOLL
-	list_del(&napi->dev_list);
-#endif
-}
+extern void netif_napi_del(struct napi_struct *napi);
+
+struct napi_gro_cb {
+	/* This is non-zero if the packet may be of the same flow. */
+	int same_flow;
+
+	/* This is non-zero if the packet cannot be merged with the new skb. */
+	int flush;
+
+	/* Number of segments aggregated. */
+	int count;
+
+	/* Free the skb? */
+	int free;
+};
+
+#define NAPI_GRO_CB(skb) ((struct napi_gro_cb *)(skb)->cb)
 
 struct packet_type {
 	__be16			type;	/* This is really htons(ether_type). */
@@ -899,6 +979,9 @@ struct packet_type {
 	struct sk_buff		*(*gso_segment)(struct sk_buff *skb,
 						int features);
 	int			(*gso_send_check)(struct sk_buff *skb);
+	struct sk_buff		**(*gro_receive)(struct sk_buff **head,
+					       struct sk_buff *skb);
+	int			(*gro_complete)(struct sk_buff *skb);
 	void			*af_packet_priv;
 	struct list_head	list;
 };
@@ -951,6 +1034,10 @@ extern int		dev_open(struct net_device *dev);
 extern int		dev_close(struct net_device *dev);
 extern void		dev_disable_lro(struct net_device *dev);
 extern int		dev_queue_xmit(struct sk_buff *skb);
+#ifdef CONFIG_XPS
+extern int		netif_set_xps_queue(struct net_device *dev,
+					    const cpumask_t *mask, u16 index);
+#endif
 extern int		register_netdevice(struct net_device *dev);
 extern void		unregister_netdevice(struct net_device *dev);
 extern void		free_netdev(struct net_device *dev);
@@ -1000,10 +1087,22 @@ static inline int unregister_gifconf(unsigned int family)
 struct softnet_data
 {
 	struct Qdisc		*output_queue;
-	struct sk_buff_head	input_pkt_queue;
 	struct list_head	poll_list;
 	struct sk_buff		*completion_queue;
 
+#ifdef CONFIG_RPS
+	/* Remote backlogs to kick at the end of net_rx_action() */
+	struct softnet_data	*rps_ipi_list;
+
+	/* Elements below are accessed from other CPUs steering to us */
+	struct call_single_data	csd ____cacheline_aligned_in_smp;
+	struct softnet_data	*rps_ipi_next;
+	unsigned int		cpu;
+	/* Packets dequeued and queued, for in order flow migration */
+	unsigned int		input_queue_head;
+	unsigned int		input_queue_tail;
+#endif
+	struct sk_buff_head	input_pkt_queue;
 	struct napi_struct	backlog;
 #ifdef CONFIG_NET_DMA
 	struct dma_chan		*net_dma;
@@ -1252,6 +1351,11 @@ extern int		netif_rx(struct sk_buff *skb);
 extern int		netif_rx_ni(struct sk_buff *skb);
 #define HAVE_NETIF_RECEIVE_SKB 1
 extern int		netif_receive_skb(struct sk_buff *skb);
+extern void		napi_gro_flush(struct napi_struct *napi);
+extern int		dev_gro_receive(struct napi_struct *napi,
+					struct sk_buff *skb);
+extern int		napi_gro_receive(struct napi_struct *napi,
+					 struct sk_buff *skb);
 extern void		netif_nit_deliver(struct sk_buff *skb);
 extern int		dev_valid_name(const char *name);
 extern int		dev_ioctl(struct net *net, unsigned int cmd, void __user *);
@@ -1480,7 +1584,7 @@ static inline int netif_rx_reschedule(struct net_device *dev,
 }
 
 /* same as netif_rx_complete, except that local_irq_save(flags)
- * has already been issued
+ * has already been issued, so it is not for drivers using GRO
  */
 static inline void __netif_rx_complete(struct net_device *dev,
 				       struct napi_struct *napi)
@@ -1491,7 +1595,7 @@ static inline void __netif_rx_complete(struct net_device *dev,
 /* Remove interface from poll list: it must be in the poll list
  * on current cpu. This primitive is called by dev->poll(), when
  * it completes the work. The device cannot be out of poll list at this
- * moment, it is BUG().
+ * moment, it is BUG().  Packets held by GRO are passed up first.
  */
 static inline void netif_rx_complete(struct net_device *dev,
 				     struct napi_struct *napi)
@@ -1504,6 +1608,7 @@ static inline void netif_rx_complete(struct net_device *dev,
 	 */
 	if (unlikely(test_bit(NAPI_STATE_NPSVC, &napi->state)))
 		return;
+	napi_gro_flush(napi);
 	local_irq_save(flags);
 	__netif_rx_complete(dev, napi);
 	local_irq_restore(flags);
@@ -236,6 +236,7 @@ typedef unsigned char *sk_buff_data_t;
  *	@end: End pointer
  *	@destructor: Destruct function
  *	@mark: Generic packet mark
+ *	@rxhash: flow hash of a received packet, 0 if not computed yet
  *	@nfct: Associated connection, if any
  *	@ipvs_property: skbuff is owned by ipvs
  *	@peeked: this packet has been seen already, so stats have been
@@ -336,6 +337,7 @@ struct sk_buff {
 #endif
 
 	__u32			mark;
+	__u32			rxhash;
 
 	__u16			vlan_tci;
 
@@ -384,6 +386,8 @@ static inline struct sk_buff *alloc_skb_fclone(unsigned int size,
 }
 
 extern int skb_recycle_check(struct sk_buff *skb, int skb_size);
+extern void skb_recycle_purge(int cpu);
+extern int sysctl_skb_recycle_max;
 
 extern struct sk_buff *skb_morph(struct sk_buff *dst, struct sk_buff *src);
 extern struct sk_buff *skb_clone(struct sk_buff *skb,
@@ -1649,6 +1653,8 @@ extern void	       skb_split(struct sk_buff *skb,
 				 struct sk_buff *skb1, const u32 len);
 
 extern struct sk_buff *skb_segment(struct sk_buff *skb, int features);
+extern int	       skb_gro_receive(struct sk_buff **head,
+				       struct sk_buff *skb);
 
 static inline void *skb_header_pointer(const struct sk_buff *skb, int offset,
 				       int len, void *buffer)
@@ -1864,6 +1870,23 @@ static inline void skb_copy_queue_mapping(struct sk_buff *to, const struct sk_bu
 	to->queue_mapping = from->queue_mapping;
 }
 
+extern __u32 __skb_get_rxhash(struct sk_buff *skb);
+
+/**
+ *	skb_get_rxhash - flow hash of a received packet
+ *	@skb: packet, with its network header at skb->data
+ *
+ *	Returns the hash of the addresses and ports of @skb, the same for
+ *	both directions of a flow, or 0 if it has no IP header.  The hash
+ *	is computed once and kept in skb->rxhash.
+ */
+static inline __u32 skb_get_rxhash(struct sk_buff *skb)
+{
+	if (!skb->rxhash)
+		skb->rxhash = __skb_get_rxhash(skb);
+	return skb->rxhash;
+}
+
 static inline int skb_is_gso(const struct sk_buff *skb)
 {
 	return skb_shinfo(skb)->gso_size;
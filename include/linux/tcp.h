@@ -96,6 +96,7 @@ enum {
 #define TCP_QUICKACK		12	/* Block/reenable quick acks */
 #define TCP_CONGESTION		13	/* Congestion control algorithm */
 #define TCP_MD5SIG		14	/* TCP MD5 Signature (RFC2385) */
+#define TCP_FASTOPEN		23	/* Enable FastOpen on listeners */
 
 #define TCPI_OPT_TIMESTAMPS	1
 #define TCPI_OPT_SACK		2
@@ -238,6 +239,10 @@ struct tcp_request_sock {
 #endif
 	u32			 	rcv_isn;
 	u32			 	snt_isn;
+	u32				rcv_nxt; /* the ack # by SYNACK. For
+						  * FastOpen it's the seq#
+						  * after data-in-SYN.
+						  */
 };
 
 static inline struct tcp_request_sock *tcp_rsk(const struct request_sock *req)
@@ -409,6 +414,13 @@ struct tcp_sock {
 #endif
 
 	int			linger2;
+
+/* TCP Fast Open */
+	struct tcp_fastopen_request *fastopen_req; /* client: data for the SYN */
+	struct request_sock	*fastopen_rsk;	/* server: req of a SYN_RECV child */
+	u16	fastopen_qlen;	/* listener: max pending Fast Open children */
+	u8	syn_fastopen:1,	/* SYN included a Fast Open option	*/
+		syn_data:1;	/* SYN included data			*/
 };
 
 static inline struct tcp_sock *tcp_sk(const struct sock *sk)
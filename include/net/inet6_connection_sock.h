@@ -14,6 +14,7 @@
 #define _INET6_CONNECTION_SOCK_H
 
 #include <linux/types.h>
+#include <linux/spinlock_types.h>
 
 struct in6_addr;
 struct inet_bind_bucket;
@@ -32,10 +33,18 @@ extern struct request_sock *inet6_csk_search_req(const struct sock *sk,
 						 const struct in6_addr *laddr,
 						 const int iif);
 
+extern int inet6_csk_reqsk_queued(const struct sock *sk, const __be16 rport,
+				  const struct in6_addr *raddr,
+				  const struct in6_addr *laddr, const int iif);
+
 extern void inet6_csk_reqsk_queue_hash_add(struct sock *sk,
 					   struct request_sock *req,
 					   const unsigned long timeout);
 
+extern spinlock_t *inet6_csk_reqsk_queue_hash_lock(struct sock *sk,
+						   struct request_sock *req,
+						   const unsigned long timeout);
+
 extern void inet6_csk_addr2sockaddr(struct sock *sk, struct sockaddr *uaddr);
 
 extern int inet6_csk_xmit(struct sk_buff *skb, int ipfragok);
@@ -17,6 +17,9 @@ extern int			inet_release(struct socket *sock);
 extern int			inet_stream_connect(struct socket *sock,
 						    struct sockaddr * uaddr,
 						    int addr_len, int flags);
+extern int			__inet_stream_connect(struct socket *sock,
+						      struct sockaddr *uaddr,
+						      int addr_len, int flags);
 extern int			inet_dgram_connect(struct socket *sock, 
 						   struct sockaddr * uaddr,
 						   int addr_len, int flags);
@@ -26,6 +29,10 @@ extern int			inet_sendmsg(struct kiocb *iocb,
 					     struct socket *sock, 
 					     struct msghdr *msg, 
 					     size_t size);
+extern int			inet_recvmsg(struct kiocb *iocb,
+					     struct socket *sock,
+					     struct msghdr *msg,
+					     size_t size, int flags);
 extern int			inet_shutdown(struct socket *sock, int how);
 extern int			inet_listen(struct socket *sock, int backlog);
 
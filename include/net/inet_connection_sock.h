@@ -245,6 +245,8 @@ extern struct request_sock *inet_csk_search_req(const struct sock *sk,
 						const __be16 rport,
 						const __be32 raddr,
 						const __be32 laddr);
+extern int inet_csk_reqsk_queued(const struct sock *sk, const __be16 rport,
+				 const __be32 raddr, const __be32 laddr);
 extern int inet_csk_bind_conflict(const struct sock *sk,
 				  const struct inet_bind_bucket *tb);
 extern int inet_csk_get_port(struct sock *sk, unsigned short snum);
@@ -262,12 +264,26 @@ static inline void inet_csk_reqsk_queue_add(struct sock *sk,
 extern void inet_csk_reqsk_queue_hash_add(struct sock *sk,
 					  struct request_sock *req,
 					  unsigned long timeout);
+extern spinlock_t *__inet_csk_reqsk_queue_hash_lock(struct sock *sk,
+						    struct request_sock *req,
+						    const u32 hash,
+						    unsigned long timeout);
+extern spinlock_t *inet_csk_reqsk_queue_hash_lock(struct sock *sk,
+						  struct request_sock *req,
+						  unsigned long timeout);
+extern void inet_csk_reqsk_queue_hash_unlock(struct sock *sk,
+					     struct request_sock *req,
+					     spinlock_t *lock, const int unhash);
 
+/*
+ * The SYN queue timer is not stopped when the queue empties: requests may be
+ * added at the same time, without the listener lock.  It stops by itself on
+ * finding the queue empty, see inet_csk_reqsk_queue_prune().
+ */
 static inline void inet_csk_reqsk_queue_removed(struct sock *sk,
 						struct request_sock *req)
 {
-	if (reqsk_queue_removed(&inet_csk(sk)->icsk_accept_queue, req) == 0)
-		inet_csk_delete_keepalive_timer(sk);
+	reqsk_queue_removed(&inet_csk(sk)->icsk_accept_queue, req);
 }
 
 static inline void inet_csk_reqsk_queue_added(struct sock *sk,
@@ -118,6 +118,7 @@ struct neighbour
 	struct sk_buff_head	arp_queue;
 	struct timer_list	timer;
 	struct neigh_ops	*ops;
+	struct rcu_head		rcu;
 	u8			primary_key[0];
 };
 
@@ -147,6 +148,18 @@ struct pneigh_entry
  *	neighbour table manipulation
  */
 
+/*
+ * The hash of a table, replaced as a whole when it grows.  Lookups walk
+ * it under rcu_read_lock_bh(); changes to it are made under tbl->lock.
+ */
+struct neigh_hash_table
+{
+	struct neighbour	**hash_buckets;
+	unsigned int		hash_mask;
+	__u32			hash_rnd;
+	struct rcu_head		rcu;
+};
+
 
 struct neigh_table
 {
@@ -154,7 +167,9 @@ struct neigh_table
 	int			family;
 	int			entry_size;
 	int			key_len;
-	__u32			(*hash)(const void *pkey, const struct net_device *);
+	__u32			(*hash)(const void *pkey,
+					const struct net_device *dev,
+					__u32 hash_rnd);
 	int			(*constructor)(struct neighbour *);
 	int			(*pconstructor)(struct pneigh_entry *);
 	void			(*pdestructor)(struct pneigh_entry *);
@@ -175,9 +190,7 @@ struct neigh_table
 	unsigned long		last_rand;
 	struct kmem_cache		*kmem_cachep;
 	struct neigh_statistics	*stats;
-	struct neighbour	**hash_buckets;
-	unsigned int		hash_mask;
-	__u32			hash_rnd;
+	struct neigh_hash_table	*nht;
 	unsigned int		hash_chain_gc;
 	struct pneigh_entry	**phash_buckets;
 #ifdef CONFIG_PROC_FS
@@ -57,6 +57,7 @@ struct request_sock {
 	struct sock			*sk;
 	u32				secid;
 	u32				peer_secid;
+	u32				synq_hash; /* bucket in the SYN table */
 };
 
 static inline struct request_sock *reqsk_alloc(const struct request_sock_ops *ops)
@@ -85,33 +86,50 @@ extern int sysctl_max_syn_backlog;
 /** struct listen_sock - listen state
  *
  * @max_qlen_log - log_2 of maximal queued SYNs/REQUESTs
+ * @syn_locks - serialize the SYN table, by slices of buckets
+ *
+ * Requests are queued without the lock of the listening socket, so that
+ * SYNs arriving on all CPUs at once do not serialize on it; see
+ * tcp_v4_rcv_syn().  Queueing a request takes the lock of the slice of
+ * syn_table its bucket is in.  Everything else that changes the table
+ * runs under the listener lock, and only unlinking takes the slice lock
+ * too, to keep out SYNs that are looking for a request of theirs.
+ * Walking a bucket under the listener lock needs no slice lock, as
+ * requests are only ever added at the head of a bucket.
  */
 struct listen_sock {
 	u8			max_qlen_log;
 	/* 3 bytes hole, try to use */
-	int			qlen;
-	int			qlen_young;
+	atomic_t		qlen;
+	atomic_t		qlen_young;
 	int			clock_hand;
 	u32			hash_rnd;
 	u32			nr_table_entries;
+	u32			syn_locks_mask;
+	spinlock_t		*syn_locks;
 	struct request_sock	*syn_table[0];
 };
 
+static inline spinlock_t *reqsk_synq_lockp(struct listen_sock *lopt, u32 hash)
+{
+	return &lopt->syn_locks[hash & lopt->syn_locks_mask];
+}
+
 /** struct request_sock_queue - queue of request_socks
  *
  * @rskq_accept_head - FIFO head of established children
  * @rskq_accept_tail - FIFO tail of established children
  * @rskq_defer_accept - User waits for some data after accept()
+ * @rskq_syn_lockless - SYNs were processed without the listener lock
  * @syn_wait_lock - serializer
  *
  * %syn_wait_lock is necessary only to avoid proc interface having to grab the main
  * lock sock while browsing the listening hash (otherwise it's deadlock prone).
  *
  * This lock is acquired in read mode only from listening_get_next() seq_file
- * op and it's acquired in write mode _only_ from code that is actively
- * changing rskq_accept_head. All readers that are holding the master sock lock
- * don't need to grab this lock in read mode too as rskq_accept_head. writes
- * are always protected from the main sock lock.
+ * op and inet_diag, and in write mode when a request is unlinked from the
+ * SYN table or listen_opt changes.  Requests added to the table meanwhile
+ * are safe for its readers, they only ever go in at the head of a bucket.
  */
 struct request_sock_queue {
 	struct request_sock	*rskq_accept_head;
@@ -120,6 +138,10 @@ struct request_sock_queue {
 	u8			rskq_defer_accept;
 	/* 3 bytes hole, try to pack */
 	struct listen_sock	*listen_opt;
+	/* Set without the listener lock, so not in a word shared with
+	 * fields set under it.
+	 */
+	int			rskq_syn_lockless;
 };
 
 extern int reqsk_queue_alloc(struct request_sock_queue *queue,
@@ -137,6 +159,16 @@ static inline struct request_sock *
 	return req;
 }
 
+/* Tells a listener being stopped to wait for SYNs processed without its lock,
+ * before the caller checks that it is still listening.
+ */
+static inline void reqsk_queue_mark_lockless(struct request_sock_queue *queue)
+{
+	if (!queue->rskq_syn_lockless)
+		queue->rskq_syn_lockless = 1;
+	smp_mb();
+}
+
 static inline int reqsk_queue_empty(struct request_sock_queue *queue)
 {
 	return queue->rskq_accept_head == NULL;
@@ -146,9 +178,18 @@ static inline void reqsk_queue_unlink(struct request_sock_queue *queue,
 				      struct request_sock *req,
 				      struct request_sock **prev_req)
 {
+	spinlock_t *lock = reqsk_synq_lockp(queue->listen_opt, req->synq_hash);
+
+	spin_lock(lock);
 	write_lock(&queue->syn_wait_lock);
+	/* SYNs may have queued requests in front of req since prev_req
+	 * was looked up, if it is the head of the bucket.
+	 */
+	while (*prev_req != req)
+		prev_req = &(*prev_req)->dl_next;
 	*prev_req = req->dl_next;
 	write_unlock(&queue->syn_wait_lock);
+	spin_unlock(lock);
 }
 
 static inline void reqsk_queue_add(struct request_sock_queue *queue,
@@ -194,55 +235,80 @@ static inline struct sock *reqsk_queue_get_child(struct request_sock_queue *queu
 	return child;
 }
 
-static inline int reqsk_queue_removed(struct request_sock_queue *queue,
-				      struct request_sock *req)
+static inline void reqsk_queue_removed(struct request_sock_queue *queue,
+				       struct request_sock *req)
 {
 	struct listen_sock *lopt = queue->listen_opt;
 
 	if (req->retrans == 0)
-		--lopt->qlen_young;
-
-	return --lopt->qlen;
+		atomic_dec(&lopt->qlen_young);
+	atomic_dec(&lopt->qlen);
 }
 
 static inline int reqsk_queue_added(struct request_sock_queue *queue)
 {
 	struct listen_sock *lopt = queue->listen_opt;
-	const int prev_qlen = lopt->qlen;
 
-	lopt->qlen_young++;
-	lopt->qlen++;
-	return prev_qlen;
+	atomic_inc(&lopt->qlen_young);
+	return atomic_inc_return(&lopt->qlen) - 1;
 }
 
 static inline int reqsk_queue_len(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt != NULL ? queue->listen_opt->qlen : 0;
+	return queue->listen_opt != NULL ?
+	       atomic_read(&queue->listen_opt->qlen) : 0;
 }
 
 static inline int reqsk_queue_len_young(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt->qlen_young;
+	return atomic_read(&queue->listen_opt->qlen_young);
 }
 
 static inline int reqsk_queue_is_full(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt->qlen >> queue->listen_opt->max_qlen_log;
+	return atomic_read(&queue->listen_opt->qlen) >>
+	       queue->listen_opt->max_qlen_log;
 }
 
-static inline void reqsk_queue_hash_req(struct request_sock_queue *queue,
-					u32 hash, struct request_sock *req,
-					unsigned long timeout)
+/* The caller holds the lock of the slice of syn_table that hash is in */
+static inline void __reqsk_queue_hash_req(struct request_sock_queue *queue,
+					  u32 hash, struct request_sock *req,
+					  unsigned long timeout)
 {
 	struct listen_sock *lopt = queue->listen_opt;
 
 	req->expires = jiffies + timeout;
 	req->retrans = 0;
 	req->sk = NULL;
+	req->synq_hash = hash;
+
 	req->dl_next = lopt->syn_table[hash];
+	/* Lockless readers of the bucket must see req complete */
+	smp_wmb();
+	lopt->syn_table[hash] = req;
+}
+
+static inline void reqsk_queue_hash_req(struct request_sock_queue *queue,
+					u32 hash, struct request_sock *req,
+					unsigned long timeout)
+{
+	spinlock_t *lock = reqsk_synq_lockp(queue->listen_opt, hash);
+
+	spin_lock(lock);
+	__reqsk_queue_hash_req(queue, hash, req, timeout);
+	spin_unlock(lock);
+}
+
+/* Takes back a request queued by __reqsk_queue_hash_req(), with the slice
+ * lock held since, so that req is still at the head of its bucket.
+ */
+static inline void __reqsk_queue_unhash_req(struct request_sock_queue *queue,
+					    struct request_sock *req)
+{
+	struct listen_sock *lopt = queue->listen_opt;
 
 	write_lock(&queue->syn_wait_lock);
-	lopt->syn_table[hash] = req;
+	lopt->syn_table[req->synq_hash] = req->dl_next;
 	write_unlock(&queue->syn_wait_lock);
 }
 
@@ -166,6 +166,11 @@ extern void tcp_time_wait(struct sock *sk, int state, int timeo);
 #define TCPOPT_SACK             5       /* SACK Block */
 #define TCPOPT_TIMESTAMP	8	/* Better RTT estimations/PAWS */
 #define TCPOPT_MD5SIG		19	/* MD5 Signature (RFC2385) */
+#define TCPOPT_EXP		254	/* Experimental */
+/* Magic number to be after the option value for sharing TCP
+ * experimental options. See draft-ietf-tcpm-experimental-options-00.txt
+ */
+#define TCPOPT_FASTOPEN_MAGIC	0xF989
 
 /*
  *     TCP option lengths
@@ -176,6 +181,7 @@ extern void tcp_time_wait(struct sock *sk, int state, int timeo);
 #define TCPOLEN_SACK_PERM      2
 #define TCPOLEN_TIMESTAMP      10
 #define TCPOLEN_MD5SIG         18
+#define TCPOLEN_EXP_FASTOPEN_BASE  4
 
 /* But this is what stacks really send out. */
 #define TCPOLEN_TSTAMP_ALIGNED		12
@@ -187,6 +193,30 @@ extern void tcp_time_wait(struct sock *sk, int state, int timeo);
 #define TCPOLEN_MD5SIG_ALIGNED		20
 #define TCPOLEN_MSS_ALIGNED		4
 
+/* TCP Fast Open */
+#define TCP_FASTOPEN_COOKIE_MIN	4	/* Min Fast Open Cookie size in bytes */
+#define TCP_FASTOPEN_COOKIE_MAX	16	/* Max Fast Open Cookie size in bytes */
+#define TCP_FASTOPEN_COOKIE_SIZE 8	/* the size employed by this impl. */
+#define TCP_FASTOPEN_KEY_LENGTH	16
+
+/* Bits in sysctl_tcp_fastopen */
+#define	TFO_CLIENT_ENABLE	1
+#define	TFO_SERVER_ENABLE	2
+
+/* Fast Open cookie. Size 0 means a cookie request, -1 means none */
+struct tcp_fastopen_cookie {
+	s8	len;
+	u8	val[TCP_FASTOPEN_COOKIE_MAX];
+};
+
+/* Fast Open state of a connecting socket, only alive inside sendmsg() */
+struct tcp_fastopen_request {
+	/* Fast Open cookie. Size 0 means a cookie request */
+	struct tcp_fastopen_cookie	cookie;
+	struct msghdr			*data;  /* data in MSG_FASTOPEN */
+	int				copied;	/* queued in tcp_connect() */
+};
+
 /* Flags in tp->nonagle */
 #define TCP_NAGLE_OFF		1	/* Nagle's algo is disabled */
 #define TCP_NAGLE_CORK		2	/* Socket is corked	    */
@@ -236,6 +266,7 @@ extern int sysctl_tcp_base_mss;
 extern int sysctl_tcp_workaround_signed_windows;
 extern int sysctl_tcp_slow_start_after_idle;
 extern int sysctl_tcp_max_ssthresh;
+extern int sysctl_tcp_fastopen;
 
 extern atomic_t tcp_memory_allocated;
 extern atomic_t tcp_sockets_allocated;
@@ -395,7 +426,8 @@ extern int			tcp_recvmsg(struct kiocb *iocb, struct sock *sk,
 
 extern void			tcp_parse_options(struct sk_buff *skb,
 						  struct tcp_options_received *opt_rx,
-						  int estab);
+						  int estab,
+						  struct tcp_fastopen_cookie *foc);
 
 extern u8			*tcp_parse_md5sig_option(struct tcphdr *th);
 
@@ -429,7 +461,12 @@ extern int			tcp_connect(struct sock *sk);
 
 extern struct sk_buff *		tcp_make_synack(struct sock *sk,
 						struct dst_entry *dst,
-						struct request_sock *req);
+						struct request_sock *req,
+						struct tcp_fastopen_cookie *foc);
+
+extern void			tcp_openreq_init_rwin(struct request_sock *req,
+						      struct sock *sk,
+						      struct dst_entry *dst);
 
 extern int			tcp_disconnect(struct sock *sk, int flags);
 
@@ -442,6 +479,17 @@ extern __u32 cookie_v4_init_sequence(struct sock *sk, struct sk_buff *skb,
 				     __u16 *mss);
 
 extern __u32 cookie_init_timestamp(struct request_sock *req);
+
+/* Cookies are sent from all CPUs at once, without the listener lock: only
+ * write the stamp when it changes, not to bounce its cache line on every SYN.
+ */
+static inline void tcp_synq_overflow(struct sock *sk)
+{
+	unsigned long now = jiffies;
+
+	if (tcp_sk(sk)->last_synq_overflow != now)
+		tcp_sk(sk)->last_synq_overflow = now;
+}
 extern void cookie_check_timestamp(struct tcp_options_received *tcp_opt);
 
 /* From net/ipv6/syncookies.c */
@@ -495,6 +543,7 @@ extern int tcp_read_sock(struct sock *sk, read_descriptor_t *desc,
 			 sk_read_actor_t recv_actor);
 
 extern void tcp_initialize_rcv_mss(struct sock *sk);
+extern void tcp_init_transfer(struct sock *sk);
 
 extern int tcp_mtu_to_mss(struct sock *sk, int pmtu);
 extern int tcp_mss_to_mtu(struct sock *sk, int mss);
@@ -927,6 +976,54 @@ extern void tcp_set_state(struct sock *sk, int state);
 
 extern void tcp_done(struct sock *sk);
 
+/* A server-side child still in SYN_RECV that came from a Fast Open SYN */
+static inline int tcp_passive_fastopen(const struct sock *sk)
+{
+	return sk->sk_state == TCP_SYN_RECV &&
+	       tcp_sk(sk)->fastopen_rsk != NULL;
+}
+
+/* Release the request a passive Fast Open child keeps until the handshake
+ * completes, for retransmitting the SYN-ACK.
+ */
+static inline void tcp_fastopen_rsk_free(struct tcp_sock *tp)
+{
+	if (tp->fastopen_rsk != NULL) {
+		reqsk_free(tp->fastopen_rsk);
+		tp->fastopen_rsk = NULL;
+	}
+}
+
+/* Whether a segment for a listener is a SYN that may be processed without
+ * the listener lock, see tcp_v4_rcv_syn().  SYNs carrying data may open a
+ * Fast Open child right away and MD5 keys may change under us, so those
+ * take the locked path.  So do SYNs with an MD5 option, to be dropped by
+ * the inbound MD5 check there.
+ */
+static inline int tcp_syn_lockless(struct sock *sk, const struct sk_buff *skb)
+{
+	const struct tcphdr *th = tcp_hdr(skb);
+
+	if (!th->syn || th->ack || th->rst ||
+	    TCP_SKB_CB(skb)->end_seq != TCP_SKB_CB(skb)->seq + 1)
+		return 0;
+#ifdef CONFIG_TCP_MD5SIG
+	if (tcp_parse_md5sig_option((struct tcphdr *)th) != NULL)
+		return 0;
+#endif
+	if (sk->sk_state != TCP_LISTEN)
+		return 0;
+	/* Checked again once marked, inet_csk_listen_stop() may have run */
+	reqsk_queue_mark_lockless(&inet_csk(sk)->icsk_accept_queue);
+	if (sk->sk_state != TCP_LISTEN)
+		return 0;
+#ifdef CONFIG_TCP_MD5SIG
+	if (tcp_sk(sk)->md5sig_info != NULL)
+		return 0;
+#endif
+	return 1;
+}
+
 static inline void tcp_sack_reset(struct tcp_options_received *rx_opt)
 {
 	rx_opt->dsack = 0;
@@ -967,6 +1064,7 @@ static inline void tcp_openreq_init(struct request_sock *req,
 	req->rcv_wnd = 0;		/* So that tcp_send_synack() knows! */
 	req->cookie_ts = 0;
 	tcp_rsk(req)->rcv_isn = TCP_SKB_CB(skb)->seq;
+	tcp_rsk(req)->rcv_nxt = TCP_SKB_CB(skb)->seq + 1;
 	req->mss = rx_opt->mss_clamp;
 	req->ts_recent = rx_opt->saw_tstamp ? rx_opt->rcv_tsval : 0;
 	ireq->tstamp_ok = rx_opt->tstamp_ok;
@@ -1358,6 +1456,12 @@ extern void tcp_v4_destroy_sock(struct sock *sk);
 
 extern int tcp_v4_gso_send_check(struct sk_buff *skb);
 extern struct sk_buff *tcp_tso_segment(struct sk_buff *skb, int features);
+extern struct sk_buff **tcp_gro_receive(struct sk_buff **head,
+					struct sk_buff *skb);
+extern struct sk_buff **tcp4_gro_receive(struct sk_buff **head,
+					 struct sk_buff *skb);
+extern int tcp_gro_complete(struct sk_buff *skb);
+extern int tcp4_gro_complete(struct sk_buff *skb);
 
 #ifdef CONFIG_PROC_FS
 extern int  tcp4_proc_init(void);
@@ -1394,4 +1498,20 @@ struct tcp_request_sock_ops {
 extern void tcp_v4_init(void);
 extern void tcp_init(void);
 
+/* From tcp_fastopen.c */
+extern void tcp_fastopen_init(void);
+extern int proc_tcp_fastopen_key(struct ctl_table *table, int write,
+				 struct file *filp, void __user *buffer,
+				 size_t *lenp, loff_t *ppos);
+extern int tcp_fastopen_check(struct sock *sk, struct sk_buff *skb,
+			      struct request_sock *req,
+			      struct tcp_fastopen_cookie *foc);
+extern int tcp_fastopen_create_child(struct sock *sk, struct sk_buff *skb,
+				     struct request_sock *req,
+				     struct dst_entry *dst);
+extern void tcp_fastopen_cache_get(struct sock *sk, u16 *mss,
+				   struct tcp_fastopen_cookie *cookie);
+extern void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+				   struct tcp_fastopen_cookie *cookie);
+
 #endif	/* _TCP_H */
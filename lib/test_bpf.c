@@ -0,0 +1,681 @@
+/*
+ * Testsuite for the BPF interpreter and JIT compiler
+ *
+ * Runs each filter of the table below through sk_run_filter() and, if
+ * the JIT is enabled with net.core.bpf_jit_enable, through its compiled
+ * code, on packets of the given sizes, and checks that both return what
+ * the filter is expected to.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/filter.h>
+#include <linux/skbuff.h>
+#include <linux/netdevice.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+#define MAX_SUBTESTS	3
+#define MAX_INSNS	64
+#define MAX_DATA	64
+
+/* Properties of the packets the filters run on */
+#define SKB_PROTO	0x0800	/* ETH_P_IP */
+#define SKB_TYPE	PACKET_OTHERHOST
+#define SKB_DEV_IFINDEX	577
+
+/* Flags of a test */
+#define FLAG_NO_DATA	1	/* run on an empty packet */
+#define FLAG_SKB_FRAG	2	/* append frag_data in a page fragment */
+#define FLAG_NO_DEV	4	/* packet has no skb->dev */
+
+#define SKF_AD(x)	(SKF_AD_OFF + SKF_AD_##x)
+
+struct bpf_test {
+	const char *descr;
+	struct sock_filter insns[MAX_INSNS];
+	int flags;
+	u8 data[MAX_DATA];
+	struct {
+		int data_size;	/* bytes of data in the linear part */
+		u32 result;
+	} test[MAX_SUBTESTS];
+	u8 frag_data[MAX_DATA];	/* with FLAG_SKB_FRAG */
+	int frag_size;
+};
+
+static struct bpf_test tests[] = {
+	{
+		"TAX",
+		{
+			BPF_STMT(BPF_LD|BPF_IMM, 1),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_IMM, 2),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_ALU|BPF_NEG, 0), /* A == -3 */
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_W|BPF_LEN, 0),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0), /* X == len - 3 */
+			BPF_STMT(BPF_LD|BPF_B|BPF_IND, 1),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		0,
+		{ 10, 20, 30, 40, 50 },
+		{ { 2, 10 }, { 3, 20 }, { 4, 30 } },
+	},
+	{
+		"TXA",
+		{
+			BPF_STMT(BPF_LDX|BPF_W|BPF_LEN, 0),
+			BPF_STMT(BPF_MISC|BPF_TXA, 0),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0) /* A == len * 2 */
+		},
+		0,
+		{ 10, 20, 30, 40, 50 },
+		{ { 1, 2 }, { 3, 6 }, { 4, 8 } },
+	},
+	{
+		"ADD_SUB_MUL_K",
+		{
+			BPF_STMT(BPF_LD|BPF_IMM, 1),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_K, 2),
+			BPF_STMT(BPF_LDX|BPF_IMM, 3),
+			BPF_STMT(BPF_ALU|BPF_SUB|BPF_X, 0),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_K, 0xffffffff),
+			BPF_STMT(BPF_ALU|BPF_MUL|BPF_K, 3),
+			BPF_STMT(BPF_ALU|BPF_SUB|BPF_K, 0x1000),
+			BPF_STMT(BPF_ALU|BPF_MUL|BPF_K, 0x10001),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		FLAG_NO_DATA,
+		{ },
+		{ { 0, 0xeffceffd } },
+	},
+	{
+		"DIV_KX",
+		{
+			BPF_STMT(BPF_LD|BPF_IMM, 8),
+			BPF_STMT(BPF_ALU|BPF_DIV|BPF_K, 2),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_IMM, 0xffffffff),
+			BPF_STMT(BPF_ALU|BPF_DIV|BPF_X, 0),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_IMM, 0xffffffff),
+			BPF_STMT(BPF_ALU|BPF_DIV|BPF_K, 0x70000000),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		FLAG_NO_DATA,
+		{ },
+		{ { 0, 0x40000001 } },
+	},
+	{
+		"DIV_X_ZERO",
+		{
+			BPF_STMT(BPF_LD|BPF_IMM, 1),
+			BPF_STMT(BPF_LDX|BPF_W|BPF_LEN, 0),
+			BPF_STMT(BPF_ALU|BPF_DIV|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_K, 5)
+		},
+		0,
+		{ 1, 2, 3 },
+		{ { 0, 0 }, { 3, 5 } },
+	},
+	{
+		"AND_OR_LSH_K",
+		{
+			BPF_STMT(BPF_LD|BPF_IMM, 0xff),
+			BPF_STMT(BPF_ALU|BPF_AND|BPF_K, 0xf0),
+			BPF_STMT(BPF_ALU|BPF_LSH|BPF_K, 27),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_IMM, 0xf),
+			BPF_STMT(BPF_ALU|BPF_OR|BPF_K, 0xf0),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		FLAG_NO_DATA,
+		{ },
+		{ { 0, 0x800000ff } },
+	},
+	{
+		"ALU_MASKS_SHIFTS",
+		{
+			BPF_STMT(BPF_LD|BPF_IMM, 0x12345678),
+			BPF_STMT(BPF_ALU|BPF_AND|BPF_K, 0xffffff0f),
+			BPF_STMT(BPF_ALU|BPF_AND|BPF_K, 0xffff0fff),
+			BPF_STMT(BPF_ALU|BPF_AND|BPF_K, 0x0fffffff),
+			BPF_STMT(BPF_LDX|BPF_IMM, 4),
+			BPF_STMT(BPF_ALU|BPF_LSH|BPF_X, 0),
+			BPF_STMT(BPF_ALU|BPF_RSH|BPF_K, 1),
+			BPF_STMT(BPF_ALU|BPF_RSH|BPF_X, 0),
+			BPF_STMT(BPF_ALU|BPF_LSH|BPF_K, 1),
+			BPF_STMT(BPF_ALU|BPF_RSH|BPF_K, 2),
+			BPF_STMT(BPF_LDX|BPF_IMM, 3),
+			BPF_STMT(BPF_ALU|BPF_MUL|BPF_X, 0),
+			BPF_STMT(BPF_LDX|BPF_IMM, 0xc),
+			BPF_STMT(BPF_ALU|BPF_SUB|BPF_X, 0),
+			BPF_STMT(BPF_ALU|BPF_OR|BPF_X, 0),
+			BPF_STMT(BPF_ALU|BPF_OR|BPF_K, 0x10000000),
+			BPF_STMT(BPF_LDX|BPF_IMM, 0xfffff0ff),
+			BPF_STMT(BPF_ALU|BPF_AND|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		FLAG_NO_DATA,
+		{ },
+		{ { 0, 0x11a7007e } },
+	},
+	{
+		"LD_ST_MEM",
+		{
+			BPF_STMT(BPF_LD|BPF_IMM, 1),
+			BPF_STMT(BPF_ST, 0),
+			BPF_STMT(BPF_LD|BPF_IMM, 2),
+			BPF_STMT(BPF_ST, 15),
+			BPF_STMT(BPF_LDX|BPF_IMM, 3),
+			BPF_STMT(BPF_STX, 7),
+			BPF_STMT(BPF_LD|BPF_MEM, 0),
+			BPF_STMT(BPF_LDX|BPF_MEM, 15),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_MEM, 7),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		FLAG_NO_DATA,
+		{ },
+		{ { 0, 6 } },
+	},
+	{
+		"LD_ABS",
+		{
+			BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 0),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 1),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS, 3),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		0,
+		{ 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07 },
+		{ { 7, 0x0405080b }, { 6, 0 }, { 2, 0 } },
+	},
+	{
+		"LD_IND",
+		{
+			BPF_STMT(BPF_LDX|BPF_IMM, 2),
+			BPF_STMT(BPF_LD|BPF_B|BPF_IND, 0),
+			BPF_STMT(BPF_ST, 1),
+			BPF_STMT(BPF_LD|BPF_H|BPF_IND, 1),
+			BPF_STMT(BPF_ST, 2),
+			BPF_STMT(BPF_LD|BPF_W|BPF_IND, -1),
+			BPF_STMT(BPF_LDX|BPF_MEM, 1),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_LDX|BPF_MEM, 2),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		0,
+		{ 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 },
+		{ { 6, 0x0203080d }, { 5, 0x0203080d }, { 4, 0 } },
+	},
+	{
+		"LD_ABS_NEG_OFFSETS",
+		{
+			BPF_STMT(BPF_LD|BPF_B|BPF_ABS, SKF_LL_OFF + 1),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_H|BPF_ABS, SKF_NET_OFF + 2),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_B|BPF_IND, SKF_NET_OFF - 0x2fc),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		0,
+		{ 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+		  0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10 },
+		{ { 16, 0x0b }, { 6, 0 } },
+	},
+	{
+		"LD_ABS_OUT_OF_RANGE",
+		{
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS, 0x7ffffffc),
+			BPF_STMT(BPF_RET|BPF_K, 1)
+		},
+		0,
+		{ 1, 2, 3, 4 },
+		{ { 4, 0 } },
+	},
+	{
+		"LD_FRAG",
+		{
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS, 2),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 5),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 1),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		FLAG_SKB_FRAG,
+		{ 0x01, 0x02, 0x03, 0x04 },
+		{ { 4, 0x03040b0f } },
+		{ 0x05, 0x06, 0x07, 0x08 },
+		4,
+	},
+	{
+		"LDX_MSH",
+		{
+			BPF_STMT(BPF_LDX|BPF_B|BPF_MSH, 1),
+			BPF_STMT(BPF_LD|BPF_IMM, 0x1000),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_LDX|BPF_B|BPF_MSH, 5),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		FLAG_SKB_FRAG,
+		{ 0x00, 0x45, 0x00, 0x00 },
+		{ { 4, 0x1030 } },
+		{ 0x00, 0x47 },
+		2,
+	},
+	{
+		"LDX_MSH_ANCILLARY",
+		{
+			BPF_STMT(BPF_LD|BPF_IMM, 1),
+			BPF_STMT(BPF_LDX|BPF_B|BPF_MSH, SKF_AD(PROTOCOL)),
+			BPF_STMT(BPF_RET|BPF_K, 1)
+		},
+		0,
+		{ 0x45 },
+		{ { 1, 0 } },
+	},
+	{
+		"LD_PROTOCOL",
+		{
+			BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 0),
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 20, 1, 0),
+			BPF_STMT(BPF_RET|BPF_K, 0),
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS, SKF_AD(PROTOCOL)),
+			BPF_STMT(BPF_ST, 0),
+			BPF_STMT(BPF_LD|BPF_H|BPF_ABS, SKF_AD(PROTOCOL)),
+			BPF_STMT(BPF_LDX|BPF_MEM, 0),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		0,
+		{ 10, 20, 30 },
+		{ { 10, 0 }, { 60, 0 } },
+	},
+	{
+		"LD_PROTOCOL_FIRST",
+		{
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS, SKF_AD(PROTOCOL)),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		0,
+		{ },
+		{ { 1, SKB_PROTO } },
+	},
+	{
+		"LD_PKTTYPE",
+		{
+			BPF_STMT(BPF_LD|BPF_B|BPF_ABS, SKF_AD(PKTTYPE)),
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, SKB_TYPE, 1, 0),
+			BPF_STMT(BPF_RET|BPF_K, 1),
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS, SKF_AD(PKTTYPE)),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_K, 10),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		0,
+		{ },
+		{ { 1, SKB_TYPE + 10 }, { 10, SKB_TYPE + 10 } },
+	},
+	{
+		"LD_IFINDEX",
+		{
+			BPF_STMT(BPF_LD|BPF_H|BPF_ABS, SKF_AD(IFINDEX)),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		0,
+		{ },
+		{ { 1, SKB_DEV_IFINDEX }, { 10, SKB_DEV_IFINDEX } },
+	},
+	{
+		"LD_IFINDEX_NO_DEV",
+		{
+			BPF_STMT(BPF_LDX|BPF_IMM, 7),
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS, SKF_AD(IFINDEX)),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		FLAG_NO_DEV,
+		{ },
+		{ { 1, 0 } },
+	},
+	{
+		"LD_NLATTR",
+		{
+			BPF_STMT(BPF_LD|BPF_IMM, 0),
+			BPF_STMT(BPF_LDX|BPF_IMM, 3),
+			BPF_STMT(BPF_LD|BPF_B|BPF_ABS, SKF_AD(NLATTR)),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_IMM, 0),
+			BPF_STMT(BPF_LD|BPF_B|BPF_ABS, SKF_AD(NLATTR)),
+			BPF_STMT(BPF_ALU|BPF_LSH|BPF_K, 8),
+			BPF_STMT(BPF_ALU|BPF_OR|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		0,
+#ifdef __BIG_ENDIAN
+		{ 0x00, 0x08, 0x00, 0x02, 0xaa, 0xbb, 0xcc, 0xdd,
+		  0x00, 0x08, 0x00, 0x03, 0xaa, 0xbb, 0xcc, 0xdd },
+#else
+		{ 0x08, 0x00, 0x02, 0x00, 0xaa, 0xbb, 0xcc, 0xdd,
+		  0x08, 0x00, 0x03, 0x00, 0xaa, 0xbb, 0xcc, 0xdd },
+#endif
+		{ { 16, 8 }, { 4, 0 } },
+	},
+	{
+		"LD_ANCILLARY_UNKNOWN",
+		{
+			BPF_STMT(BPF_LD|BPF_IMM, 1),
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_MAX),
+			BPF_STMT(BPF_RET|BPF_K, 1)
+		},
+		0,
+		{ },
+		{ { 1, 0 } },
+	},
+	{
+		"JA",
+		{
+			BPF_JUMP(BPF_JMP|BPF_JA, 1, 0, 0),
+			BPF_STMT(BPF_RET|BPF_K, 0),
+			BPF_STMT(BPF_LD|BPF_IMM, 2),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		FLAG_NO_DATA,
+		{ },
+		{ { 0, 2 } },
+	},
+	{
+		"JGT_JGE_JEQ_JSET_K",
+		{
+			BPF_STMT(BPF_LD|BPF_W|BPF_LEN, 0),
+			BPF_JUMP(BPF_JMP|BPF_JGT|BPF_K, 3, 0, 1),
+			BPF_STMT(BPF_RET|BPF_K, 10),
+			BPF_JUMP(BPF_JMP|BPF_JGE|BPF_K, 2, 0, 1),
+			BPF_STMT(BPF_RET|BPF_K, 20),
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0, 1, 0),
+			BPF_STMT(BPF_RET|BPF_K, 30),
+			BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 0),
+			BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x1, 1, 0),
+			BPF_STMT(BPF_RET|BPF_K, 40),
+			BPF_STMT(BPF_RET|BPF_K, 50)
+		},
+		0,
+		{ 0x01, 0x02, 0x03, 0x04 },
+		{ { 4, 10 }, { 2, 20 }, { 1, 30 } },
+	},
+	{
+		"JEQ_JSET_K_WIDE",
+		{
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS, 0),
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x01020304, 1, 0),
+			BPF_STMT(BPF_RET|BPF_K, 1),
+			BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x00000300, 1, 0),
+			BPF_STMT(BPF_RET|BPF_K, 2),
+			BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x00000204, 1, 0),
+			BPF_STMT(BPF_RET|BPF_K, 3),
+			BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x00010000, 0, 1),
+			BPF_STMT(BPF_RET|BPF_K, 4),
+			BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0xf0000000, 0, 1),
+			BPF_STMT(BPF_RET|BPF_K, 5),
+			BPF_JUMP(BPF_JMP|BPF_JGE|BPF_K, 0x01020305, 1, 0),
+			BPF_STMT(BPF_RET|BPF_K, 6),
+			BPF_STMT(BPF_RET|BPF_K, 7)
+		},
+		0,
+		{ 0x01, 0x02, 0x03, 0x04 },
+		{ { 4, 6 } },
+	},
+	{
+		"JGT_JGE_JEQ_JSET_X",
+		{
+			BPF_STMT(BPF_LDX|BPF_W|BPF_LEN, 0),
+			BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 0),
+			BPF_JUMP(BPF_JMP|BPF_JGT|BPF_X, 0, 0, 1),
+			BPF_STMT(BPF_RET|BPF_K, 10),
+			BPF_JUMP(BPF_JMP|BPF_JGE|BPF_X, 0, 0, 1),
+			BPF_STMT(BPF_RET|BPF_K, 20),
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_X, 0, 0, 1),
+			BPF_STMT(BPF_RET|BPF_K, 30),
+			BPF_STMT(BPF_RET|BPF_K, 40)
+		},
+		0,
+		{ 0x03 },
+		{ { 1, 10 }, { 3, 20 } },
+	},
+	{
+		"JSET_X",
+		{
+			BPF_STMT(BPF_LDX|BPF_W|BPF_LEN, 0),
+			BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 0),
+			BPF_JUMP(BPF_JMP|BPF_JSET|BPF_X, 0, 1, 0),
+			BPF_STMT(BPF_RET|BPF_K, 10),
+			BPF_STMT(BPF_RET|BPF_K, 20)
+		},
+		0,
+		{ 0x05, 0x00, 0x00 },
+		{ { 1, 20 }, { 2, 10 }, { 3, 20 } },
+	},
+	{
+		"JMP_SAME_TARGETS",
+		{
+			BPF_STMT(BPF_LD|BPF_W|BPF_LEN, 0),
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 1, 1, 1),
+			BPF_STMT(BPF_RET|BPF_K, 1),
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		0,
+		{ 1, 2 },
+		{ { 1, 1 }, { 2, 2 } },
+	},
+	{
+		"JMP_FAR",
+		{
+			BPF_STMT(BPF_LD|BPF_W|BPF_LEN, 0),
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 2, 0, 40),
+#define ADD_K	BPF_STMT(BPF_ALU|BPF_ADD|BPF_K, 0x100000)
+			ADD_K, ADD_K, ADD_K, ADD_K, ADD_K, ADD_K, ADD_K, ADD_K,
+			ADD_K, ADD_K, ADD_K, ADD_K, ADD_K, ADD_K, ADD_K, ADD_K,
+			ADD_K, ADD_K, ADD_K, ADD_K, ADD_K, ADD_K, ADD_K, ADD_K,
+			ADD_K, ADD_K, ADD_K, ADD_K, ADD_K, ADD_K, ADD_K, ADD_K,
+			ADD_K, ADD_K, ADD_K, ADD_K, ADD_K, ADD_K, ADD_K, ADD_K,
+#undef ADD_K
+			BPF_STMT(BPF_RET|BPF_A, 0)
+		},
+		0,
+		{ 1, 2, 3 },
+		{ { 1, 1 }, { 2, 0x2800002 }, { 3, 3 } },
+	},
+	{
+		"RET_MIDDLE",
+		{
+			BPF_STMT(BPF_LDX|BPF_IMM, 1),
+			BPF_STMT(BPF_LD|BPF_W|BPF_LEN, 0),
+			BPF_JUMP(BPF_JMP|BPF_JGE|BPF_K, 2, 0, 2),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0),
+			BPF_STMT(BPF_RET|BPF_K, 0xfffffff0)
+		},
+		0,
+		{ 1, 2 },
+		{ { 1, 0xfffffff0 }, { 2, 3 } },
+	},
+};
+
+static struct net_device dev;
+
+static int get_length(struct sock_filter *fp)
+{
+	int len;
+
+	for (len = MAX_INSNS - 1; len > 0; --len)
+		if (fp[len].code != 0 || fp[len].k != 0)
+			break;
+
+	return len + 1;
+}
+
+static struct sk_buff *populate_skb(struct bpf_test *test, int size)
+{
+	struct sk_buff *skb;
+	struct page *page;
+
+	skb = alloc_skb(MAX_DATA, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	memcpy(__skb_put(skb, size), test->data, size);
+	skb_reset_mac_header(skb);
+	skb_reset_network_header(skb);
+	skb->protocol = htons(SKB_PROTO);
+	skb->pkt_type = SKB_TYPE;
+	if (!(test->flags & FLAG_NO_DEV))
+		skb->dev = &dev;
+
+	if (test->flags & FLAG_SKB_FRAG) {
+		page = alloc_page(GFP_KERNEL);
+		if (!page) {
+			kfree_skb(skb);
+			return NULL;
+		}
+		memcpy(page_address(page), test->frag_data, test->frag_size);
+		skb_add_rx_frag(skb, 0, page, 0, test->frag_size);
+	}
+	return skb;
+}
+
+static struct sk_filter *generate_filter(struct bpf_test *test)
+{
+	unsigned int flen = get_length(test->insns);
+	unsigned int fsize = flen * sizeof(struct sock_filter);
+	struct sk_filter *fp;
+	int err;
+
+	fp = kmalloc(sizeof(*fp) + fsize, GFP_KERNEL);
+	if (!fp)
+		return ERR_PTR(-ENOMEM);
+
+	atomic_set(&fp->refcnt, 1);
+	fp->len = flen;
+#ifdef CONFIG_BPF_JIT
+	fp->bpf_func = NULL;
+#endif
+	memcpy(fp->insns, test->insns, fsize);
+
+	err = sk_chk_filter(fp->insns, fp->len);
+	if (err) {
+		kfree(fp);
+		return ERR_PTR(err);
+	}
+
+	bpf_jit_compile(fp);
+	return fp;
+}
+
+static int run_one(struct bpf_test *test, struct sk_filter *fp)
+{
+	int err = 0;
+	int i;
+
+	for (i = 0; i < MAX_SUBTESTS; i++) {
+		int size = test->test[i].data_size;
+		u32 expected = test->test[i].result;
+		struct sk_buff *skb;
+		u32 ret;
+
+		if (size == 0 && i > 0)
+			break;
+
+		skb = populate_skb(test, size);
+		if (!skb) {
+			printk(KERN_CONT "alloc_skb failed ");
+			return -ENOMEM;
+		}
+
+		ret = sk_run_filter(skb, fp->insns, fp->len);
+		if (ret != expected) {
+			printk(KERN_CONT "size %d: interpreter ret %u != %u ",
+				size, ret, expected);
+			err++;
+		}
+
+		ret = SK_RUN_FILTER(fp, skb);
+		if (ret != expected) {
+			printk(KERN_CONT "size %d: JIT ret %u != %u ",
+				size, ret, expected);
+			err++;
+		}
+		kfree_skb(skb);
+	}
+	return err;
+}
+
+static int __init test_bpf_init(void)
+{
+	int i, err, jited = 0, err_cnt = 0, pass_cnt = 0;
+	struct sk_filter *fp;
+
+	dev.ifindex = SKB_DEV_IFINDEX;
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		printk(KERN_INFO "test_bpf: #%d %s ", i, tests[i].descr);
+
+		fp = generate_filter(&tests[i]);
+		if (IS_ERR(fp)) {
+			printk(KERN_CONT "FAIL to attach %ld\n", PTR_ERR(fp));
+			err_cnt++;
+			continue;
+		}
+
+#ifdef CONFIG_BPF_JIT
+		if (fp->bpf_func)
+			jited++;
+#endif
+		err = run_one(&tests[i], fp);
+
+		bpf_jit_free(fp);
+		kfree(fp);
+
+		if (err) {
+			printk(KERN_CONT "FAIL (%d times)\n", err);
+			err_cnt++;
+		} else {
+			printk(KERN_CONT "PASS\n");
+			pass_cnt++;
+		}
+	}
+
+	printk(KERN_INFO "test_bpf: Summary: %d PASSED, %d FAILED, %d JIT compiled\n",
+	       pass_cnt, err_cnt, jited);
+	return err_cnt ? -EINVAL : 0;
+}
+
+static void __exit test_bpf_exit(void)
+{
+}
+
+module_init(test_bpf_init);
+module_exit(test_bpf_exit);
+MODULE_LICENSE("GPL");
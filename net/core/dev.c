@@ -161,6 +161,9 @@
 #define PTYPE_HASH_SIZE	(16)
 #define PTYPE_HASH_MASK	(PTYPE_HASH_SIZE - 1)
 
+/* Number of flows GRO holds packets of, per napi context */
+#define MAX_GRO_SKBS	8
+
 static DEFINE_SPINLOCK(ptype_lock);
 static struct list_head ptype_base[PTYPE_HASH_SIZE] __read_mostly;
 static struct list_head ptype_all __read_mostly;	/* Taps */
@@ -1695,7 +1698,7 @@ out_kfree_skb:
 static u32 simple_tx_hashrnd;
 static int simple_tx_hashrnd_initialized = 0;
 
-static u16 simple_tx_hash(struct net_device *dev, struct sk_buff *skb)
+static u32 __simple_tx_hash(struct sk_buff *skb)
 {
 	u32 addr1, addr2, ports;
 	u32 hash, ihl;
@@ -1743,9 +1746,131 @@ static u16 simple_tx_hash(struct net_device *dev, struct sk_buff *skb)
 
 	hash = jhash_3words(addr1, addr2, ports, simple_tx_hashrnd);
 
+	return hash;
+}
+
+static u16 simple_tx_hash(struct net_device *dev, struct sk_buff *skb)
+{
+	u32 hash = __simple_tx_hash(skb);
+
 	return (u16) (((u64) hash * dev->real_num_tx_queues) >> 32);
 }
 
+#ifdef CONFIG_XPS
+/*
+ * The TX queue the xps_cpus of its queues have the current CPU transmit
+ * on, or -1 if they give it none.
+ */
+static int get_xps_queue(struct net_device *dev, struct sk_buff *skb)
+{
+	struct xps_dev_maps *dev_maps;
+	struct xps_map *map;
+	int queue_index = -1;
+
+	rcu_read_lock();
+	dev_maps = rcu_dereference(dev->xps_maps);
+	if (dev_maps) {
+		map = dev_maps->cpu_map[raw_smp_processor_id()];
+		if (map) {
+			if (map->len == 1)
+				queue_index = map->queues[0];
+			else
+				queue_index = map->queues[((u64)__simple_tx_hash(skb) *
+							   map->len) >> 32];
+			if (unlikely(queue_index >= dev->real_num_tx_queues))
+				queue_index = -1;
+		}
+	}
+	rcu_read_unlock();
+
+	return queue_index;
+}
+
+static void xps_dev_maps_free(struct xps_dev_maps *dev_maps)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		kfree(dev_maps->cpu_map[cpu]);
+	kfree(dev_maps);
+}
+
+static void xps_dev_maps_release(struct rcu_head *rcu)
+{
+	xps_dev_maps_free(container_of(rcu, struct xps_dev_maps, rcu));
+}
+
+/**
+ *	netif_set_xps_queue - set the CPUs that transmit on a TX queue
+ *	@dev: network device
+ *	@mask: the CPUs
+ *	@index: index of the TX queue
+ *
+ *	The CPUs of @mask transmit on queue @index and the other queues
+ *	whose masks they are in.  Caller must hold the rtnl semaphore.
+ */
+int netif_set_xps_queue(struct net_device *dev, const cpumask_t *mask,
+			u16 index)
+{
+	struct xps_dev_maps *dev_maps, *new_dev_maps;
+	struct xps_map *map, *new_map;
+	int cpu, i, n, empty = 1;
+
+	ASSERT_RTNL();
+
+	new_dev_maps = kzalloc(XPS_DEV_MAPS_SIZE, GFP_KERNEL);
+	if (!new_dev_maps)
+		return -ENOMEM;
+
+	dev_maps = dev->xps_maps;
+	for_each_possible_cpu(cpu) {
+		map = dev_maps ? dev_maps->cpu_map[cpu] : NULL;
+
+		n = !!cpu_isset(cpu, *mask);
+		for (i = 0; map && i < map->len; i++)
+			if (map->queues[i] != index)
+				n++;
+		if (!n)
+			continue;
+
+		new_map = kmalloc(XPS_MAP_SIZE(n), GFP_KERNEL);
+		if (!new_map)
+			goto nomem;
+
+		n = 0;
+		for (i = 0; map && i < map->len; i++)
+			if (map->queues[i] != index)
+				new_map->queues[n++] = map->queues[i];
+		if (cpu_isset(cpu, *mask))
+			new_map->queues[n++] = index;
+		new_map->len = n;
+
+		new_dev_maps->cpu_map[cpu] = new_map;
+		empty = 0;
+	}
+
+	if (empty) {
+		kfree(new_dev_maps);
+		new_dev_maps = NULL;
+	}
+
+	rcu_assign_pointer(dev->xps_maps, new_dev_maps);
+	if (dev_maps)
+		call_rcu(&dev_maps->rcu, xps_dev_maps_release);
+	return 0;
+
+nomem:
+	xps_dev_maps_free(new_dev_maps);
+	return -ENOMEM;
+}
+EXPORT_SYMBOL(netif_set_xps_queue);
+#else
+static inline int get_xps_queue(struct net_device *dev, struct sk_buff *skb)
+{
+	return -1;
+}
+#endif /* CONFIG_XPS */
+
 static struct netdev_queue *dev_pick_tx(struct net_device *dev,
 					struct sk_buff *skb)
 {
@@ -1753,8 +1878,32 @@ static struct netdev_queue *dev_pick_tx(struct net_device *dev,
 
 	if (dev->select_queue)
 		queue_index = dev->select_queue(dev, skb);
-	else if (dev->real_num_tx_queues > 1)
-		queue_index = simple_tx_hash(dev, skb);
+	else if (dev->real_num_tx_queues > 1) {
+		struct sock *sk = skb->sk;
+		int xps_queue, routed;
+
+		/*
+		 * A socket keeps its queue while it has packets in flight
+		 * besides this one, so that they are not reordered when it
+		 * sends from another CPU.  The queue was picked for the
+		 * device of the socket's route, packets that do not follow
+		 * it neither use nor change it.
+		 */
+		routed = sk && skb->dst && sk->sk_dst_cache == skb->dst;
+		if (routed && sk_tx_queue_get(sk) >= 0 &&
+		    sk_tx_queue_get(sk) < dev->real_num_tx_queues &&
+		    atomic_read(&sk->sk_wmem_alloc) > skb->truesize)
+			queue_index = sk_tx_queue_get(sk);
+		else {
+			xps_queue = get_xps_queue(dev, skb);
+			if (xps_queue >= 0)
+				queue_index = xps_queue;
+			else
+				queue_index = simple_tx_hash(dev, skb);
+			if (routed)
+				sk_tx_queue_set(sk, queue_index);
+		}
+	}
 
 	skb_set_queue_mapping(skb, queue_index);
 	return netdev_get_tx_queue(dev, queue_index);
@@ -1910,53 +2059,269 @@ int weight_p __read_mostly = 64;            /* old backlog weight */
 
 DEFINE_PER_CPU(struct netif_rx_stats, netdev_rx_stat) = { 0, };
 
+static u32 rxhash_rnd __read_mostly;
 
-/**
- *	netif_rx	-	post buffer to the network code
- *	@skb: buffer to post
- *
- *	This function receives a packet from a device driver and queues it for
- *	the upper (protocol) levels to process.  It always succeeds. The buffer
- *	may be dropped during processing for congestion control or by the
- *	protocol layers.
+/*
+ * Hash of the addresses and ports of a received packet, ordered so that
+ * both directions of a flow hash alike.  Called before the network header
+ * is set, with skb->data at it.
+ */
+__u32 __skb_get_rxhash(struct sk_buff *skb)
+{
+	struct ipv6hdr *ip6;
+	struct iphdr *ip;
+	u32 addr1, addr2, ihl, hash;
+	u8 ip_proto = 0;
+	union {
+		u32 v32;
+		u16 v16[2];
+	} ports;
+	u16 port;
+
+	switch (skb->protocol) {
+	case htons(ETH_P_IP):
+		if (!pskb_may_pull(skb, sizeof(*ip)))
+			return 0;
+		ip = (struct iphdr *)skb->data;
+		if (!(ip->frag_off & htons(IP_MF | IP_OFFSET)))
+			ip_proto = ip->protocol;
+		addr1 = (__force u32)ip->saddr;
+		addr2 = (__force u32)ip->daddr;
+		ihl = ip->ihl;
+		break;
+	case htons(ETH_P_IPV6):
+		if (!pskb_may_pull(skb, sizeof(*ip6)))
+			return 0;
+		ip6 = (struct ipv6hdr *)skb->data;
+		ip_proto = ip6->nexthdr;
+		addr1 = (__force u32)ip6->saddr.s6_addr32[3];
+		addr2 = (__force u32)ip6->daddr.s6_addr32[3];
+		ihl = (40 >> 2);
+		break;
+	default:
+		return 0;
+	}
+
+	ports.v32 = 0;
+	switch (ip_proto) {
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+	case IPPROTO_DCCP:
+	case IPPROTO_SCTP:
+	case IPPROTO_UDPLITE:
+		if (pskb_may_pull(skb, ihl * 4 + 4)) {
+			ports.v32 = *(u32 *)(skb->data + ihl * 4);
+			if (ports.v16[1] < ports.v16[0]) {
+				port = ports.v16[0];
+				ports.v16[0] = ports.v16[1];
+				ports.v16[1] = port;
+			}
+		}
+		break;
+	}
+
+	if (addr2 < addr1) {
+		hash = addr1;
+		addr1 = addr2;
+		addr2 = hash;
+	}
+
+	hash = jhash_3words(addr1, addr2, ports.v32, rxhash_rnd);
+	return hash ? : 1;
+}
+EXPORT_SYMBOL(__skb_get_rxhash);
+
+/*
+ * The input_pkt_queue of a CPU is only ever touched with interrupts
+ * disabled.  Receive packet steering has other CPUs queue to it, which
+ * they then do under its lock.
+ */
+static inline void rps_lock(struct softnet_data *queue)
+{
+#ifdef CONFIG_RPS
+	spin_lock(&queue->input_pkt_queue.lock);
+#endif
+}
+
+static inline void rps_unlock(struct softnet_data *queue)
+{
+#ifdef CONFIG_RPS
+	spin_unlock(&queue->input_pkt_queue.lock);
+#endif
+}
+
+static inline void input_queue_head_incr(struct softnet_data *queue)
+{
+#ifdef CONFIG_RPS
+	queue->input_queue_head++;
+#endif
+}
+
+/* Called with interrupts disabled */
+static inline void ____napi_schedule(struct softnet_data *sd,
+				     struct napi_struct *napi)
+{
+	list_add_tail(&napi->poll_list, &sd->poll_list);
+	__raise_softirq_irqoff(NET_RX_SOFTIRQ);
+}
+
+#ifdef CONFIG_RPS
+/* The CPU each flow was last read on, NULL if not configured */
+struct rps_sock_flow_table *rps_sock_flow_table __read_mostly;
+EXPORT_SYMBOL(rps_sock_flow_table);
+
+/*
+ * get_rps_cpu - CPU to process a received packet on
  *
- *	return values:
- *	NET_RX_SUCCESS	(no congestion)
- *	NET_RX_DROP     (packet was dropped)
+ * With receive flow steering, a flow goes to the CPU its application
+ * last read it on.  It moves there from the CPU it was steered to before
+ * only once the backlog of that has been processed past the last packet
+ * of the flow, so that the flow stays in order; until then *@rflowp is
+ * set so the caller can record the backlog tail after queueing.
  *
+ * Otherwise returns the CPU the rps_map of the device selects by the
+ * flow hash of @skb, or -1 if the device has no map or the packet no hash.
  */
+static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
+		       struct rps_dev_flow **rflowp)
+{
+	struct rps_sock_flow_table *sock_flow_table;
+	struct rps_dev_flow_table *flow_table;
+	struct rps_map *map;
+	int cpu = -1;
+	u16 tcpu;
 
-int netif_rx(struct sk_buff *skb)
+	rcu_read_lock();
+	map = rcu_dereference(dev->rps_map);
+	flow_table = rcu_dereference(dev->rps_flow_table);
+	if (!map && !flow_table)
+		goto done;
+
+	if (map && map->len == 1 && !flow_table) {
+		tcpu = map->cpus[0];
+		if (cpu_online(tcpu))
+			cpu = tcpu;
+		goto done;
+	}
+
+	if (!skb_get_rxhash(skb))
+		goto done;
+
+	sock_flow_table = rcu_dereference(rps_sock_flow_table);
+	if (flow_table && sock_flow_table) {
+		struct rps_dev_flow *rflow;
+		u16 next_cpu;
+
+		rflow = &flow_table->flows[skb->rxhash & flow_table->mask];
+		tcpu = rflow->cpu;
+		next_cpu = sock_flow_table->ents[skb->rxhash &
+						 sock_flow_table->mask];
+
+		/*
+		 * Move the flow to the CPU of the application if it is not
+		 * steered anywhere yet, its CPU went offline, or that CPU
+		 * has processed all packets of the flow queued to it.
+		 */
+		if (unlikely(tcpu != next_cpu) &&
+		    (tcpu == RPS_NO_CPU || !cpu_online(tcpu) ||
+		     ((int)(per_cpu(softnet_data, tcpu).input_queue_head -
+			    rflow->last_qtail)) >= 0)) {
+			tcpu = rflow->cpu = next_cpu;
+			if (tcpu != RPS_NO_CPU)
+				rflow->last_qtail = per_cpu(softnet_data,
+							    tcpu).input_queue_head;
+		}
+		if (tcpu != RPS_NO_CPU && cpu_online(tcpu)) {
+			*rflowp = rflow;
+			cpu = tcpu;
+			goto done;
+		}
+	}
+
+	if (map) {
+		tcpu = map->cpus[((u64)skb->rxhash * map->len) >> 32];
+		if (cpu_online(tcpu))
+			cpu = tcpu;
+	}
+done:
+	rcu_read_unlock();
+	return cpu;
+}
+
+/* Called from the IPI of a CPU that queued packets to us */
+static void rps_trigger_softirq(void *data)
 {
-	struct softnet_data *queue;
-	unsigned long flags;
+	struct softnet_data *sd = data;
 
-	/* if netpoll wants it, pretend we never saw it */
-	if (netpoll_rx(skb))
-		return NET_RX_DROP;
+	____napi_schedule(sd, &sd->backlog);
+	__get_cpu_var(netdev_rx_stat).received_rps++;
+}
+#endif /* CONFIG_RPS */
 
-	if (!skb->tstamp.tv64)
-		net_timestamp(skb);
+/*
+ * Have the backlog of another CPU kicked, by an IPI sent at the end of
+ * our net_rx_action(), so that one IPI covers all packets of a poll.
+ * Returns 0 if @sd is our own.  Called with interrupts disabled.
+ */
+static int rps_ipi_queued(struct softnet_data *sd)
+{
+#ifdef CONFIG_RPS
+	struct softnet_data *mysd = &__get_cpu_var(softnet_data);
+
+	if (sd != mysd) {
+		sd->rps_ipi_next = mysd->rps_ipi_list;
+		mysd->rps_ipi_list = sd;
+
+		__raise_softirq_irqoff(NET_RX_SOFTIRQ);
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+/*
+ * Queue a packet to the backlog of @cpu, or of the current CPU if it is
+ * negative, and have the backlog scheduled if it was idle.  The tail of
+ * the backlog after the packet is stored in *@qtail.
+ */
+static int enqueue_to_backlog(struct sk_buff *skb, int cpu,
+			      unsigned int *qtail)
+{
+	struct softnet_data *queue;
+	unsigned long flags;
 
 	/*
 	 * The code is rearranged so that the path is the most
 	 * short when CPU is congested, but is still operating.
 	 */
 	local_irq_save(flags);
-	queue = &__get_cpu_var(softnet_data);
+	if (cpu < 0)
+		queue = &__get_cpu_var(softnet_data);
+	else
+		queue = &per_cpu(softnet_data, cpu);
 
 	__get_cpu_var(netdev_rx_stat).total++;
+
+	rps_lock(queue);
 	if (queue->input_pkt_queue.qlen <= netdev_max_backlog) {
 		if (queue->input_pkt_queue.qlen) {
 enqueue:
 			__skb_queue_tail(&queue->input_pkt_queue, skb);
+#ifdef CONFIG_RPS
+			*qtail = ++queue->input_queue_tail;
+#endif
+			rps_unlock(queue);
 			local_irq_restore(flags);
 			return NET_RX_SUCCESS;
 		}
 
-		napi_schedule(&queue->backlog);
+		if (napi_schedule_prep(&queue->backlog)) {
+			if (!rps_ipi_queued(queue))
+				____napi_schedule(queue, &queue->backlog);
+		}
 		goto enqueue;
 	}
+	rps_unlock(queue);
 
 	__get_cpu_var(netdev_rx_stat).dropped++;
 	local_irq_restore(flags);
@@ -1965,6 +2330,39 @@ enqueue:
 	return NET_RX_DROP;
 }
 
+/**
+ *	netif_rx	-	post buffer to the network code
+ *	@skb: buffer to post
+ *
+ *	This function receives a packet from a device driver and queues it for
+ *	the upper (protocol) levels to process.  It always succeeds. The buffer
+ *	may be dropped during processing for congestion control or by the
+ *	protocol layers.
+ *
+ *	return values:
+ *	NET_RX_SUCCESS	(no congestion)
+ *	NET_RX_DROP     (packet was dropped)
+ *
+ */
+
+int netif_rx(struct sk_buff *skb)
+{
+	struct rps_dev_flow voidflow, *rflow = &voidflow;
+	int cpu = -1;
+
+	/* if netpoll wants it, pretend we never saw it */
+	if (netpoll_rx(skb))
+		return NET_RX_DROP;
+
+	if (!skb->tstamp.tv64)
+		net_timestamp(skb);
+
+#ifdef CONFIG_RPS
+	cpu = get_rps_cpu(skb->dev, skb, &rflow);
+#endif
+	return enqueue_to_backlog(skb, cpu, &rflow->last_qtail);
+}
+
 int netif_rx_ni(struct sk_buff *skb)
 {
 	int err;
@@ -2195,22 +2593,7 @@ void netif_nit_deliver(struct sk_buff *skb)
 	rcu_read_unlock();
 }
 
-/**
- *	netif_receive_skb - process receive buffer from network
- *	@skb: buffer to process
- *
- *	netif_receive_skb() is the main receive data processing function.
- *	It always succeeds. The buffer may be dropped during processing
- *	for congestion control or by the protocol layers.
- *
- *	This function may only be called from softirq context and interrupts
- *	should be enabled.
- *
- *	Return values (usually ignored):
- *	NET_RX_SUCCESS: no congestion
- *	NET_RX_DROP: packet was dropped
- */
-int netif_receive_skb(struct sk_buff *skb)
+static int __netif_receive_skb(struct sk_buff *skb)
 {
 	struct packet_type *ptype, *pt_prev;
 	struct net_device *orig_dev;
@@ -2311,6 +2694,215 @@ out:
 	return ret;
 }
 
+/**
+ *	netif_receive_skb - process receive buffer from network
+ *	@skb: buffer to process
+ *
+ *	netif_receive_skb() is the main receive data processing function.
+ *	It always succeeds. The buffer may be dropped during processing
+ *	for congestion control or by the protocol layers.  If the device
+ *	steers its packets to other CPUs, the packet is queued to the
+ *	backlog of the CPU its flow maps to.
+ *
+ *	This function may only be called from softirq context and interrupts
+ *	should be enabled.
+ *
+ *	Return values (usually ignored):
+ *	NET_RX_SUCCESS: no congestion
+ *	NET_RX_DROP: packet was dropped
+ */
+int netif_receive_skb(struct sk_buff *skb)
+{
+#ifdef CONFIG_RPS
+	struct rps_dev_flow voidflow, *rflow = &voidflow;
+	int cpu = get_rps_cpu(skb->dev, skb, &rflow);
+
+	if (cpu >= 0 && cpu != smp_processor_id()) {
+		if (!skb->tstamp.tv64)
+			net_timestamp(skb);
+		return enqueue_to_backlog(skb, cpu, &rflow->last_qtail);
+	}
+#endif
+	return __netif_receive_skb(skb);
+}
+
+/*
+ * Hand a held GRO packet, with the segments merged into it, to the
+ * stack.  The protocols fix up their headers to cover the whole of it
+ * and mark it as GSO, so that it is segmented again if it is forwarded.
+ */
+static int napi_gro_complete(struct sk_buff *skb)
+{
+	struct packet_type *ptype;
+	__be16 type = skb->protocol;
+	struct list_head *head = &ptype_base[ntohs(type) & PTYPE_HASH_MASK];
+	int err = -ENOENT;
+
+	if (NAPI_GRO_CB(skb)->count == 1) {
+		skb_shinfo(skb)->gso_size = 0;
+		goto out;
+	}
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(ptype, head, list) {
+		if (ptype->type != type || ptype->dev || !ptype->gro_complete)
+			continue;
+
+		err = ptype->gro_complete(skb);
+		break;
+	}
+	rcu_read_unlock();
+
+	if (err) {
+		WARN_ON(&ptype->list == head);
+		kfree_skb(skb);
+		return NET_RX_SUCCESS;
+	}
+
+out:
+	__skb_push(skb, -skb_network_offset(skb));
+	return netif_receive_skb(skb);
+}
+
+/**
+ *	napi_gro_flush - pass all held packets up the stack
+ *	@napi: napi context
+ *
+ *	Called when the poll routine completes, and by drivers that must
+ *	not hold packets past some point of their own.
+ */
+void napi_gro_flush(struct napi_struct *napi)
+{
+	struct sk_buff *skb, *next;
+
+	for (skb = napi->gro_list; skb; skb = next) {
+		next = skb->next;
+		skb->next = NULL;
+		napi_gro_complete(skb);
+	}
+
+	napi->gro_list = NULL;
+}
+EXPORT_SYMBOL(napi_gro_flush);
+
+/**
+ *	dev_gro_receive - try to merge a packet with those held
+ *	@napi: napi context the packet was received on
+ *	@skb: the packet, with skb->protocol set
+ *
+ *	The gro_receive handler of the packet's protocol compares it to
+ *	the packets held on @napi, and if it continues one of their flows,
+ *	appends its payload to that one.  A packet that starts a flow is
+ *	held in turn, for up to MAX_GRO_SKBS flows.
+ *
+ *	Returns -1 if the packet is to be passed up the stack as usual,
+ *	1 if it was merged and is to be freed, and 0 if it was consumed.
+ */
+int dev_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
+{
+	struct sk_buff **pp = NULL;
+	struct packet_type *ptype;
+	__be16 type = skb->protocol;
+	struct list_head *head = &ptype_base[ntohs(type) & PTYPE_HASH_MASK];
+	int count = 0;
+	int same_flow;
+	int mac_len;
+	int free;
+
+	if (!(skb->dev->features & NETIF_F_GRO))
+		goto normal;
+
+	if (skb_is_gso(skb) || skb_shinfo(skb)->frag_list)
+		goto normal;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(ptype, head, list) {
+		struct sk_buff *p;
+
+		if (ptype->type != type || ptype->dev || !ptype->gro_receive)
+			continue;
+
+		skb_reset_network_header(skb);
+		mac_len = skb->network_header - skb->mac_header;
+		skb->mac_len = mac_len;
+		NAPI_GRO_CB(skb)->same_flow = 0;
+		NAPI_GRO_CB(skb)->flush = 0;
+		NAPI_GRO_CB(skb)->free = 0;
+
+		for (p = napi->gro_list; p; p = p->next) {
+			count++;
+			NAPI_GRO_CB(p)->same_flow =
+				p->mac_len == mac_len &&
+				!memcmp(skb_mac_header(p), skb_mac_header(skb),
+					mac_len);
+			NAPI_GRO_CB(p)->flush = 0;
+		}
+
+		pp = ptype->gro_receive(&napi->gro_list, skb);
+		break;
+	}
+	rcu_read_unlock();
+
+	if (&ptype->list == head)
+		goto normal;
+
+	same_flow = NAPI_GRO_CB(skb)->same_flow;
+	free = NAPI_GRO_CB(skb)->free;
+
+	if (pp) {
+		struct sk_buff *nskb = *pp;
+
+		*pp = nskb->next;
+		nskb->next = NULL;
+		napi_gro_complete(nskb);
+		count--;
+	}
+
+	if (same_flow)
+		goto ok;
+
+	if (NAPI_GRO_CB(skb)->flush || count >= MAX_GRO_SKBS) {
+		__skb_push(skb, -skb_network_offset(skb));
+		goto normal;
+	}
+
+	NAPI_GRO_CB(skb)->count = 1;
+	skb_shinfo(skb)->gso_size = skb->len;
+	skb->next = napi->gro_list;
+	napi->gro_list = skb;
+
+ok:
+	return free;
+
+normal:
+	return -1;
+}
+EXPORT_SYMBOL(dev_gro_receive);
+
+/**
+ *	napi_gro_receive - receive a packet from a NAPI poll routine
+ *	@napi: napi context being polled
+ *	@skb: the packet, with skb->protocol set
+ *
+ *	Like netif_receive_skb(), but merges TCP segments of the same flow
+ *	into one packet when the device has NETIF_F_GRO set.  Held packets
+ *	are passed up by napi_complete() at the latest.
+ */
+int napi_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
+{
+	switch (dev_gro_receive(napi, skb)) {
+	case -1:
+		return netif_receive_skb(skb);
+
+	case 1:
+		kfree_skb(skb);
+		break;
+	}
+
+	return NET_RX_SUCCESS;
+}
+EXPORT_SYMBOL(napi_gro_receive);
+
 /* Network device is going away, flush any packets still pending  */
 static void flush_backlog(void *arg)
 {
@@ -2318,11 +2910,14 @@ static void flush_backlog(void *arg)
 	struct softnet_data *queue = &__get_cpu_var(softnet_data);
 	struct sk_buff *skb, *tmp;
 
+	rps_lock(queue);
 	skb_queue_walk_safe(&queue->input_pkt_queue, skb, tmp)
 		if (skb->dev == dev) {
 			__skb_unlink(skb, &queue->input_pkt_queue);
 			kfree_skb(skb);
+			input_queue_head_incr(queue);
 		}
+	rps_unlock(queue);
 }
 
 static int process_backlog(struct napi_struct *napi, int quota)
@@ -2336,15 +2931,19 @@ static int process_backlog(struct napi_struct *napi, int quota)
 		struct sk_buff *skb;
 
 		local_irq_disable();
+		rps_lock(queue);
 		skb = __skb_dequeue(&queue->input_pkt_queue);
 		if (!skb) {
 			__napi_complete(napi);
+			rps_unlock(queue);
 			local_irq_enable();
 			break;
 		}
+		input_queue_head_incr(queue);
+		rps_unlock(queue);
 		local_irq_enable();
 
-		netif_receive_skb(skb);
+		__netif_receive_skb(skb);
 	} while (++work < quota && jiffies == start_time);
 
 	return work;
@@ -2361,16 +2960,111 @@ void __napi_schedule(struct napi_struct *n)
 	unsigned long flags;
 
 	local_irq_save(flags);
-	list_add_tail(&n->poll_list, &__get_cpu_var(softnet_data).poll_list);
-	__raise_softirq_irqoff(NET_RX_SOFTIRQ);
+	____napi_schedule(&__get_cpu_var(softnet_data), n);
 	local_irq_restore(flags);
 }
 EXPORT_SYMBOL(__napi_schedule);
 
+/**
+ *	__napi_complete - NAPI processing complete
+ *	@n: napi context
+ *
+ *	As napi_complete(), for callers that have interrupts disabled and
+ *	do not use GRO.
+ */
+void __napi_complete(struct napi_struct *n)
+{
+	BUG_ON(!test_bit(NAPI_STATE_SCHED, &n->state));
+	BUG_ON(n->gro_list);
+
+	list_del(&n->poll_list);
+	smp_mb__before_clear_bit();
+	clear_bit(NAPI_STATE_SCHED, &n->state);
+}
+EXPORT_SYMBOL(__napi_complete);
+
+/**
+ *	napi_complete - NAPI processing complete
+ *	@n: napi context
+ *
+ *	Mark NAPI processing as complete, after passing the packets GRO
+ *	holds up the stack.
+ */
+void napi_complete(struct napi_struct *n)
+{
+	unsigned long flags;
+
+	napi_gro_flush(n);
+	local_irq_save(flags);
+	__napi_complete(n);
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(napi_complete);
+
+void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
+		    int (*poll)(struct napi_struct *, int), int weight)
+{
+	INIT_LIST_HEAD(&napi->poll_list);
+	napi->gro_list = NULL;
+	napi->poll = poll;
+	napi->weight = weight;
+	list_add(&napi->dev_list, &dev->napi_list);
+	napi->dev = dev;
+#ifdef CONFIG_NETPOLL
+	spin_lock_init(&napi->poll_lock);
+	napi->poll_owner = -1;
+#endif
+	set_bit(NAPI_STATE_SCHED, &napi->state);
+}
+EXPORT_SYMBOL(netif_napi_add);
+
+void netif_napi_del(struct napi_struct *napi)
+{
+	struct sk_buff *skb, *next;
+
+	list_del_init(&napi->dev_list);
+
+	for (skb = napi->gro_list; skb; skb = next) {
+		next = skb->next;
+		skb->next = NULL;
+		kfree_skb(skb);
+	}
+
+	napi->gro_list = NULL;
+}
+EXPORT_SYMBOL(netif_napi_del);
+
+/*
+ * Send the IPIs that kick the backlogs of the CPUs we queued packets to,
+ * and enable interrupts.
+ */
+static void net_rps_action_and_irq_enable(struct softnet_data *sd)
+{
+#ifdef CONFIG_RPS
+	struct softnet_data *remsd = sd->rps_ipi_list;
+
+	if (remsd) {
+		sd->rps_ipi_list = NULL;
+		local_irq_enable();
+
+		while (remsd) {
+			struct softnet_data *next = remsd->rps_ipi_next;
+
+			if (cpu_online(remsd->cpu))
+				__smp_call_function_single(remsd->cpu,
+							   &remsd->csd);
+			remsd = next;
+		}
+		return;
+	}
+#endif
+	local_irq_enable();
+}
 
 static void net_rx_action(struct softirq_action *h)
 {
-	struct list_head *list = &__get_cpu_var(softnet_data).poll_list;
+	struct softnet_data *sd = &__get_cpu_var(softnet_data);
+	struct list_head *list = &sd->poll_list;
 	unsigned long start_time = jiffies;
 	int budget = netdev_budget;
 	void *have;
@@ -2426,16 +3120,18 @@ static void net_rx_action(struct softirq_action *h)
 		 * move the instance around on the list at-will.
 		 */
 		if (unlikely(work == weight)) {
-			if (unlikely(napi_disable_pending(n)))
-				__napi_complete(n);
-			else
+			if (unlikely(napi_disable_pending(n))) {
+				local_irq_enable();
+				napi_complete(n);
+				local_irq_disable();
+			} else
 				list_move_tail(&n->poll_list, list);
 		}
 
 		netpoll_poll_unlock(have);
 	}
 out:
-	local_irq_enable();
+	net_rps_action_and_irq_enable(sd);
 
 #ifdef CONFIG_NET_DMA
 	/*
@@ -2685,10 +3381,12 @@ static int softnet_seq_show(struct seq_file *seq, void *v)
 {
 	struct netif_rx_stats *s = v;
 
-	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
+	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x "
+		   "%08x %08x\n",
 		   s->total, s->dropped, s->time_squeeze, 0,
 		   0, 0, 0, 0, /* was fastroute */
-		   s->cpu_collision );
+		   s->cpu_collision, s->received_rps,
+		   s->recycle_hits, s->recycle_misses);
 	return 0;
 }
 
@@ -4350,7 +5048,7 @@ struct net_device *alloc_netdev_mq(int sizeof_priv, const char *name,
 	netdev_init_queues(dev);
 
 	dev->get_stats = internal_stats;
-	netpoll_netdev_init(dev);
+	INIT_LIST_HEAD(&dev->napi_list);
 	setup(dev);
 	strcpy(dev->name, name);
 	return dev;
@@ -4367,9 +5065,18 @@ EXPORT_SYMBOL(alloc_netdev_mq);
  */
 void free_netdev(struct net_device *dev)
 {
+	struct napi_struct *p, *n;
+
 	release_net(dev_net(dev));
 
 	kfree(dev->_tx);
+#ifdef CONFIG_XPS
+	if (dev->xps_maps)
+		xps_dev_maps_free(dev->xps_maps);
+#endif
+
+	list_for_each_entry_safe(p, n, &dev->napi_list, dev_list)
+		netif_napi_del(p);
 
 	/*  Compatibility with error handling in drivers */
 	if (dev->reg_state == NETREG_UNINITIALIZED) {
@@ -4558,6 +5265,10 @@ static int dev_cpu_callback(struct notifier_block *nfb,
 {
 	struct sk_buff **list_skb;
 	struct Qdisc **list_net;
+	struct napi_struct *napi, *next;
+#ifdef CONFIG_RPS
+	struct softnet_data **list_sd;
+#endif
 	struct sk_buff *skb;
 	unsigned int cpu, oldcpu = (unsigned long)ocpu;
 	struct softnet_data *sd, *oldsd;
@@ -4586,12 +5297,47 @@ static int dev_cpu_callback(struct notifier_block *nfb,
 	*list_net = oldsd->output_queue;
 	oldsd->output_queue = NULL;
 
+	/*
+	 * Append NAPI poll list from offline CPU, less its backlog, which
+	 * is drained below.  Packet steering may have scheduled that for
+	 * an IPI that never came.
+	 */
+	list_for_each_entry_safe(napi, next, &oldsd->poll_list, poll_list) {
+		if (napi != &oldsd->backlog)
+			list_move_tail(&napi->poll_list, &sd->poll_list);
+	}
+	INIT_LIST_HEAD(&oldsd->poll_list);
+
+#ifdef CONFIG_RPS
+	/* Take over the remote backlogs it had still to kick. */
+	list_sd = &sd->rps_ipi_list;
+	while (*list_sd)
+		list_sd = &(*list_sd)->rps_ipi_next;
+	*list_sd = oldsd->rps_ipi_list;
+	oldsd->rps_ipi_list = NULL;
+#endif
+
 	raise_softirq_irqoff(NET_TX_SOFTIRQ);
+	raise_softirq_irqoff(NET_RX_SOFTIRQ);
 	local_irq_enable();
 
 	/* Process offline CPU's input_pkt_queue */
-	while ((skb = __skb_dequeue(&oldsd->input_pkt_queue)))
+	for (;;) {
+		local_irq_disable();
+		rps_lock(oldsd);
+		skb = __skb_dequeue(&oldsd->input_pkt_queue);
+		if (skb)
+			input_queue_head_incr(oldsd);
+		else
+			clear_bit(NAPI_STATE_SCHED, &oldsd->backlog.state);
+		rps_unlock(oldsd);
+		local_irq_enable();
+		if (!skb)
+			break;
 		netif_rx(skb);
+	}
+
+	skb_recycle_purge(oldcpu);
 
 	return NOTIFY_OK;
 }
@@ -4906,8 +5652,16 @@ static int __init net_dev_init(void)
 
 		queue->backlog.poll = process_backlog;
 		queue->backlog.weight = weight_p;
+#ifdef CONFIG_RPS
+		queue->csd.func = rps_trigger_softirq;
+		queue->csd.info = queue;
+		queue->csd.flags = 0;
+		queue->cpu = i;
+#endif
 	}
 
+	get_random_bytes(&rxhash_rnd, sizeof(rxhash_rnd));
+
 	netdev_dma_register();
 
 	dev_boot_phase = 0;
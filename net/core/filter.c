@@ -64,6 +64,47 @@ static inline void *load_pointer(struct sk_buff *skb, int k,
 	}
 }
 
+/*
+ * Ancillary data, which are impossible (or very difficult) to get
+ * parsing packet contents.  Returns -1 if the filter is to return 0.
+ */
+static inline int load_ancillary(struct sk_buff *skb, int k, u32 *A, u32 X)
+{
+	switch (k-SKF_AD_OFF) {
+	case SKF_AD_PROTOCOL:
+		*A = ntohs(skb->protocol);
+		return 0;
+	case SKF_AD_PKTTYPE:
+		*A = skb->pkt_type;
+		return 0;
+	case SKF_AD_IFINDEX:
+		if (!skb->dev)
+			return -1;
+		*A = skb->dev->ifindex;
+		return 0;
+	case SKF_AD_NLATTR: {
+		struct nlattr *nla;
+
+		if (skb_is_nonlinear(skb))
+			return -1;
+		if (skb->len < sizeof(struct nlattr))
+			return -1;
+		if (*A > skb->len - sizeof(struct nlattr))
+			return -1;
+
+		nla = nla_find((struct nlattr *)&skb->data[*A],
+			       skb->len - *A, X);
+		if (nla)
+			*A = (void *)nla - (void *)skb->data;
+		else
+			*A = 0;
+		return 0;
+	}
+	default:
+		return -1;
+	}
+}
+
 /**
  *	sk_filter - run a packet through a socket filter
  *	@sk: sock associated with &sk_buff
@@ -88,8 +129,8 @@ int sk_filter(struct sock *sk, struct sk_buff *skb)
 	rcu_read_lock_bh();
 	filter = rcu_dereference(sk->sk_filter);
 	if (filter) {
-		unsigned int pkt_len = sk_run_filter(skb, filter->insns,
-				filter->len);
+		unsigned int pkt_len = SK_RUN_FILTER(filter, skb);
+
 		err = pkt_len ? pskb_trim(skb, pkt_len) : -EPERM;
 	}
 	rcu_read_unlock_bh();
@@ -289,45 +330,50 @@ load_b:
 			return 0;
 		}
 
-		/*
-		 * Handle ancillary data, which are impossible
-		 * (or very difficult) to get parsing packet contents.
-		 */
-		switch (k-SKF_AD_OFF) {
-		case SKF_AD_PROTOCOL:
-			A = ntohs(skb->protocol);
-			continue;
-		case SKF_AD_PKTTYPE:
-			A = skb->pkt_type;
-			continue;
-		case SKF_AD_IFINDEX:
-			A = skb->dev->ifindex;
-			continue;
-		case SKF_AD_NLATTR: {
-			struct nlattr *nla;
-
-			if (skb_is_nonlinear(skb))
-				return 0;
-			if (A > skb->len - sizeof(struct nlattr))
-				return 0;
-
-			nla = nla_find((struct nlattr *)&skb->data[A],
-				       skb->len - A, X);
-			if (nla)
-				A = (void *)nla - (void *)skb->data;
-			else
-				A = 0;
-			continue;
-		}
-		default:
+		/* Not in the packet: ancillary data */
+		if (load_ancillary(skb, k, &A, X))
 			return 0;
-		}
 	}
 
 	return 0;
 }
 EXPORT_SYMBOL(sk_run_filter);
 
+#ifdef CONFIG_BPF_JIT
+/**
+ *	bpf_jit_load_slow - packet load of a JIT compiled filter
+ *	@skb: buffer the filter runs on
+ *	@k: offset to load from
+ *	@size: bytes to load, 1, 2 or 4
+ *	@A: accumulator of the filter
+ *	@X: index register of the filter
+ *
+ * Compiled filters load the linear data of @skb themselves and call this
+ * for other offsets, beyond it, relative to a header or ancillary.  It
+ * loads as sk_run_filter() does, and returns the new accumulator, or a
+ * value with bit 63 set if the filter is to return 0.
+ */
+u64 bpf_jit_load_slow(struct sk_buff *skb, int k, unsigned int size,
+		      u32 A, u32 X)
+{
+	void *ptr;
+	u32 tmp;
+
+	ptr = load_pointer(skb, k, size, &tmp);
+	if (ptr != NULL) {
+		if (size == 4)
+			return get_unaligned_be32(ptr);
+		if (size == 2)
+			return get_unaligned_be16(ptr);
+		return *(u8 *)ptr;
+	}
+
+	if (load_ancillary(skb, k, &A, X))
+		return ~0ULL;
+	return A;
+}
+#endif /* CONFIG_BPF_JIT */
+
 /**
  *	sk_chk_filter - verify socket filter code
  *	@filter: filter to verify
@@ -488,6 +534,9 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 
 	atomic_set(&fp->refcnt, 1);
 	fp->len = fprog->len;
+#ifdef CONFIG_BPF_JIT
+	fp->bpf_func = NULL;
+#endif
 
 	err = sk_chk_filter(fp->insns, fp->len);
 	if (err) {
@@ -495,6 +544,8 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 		return err;
 	}
 
+	bpf_jit_compile(fp);
+
 	rcu_read_lock_bh();
 	old_fp = rcu_dereference(sk->sk_filter);
 	rcu_assign_pointer(sk->sk_filter, fp);
@@ -68,7 +68,12 @@ static const struct file_operations neigh_stat_seq_fops;
 /*
    Neighbour hash table buckets are protected with rwlock tbl->lock.
 
-   - All the scans/updates to hash buckets MUST be made under this lock.
+   - All the scans/updates to hash buckets MUST be made under this lock,
+     except for neigh_lookup() and neigh_lookup_nodev(), which walk them
+     under rcu_read_lock_bh() only.  Entries are therefore linked in
+     with rcu_assign_pointer() and freed an RCU-bh grace period after
+     their last reference is dropped, and the hash table, when it grows,
+     is replaced as a whole and the old one freed likewise.
    - NOTHING clever should be made under this lock: no callbacks
      to protocol backends, no attempts to send something to network.
      It will result in deadlocks, if backend/driver wants to use neighbour
@@ -134,10 +139,10 @@ static int neigh_forced_gc(struct neigh_table *tbl)
 	NEIGH_CACHE_STAT_INC(tbl, forced_gc_runs);
 
 	write_lock_bh(&tbl->lock);
-	for (i = 0; i <= tbl->hash_mask; i++) {
+	for (i = 0; i <= tbl->nht->hash_mask; i++) {
 		struct neighbour *n, **np;
 
-		np = &tbl->hash_buckets[i];
+		np = &tbl->nht->hash_buckets[i];
 		while ((n = *np) != NULL) {
 			/* Neighbour record may be discarded if:
 			 * - nobody refers to it.
@@ -199,8 +204,8 @@ static void neigh_flush_dev(struct neigh_table *tbl, struct net_device *dev)
 {
 	int i;
 
-	for (i = 0; i <= tbl->hash_mask; i++) {
-		struct neighbour *n, **np = &tbl->hash_buckets[i];
+	for (i = 0; i <= tbl->nht->hash_mask; i++) {
+		struct neighbour *n, **np = &tbl->nht->hash_buckets[i];
 
 		while ((n = *np) != NULL) {
 			if (dev && n->dev != dev) {
@@ -296,85 +301,120 @@ out_entries:
 	goto out;
 }
 
-static struct neighbour **neigh_hash_alloc(unsigned int entries)
+static struct neigh_hash_table *neigh_hash_alloc(unsigned int entries)
 {
 	unsigned long size = entries * sizeof(struct neighbour *);
-	struct neighbour **ret;
+	struct neigh_hash_table *nht;
+	struct neighbour **buckets;
+
+	nht = kmalloc(sizeof(*nht), GFP_ATOMIC);
+	if (!nht)
+		return NULL;
 
 	if (size <= PAGE_SIZE) {
-		ret = kzalloc(size, GFP_ATOMIC);
+		buckets = kzalloc(size, GFP_ATOMIC);
 	} else {
-		ret = (struct neighbour **)
+		buckets = (struct neighbour **)
 		      __get_free_pages(GFP_ATOMIC|__GFP_ZERO, get_order(size));
 	}
-	return ret;
+	if (!buckets) {
+		kfree(nht);
+		return NULL;
+	}
+
+	nht->hash_buckets = buckets;
+	nht->hash_mask = entries - 1;
+	get_random_bytes(&nht->hash_rnd, sizeof(nht->hash_rnd));
+	return nht;
 }
 
-static void neigh_hash_free(struct neighbour **hash, unsigned int entries)
+static void neigh_hash_free(struct neigh_hash_table *nht)
 {
-	unsigned long size = entries * sizeof(struct neighbour *);
+	unsigned long size = (nht->hash_mask + 1) * sizeof(struct neighbour *);
 
 	if (size <= PAGE_SIZE)
-		kfree(hash);
+		kfree(nht->hash_buckets);
 	else
-		free_pages((unsigned long)hash, get_order(size));
+		free_pages((unsigned long)nht->hash_buckets, get_order(size));
+	kfree(nht);
+}
+
+static void neigh_hash_free_rcu(struct rcu_head *head)
+{
+	neigh_hash_free(container_of(head, struct neigh_hash_table, rcu));
 }
 
+/*
+ * Entries are moved to the new table in place, so a lookup still walking
+ * the old one may miss an entry while this runs; it never sees a loop.
+ * neigh_create() looks again under the table lock before adding one.
+ */
 static void neigh_hash_grow(struct neigh_table *tbl, unsigned long new_entries)
 {
-	struct neighbour **new_hash, **old_hash;
-	unsigned int i, new_hash_mask, old_entries;
+	struct neigh_hash_table *new_nht, *old_nht = tbl->nht;
+	unsigned int i;
 
 	NEIGH_CACHE_STAT_INC(tbl, hash_grows);
 
 	BUG_ON(!is_power_of_2(new_entries));
-	new_hash = neigh_hash_alloc(new_entries);
-	if (!new_hash)
+	new_nht = neigh_hash_alloc(new_entries);
+	if (!new_nht)
 		return;
 
-	old_entries = tbl->hash_mask + 1;
-	new_hash_mask = new_entries - 1;
-	old_hash = tbl->hash_buckets;
-
-	get_random_bytes(&tbl->hash_rnd, sizeof(tbl->hash_rnd));
-	for (i = 0; i < old_entries; i++) {
+	for (i = 0; i <= old_nht->hash_mask; i++) {
 		struct neighbour *n, *next;
 
-		for (n = old_hash[i]; n; n = next) {
-			unsigned int hash_val = tbl->hash(n->primary_key, n->dev);
+		for (n = old_nht->hash_buckets[i]; n; n = next) {
+			unsigned int hash_val = tbl->hash(n->primary_key, n->dev,
+							  new_nht->hash_rnd);
 
-			hash_val &= new_hash_mask;
+			hash_val &= new_nht->hash_mask;
 			next = n->next;
 
-			n->next = new_hash[hash_val];
-			new_hash[hash_val] = n;
+			rcu_assign_pointer(n->next,
+					   new_nht->hash_buckets[hash_val]);
+			rcu_assign_pointer(new_nht->hash_buckets[hash_val], n);
 		}
 	}
-	tbl->hash_buckets = new_hash;
-	tbl->hash_mask = new_hash_mask;
+	rcu_assign_pointer(tbl->nht, new_nht);
 
-	neigh_hash_free(old_hash, old_entries);
+	call_rcu_bh(&old_nht->rcu, neigh_hash_free_rcu);
+}
+
+/*
+ * The table only holds entries whose reference count is not zero, but a
+ * lookup may find one that was just unlinked and released; it must not
+ * resurrect it.
+ */
+static inline int neigh_hold_unless_zero(struct neighbour *n)
+{
+	return atomic_inc_not_zero(&n->refcnt);
 }
 
 struct neighbour *neigh_lookup(struct neigh_table *tbl, const void *pkey,
 			       struct net_device *dev)
 {
+	struct neigh_hash_table *nht;
 	struct neighbour *n;
 	int key_len = tbl->key_len;
 	u32 hash_val;
 
 	NEIGH_CACHE_STAT_INC(tbl, lookups);
 
-	read_lock_bh(&tbl->lock);
-	hash_val = tbl->hash(pkey, dev);
-	for (n = tbl->hash_buckets[hash_val & tbl->hash_mask]; n; n = n->next) {
+	rcu_read_lock_bh();
+	nht = rcu_dereference(tbl->nht);
+	hash_val = tbl->hash(pkey, dev, nht->hash_rnd) & nht->hash_mask;
+	for (n = rcu_dereference(nht->hash_buckets[hash_val]); n;
+	     n = rcu_dereference(n->next)) {
 		if (dev == n->dev && !memcmp(n->primary_key, pkey, key_len)) {
-			neigh_hold(n);
-			NEIGH_CACHE_STAT_INC(tbl, hits);
+			if (!neigh_hold_unless_zero(n))
+				n = NULL;
+			else
+				NEIGH_CACHE_STAT_INC(tbl, hits);
 			break;
 		}
 	}
-	read_unlock_bh(&tbl->lock);
+	rcu_read_unlock_bh();
 	return n;
 }
 EXPORT_SYMBOL(neigh_lookup);
@@ -382,23 +422,28 @@ EXPORT_SYMBOL(neigh_lookup);
 struct neighbour *neigh_lookup_nodev(struct neigh_table *tbl, struct net *net,
 				     const void *pkey)
 {
+	struct neigh_hash_table *nht;
 	struct neighbour *n;
 	int key_len = tbl->key_len;
 	u32 hash_val;
 
 	NEIGH_CACHE_STAT_INC(tbl, lookups);
 
-	read_lock_bh(&tbl->lock);
-	hash_val = tbl->hash(pkey, NULL);
-	for (n = tbl->hash_buckets[hash_val & tbl->hash_mask]; n; n = n->next) {
+	rcu_read_lock_bh();
+	nht = rcu_dereference(tbl->nht);
+	hash_val = tbl->hash(pkey, NULL, nht->hash_rnd) & nht->hash_mask;
+	for (n = rcu_dereference(nht->hash_buckets[hash_val]); n;
+	     n = rcu_dereference(n->next)) {
 		if (!memcmp(n->primary_key, pkey, key_len) &&
 		    net_eq(dev_net(n->dev), net)) {
-			neigh_hold(n);
-			NEIGH_CACHE_STAT_INC(tbl, hits);
+			if (!neigh_hold_unless_zero(n))
+				n = NULL;
+			else
+				NEIGH_CACHE_STAT_INC(tbl, hits);
 			break;
 		}
 	}
-	read_unlock_bh(&tbl->lock);
+	rcu_read_unlock_bh();
 	return n;
 }
 EXPORT_SYMBOL(neigh_lookup_nodev);
@@ -410,6 +455,7 @@ struct neighbour *neigh_create(struct neigh_table *tbl, const void *pkey,
 	int key_len = tbl->key_len;
 	int error;
 	struct neighbour *n1, *rc, *n = neigh_alloc(tbl);
+	struct neigh_hash_table *nht;
 
 	if (!n) {
 		rc = ERR_PTR(-ENOBUFS);
@@ -437,17 +483,20 @@ struct neighbour *neigh_create(struct neigh_table *tbl, const void *pkey,
 
 	write_lock_bh(&tbl->lock);
 
-	if (atomic_read(&tbl->entries) > (tbl->hash_mask + 1))
-		neigh_hash_grow(tbl, (tbl->hash_mask + 1) << 1);
+	nht = tbl->nht;
+	if (atomic_read(&tbl->entries) > (nht->hash_mask + 1)) {
+		neigh_hash_grow(tbl, (nht->hash_mask + 1) << 1);
+		nht = tbl->nht;
+	}
 
-	hash_val = tbl->hash(pkey, dev) & tbl->hash_mask;
+	hash_val = tbl->hash(pkey, dev, nht->hash_rnd) & nht->hash_mask;
 
 	if (n->parms->dead) {
 		rc = ERR_PTR(-EINVAL);
 		goto out_tbl_unlock;
 	}
 
-	for (n1 = tbl->hash_buckets[hash_val]; n1; n1 = n1->next) {
+	for (n1 = nht->hash_buckets[hash_val]; n1; n1 = n1->next) {
 		if (dev == n1->dev && !memcmp(n1->primary_key, pkey, key_len)) {
 			neigh_hold(n1);
 			rc = n1;
@@ -455,10 +504,10 @@ struct neighbour *neigh_create(struct neigh_table *tbl, const void *pkey,
 		}
 	}
 
-	n->next = tbl->hash_buckets[hash_val];
-	tbl->hash_buckets[hash_val] = n;
 	n->dead = 0;
 	neigh_hold(n);
+	n->next = nht->hash_buckets[hash_val];
+	rcu_assign_pointer(nht->hash_buckets[hash_val], n);
 	write_unlock_bh(&tbl->lock);
 	NEIGH_PRINTK2("neigh %p is created.\n", n);
 	rc = n;
@@ -621,6 +670,18 @@ static inline void neigh_parms_put(struct neigh_parms *parms)
  *	neighbour must already be out of the table;
  *
  */
+/*
+ * Lookups compare against the device of an entry they may find after its
+ * last reference went away, so it is only released along with the entry.
+ */
+static void neigh_destroy_rcu(struct rcu_head *head)
+{
+	struct neighbour *neigh = container_of(head, struct neighbour, rcu);
+
+	dev_put(neigh->dev);
+	kmem_cache_free(neigh->tbl->kmem_cachep, neigh);
+}
+
 void neigh_destroy(struct neighbour *neigh)
 {
 	struct hh_cache *hh;
@@ -650,13 +711,12 @@ void neigh_destroy(struct neighbour *neigh)
 
 	skb_queue_purge(&neigh->arp_queue);
 
-	dev_put(neigh->dev);
 	neigh_parms_put(neigh->parms);
 
 	NEIGH_PRINTK2("neigh %p is destroyed.\n", neigh);
 
 	atomic_dec(&neigh->tbl->entries);
-	kmem_cache_free(neigh->tbl->kmem_cachep, neigh);
+	call_rcu_bh(&neigh->rcu, neigh_destroy_rcu);
 }
 EXPORT_SYMBOL(neigh_destroy);
 
@@ -716,8 +776,8 @@ static void neigh_periodic_timer(unsigned long arg)
 				neigh_rand_reach_time(p->base_reachable_time);
 	}
 
-	np = &tbl->hash_buckets[tbl->hash_chain_gc];
-	tbl->hash_chain_gc = ((tbl->hash_chain_gc + 1) & tbl->hash_mask);
+	np = &tbl->nht->hash_buckets[tbl->hash_chain_gc];
+	tbl->hash_chain_gc = ((tbl->hash_chain_gc + 1) & tbl->nht->hash_mask);
 
 	while ((n = *np) != NULL) {
 		unsigned int state;
@@ -753,7 +813,7 @@ next_elt:
 	 * base_reachable_time.
 	 */
 	expire = tbl->parms.base_reachable_time >> 1;
-	expire /= (tbl->hash_mask + 1);
+	expire /= (tbl->nht->hash_mask + 1);
 	if (!expire)
 		expire = 1;
 
@@ -1432,17 +1492,14 @@ void neigh_table_init_no_netlink(struct neigh_table *tbl)
 		panic("cannot create neighbour proc dir entry");
 #endif
 
-	tbl->hash_mask = 1;
-	tbl->hash_buckets = neigh_hash_alloc(tbl->hash_mask + 1);
+	tbl->nht = neigh_hash_alloc(2);
 
 	phsize = (PNEIGH_HASHMASK + 1) * sizeof(struct pneigh_entry *);
 	tbl->phash_buckets = kzalloc(phsize, GFP_KERNEL);
 
-	if (!tbl->hash_buckets || !tbl->phash_buckets)
+	if (!tbl->nht || !tbl->phash_buckets)
 		panic("cannot allocate neighbour cache hashes");
 
-	get_random_bytes(&tbl->hash_rnd, sizeof(tbl->hash_rnd));
-
 	rwlock_init(&tbl->lock);
 	setup_timer(&tbl->gc_timer, neigh_periodic_timer, (unsigned long)tbl);
 	tbl->gc_timer.expires  = now + 1;
@@ -1499,8 +1556,11 @@ int neigh_table_clear(struct neigh_table *tbl)
 	}
 	write_unlock(&neigh_tbl_lock);
 
-	neigh_hash_free(tbl->hash_buckets, tbl->hash_mask + 1);
-	tbl->hash_buckets = NULL;
+	/* Wait for the entries and hash tables still to be freed */
+	rcu_barrier_bh();
+
+	neigh_hash_free(tbl->nht);
+	tbl->nht = NULL;
 
 	kfree(tbl->phash_buckets);
 	tbl->phash_buckets = NULL;
@@ -1748,8 +1808,8 @@ static int neightbl_fill_info(struct sk_buff *skb, struct neigh_table *tbl,
 			.ndtc_entries		= atomic_read(&tbl->entries),
 			.ndtc_last_flush	= jiffies_to_msecs(flush_delta),
 			.ndtc_last_rand		= jiffies_to_msecs(rand_delta),
-			.ndtc_hash_rnd		= tbl->hash_rnd,
-			.ndtc_hash_mask		= tbl->hash_mask,
+			.ndtc_hash_rnd		= tbl->nht->hash_rnd,
+			.ndtc_hash_mask		= tbl->nht->hash_mask,
 			.ndtc_hash_chain_gc	= tbl->hash_chain_gc,
 			.ndtc_proxy_qlen	= tbl->proxy_queue.qlen,
 		};
@@ -2085,12 +2145,12 @@ static int neigh_dump_table(struct neigh_table *tbl, struct sk_buff *skb,
 	int idx, s_idx = idx = cb->args[2];
 
 	read_lock_bh(&tbl->lock);
-	for (h = 0; h <= tbl->hash_mask; h++) {
+	for (h = 0; h <= tbl->nht->hash_mask; h++) {
 		if (h < s_h)
 			continue;
 		if (h > s_h)
 			s_idx = 0;
-		for (n = tbl->hash_buckets[h], idx = 0; n; n = n->next) {
+		for (n = tbl->nht->hash_buckets[h], idx = 0; n; n = n->next) {
 			int lidx;
 			if (dev_net(n->dev) != net)
 				continue;
@@ -2144,10 +2204,10 @@ void neigh_for_each(struct neigh_table *tbl, void (*cb)(struct neighbour *, void
 	int chain;
 
 	read_lock_bh(&tbl->lock);
-	for (chain = 0; chain <= tbl->hash_mask; chain++) {
+	for (chain = 0; chain <= tbl->nht->hash_mask; chain++) {
 		struct neighbour *n;
 
-		for (n = tbl->hash_buckets[chain]; n; n = n->next)
+		for (n = tbl->nht->hash_buckets[chain]; n; n = n->next)
 			cb(n, cookie);
 	}
 	read_unlock_bh(&tbl->lock);
@@ -2160,10 +2220,10 @@ void __neigh_for_each_release(struct neigh_table *tbl,
 {
 	int chain;
 
-	for (chain = 0; chain <= tbl->hash_mask; chain++) {
+	for (chain = 0; chain <= tbl->nht->hash_mask; chain++) {
 		struct neighbour *n, **np;
 
-		np = &tbl->hash_buckets[chain];
+		np = &tbl->nht->hash_buckets[chain];
 		while ((n = *np) != NULL) {
 			int release;
 
@@ -2193,8 +2253,8 @@ static struct neighbour *neigh_get_first(struct seq_file *seq)
 	int bucket = state->bucket;
 
 	state->flags &= ~NEIGH_SEQ_IS_PNEIGH;
-	for (bucket = 0; bucket <= tbl->hash_mask; bucket++) {
-		n = tbl->hash_buckets[bucket];
+	for (bucket = 0; bucket <= tbl->nht->hash_mask; bucket++) {
+		n = tbl->nht->hash_buckets[bucket];
 
 		while (n) {
 			if (!net_eq(dev_net(n->dev), net))
@@ -2260,10 +2320,10 @@ static struct neighbour *neigh_get_next(struct seq_file *seq,
 		if (n)
 			break;
 
-		if (++state->bucket > tbl->hash_mask)
+		if (++state->bucket > tbl->nht->hash_mask)
 			break;
 
-		n = tbl->hash_buckets[state->bucket];
+		n = tbl->nht->hash_buckets[state->bucket];
 	}
 
 	if (n && pos)
@@ -12,6 +12,8 @@
 #include <linux/capability.h>
 #include <linux/kernel.h>
 #include <linux/netdevice.h>
+#include <linux/log2.h>
+#include <linux/vmalloc.h>
 #include <linux/if_arp.h>
 #include <net/sock.h>
 #include <linux/rtnetlink.h>
@@ -243,6 +245,171 @@ static ssize_t show_ifalias(struct device *dev,
 	return ret;
 }
 
+#ifdef CONFIG_RPS
+/*
+ * The CPUs received packets of the device are steered to, as a hex
+ * mask.  Packets of a flow all go to the same CPU of the mask; an empty
+ * mask has them processed where they are received.
+ */
+static ssize_t show_rps_cpus(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct net_device *net = to_net_dev(dev);
+	struct rps_map *map;
+	cpumask_t mask;
+	size_t len;
+	int i;
+
+	cpus_clear(mask);
+	rcu_read_lock();
+	map = rcu_dereference(net->rps_map);
+	if (map)
+		for (i = 0; i < map->len; i++)
+			cpu_set(map->cpus[i], mask);
+	rcu_read_unlock();
+
+	len = cpumask_scnprintf(buf, PAGE_SIZE - 1, mask);
+	buf[len++] = '\n';
+	return len;
+}
+
+static void rps_map_release(struct rcu_head *rcu)
+{
+	kfree(container_of(rcu, struct rps_map, rcu));
+}
+
+static ssize_t store_rps_cpus(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t len)
+{
+	struct net_device *net = to_net_dev(dev);
+	struct rps_map *old_map, *map;
+	cpumask_t mask;
+	int err, cpu, i;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	err = bitmap_parse(buf, len, cpus_addr(mask), NR_CPUS);
+	if (err)
+		return err;
+
+	cpus_and(mask, mask, cpu_online_map);
+	map = NULL;
+	if (!cpus_empty(mask)) {
+		map = kzalloc(max_t(unsigned int,
+				    RPS_MAP_SIZE(cpus_weight(mask)),
+				    L1_CACHE_BYTES), GFP_KERNEL);
+		if (!map)
+			return -ENOMEM;
+
+		i = 0;
+		for_each_cpu_mask_nr(cpu, mask)
+			map->cpus[i++] = cpu;
+		map->len = i;
+	}
+
+	rtnl_lock();
+	if (!dev_isalive(net)) {
+		rtnl_unlock();
+		kfree(map);
+		return -EINVAL;
+	}
+	old_map = net->rps_map;
+	rcu_assign_pointer(net->rps_map, map);
+	rtnl_unlock();
+
+	if (old_map)
+		call_rcu(&old_map->rcu, rps_map_release);
+	return len;
+}
+
+/*
+ * Number of flows of the device receive flow steering follows; they
+ * share entries beyond that.  0 leaves the device to its rps_cpus.
+ */
+static ssize_t show_rps_flow_cnt(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct net_device *net = to_net_dev(dev);
+	struct rps_dev_flow_table *flow_table;
+	unsigned int val = 0;
+
+	rcu_read_lock();
+	flow_table = rcu_dereference(net->rps_flow_table);
+	if (flow_table)
+		val = flow_table->mask + 1;
+	rcu_read_unlock();
+
+	return sprintf(buf, "%u\n", val);
+}
+
+static void rps_dev_flow_table_release_work(struct work_struct *work)
+{
+	vfree(container_of(work, struct rps_dev_flow_table, free_work));
+}
+
+static void rps_dev_flow_table_release(struct rcu_head *rcu)
+{
+	struct rps_dev_flow_table *table = container_of(rcu,
+					struct rps_dev_flow_table, rcu);
+
+	/* vfree() is not to be called from softirq context */
+	INIT_WORK(&table->free_work, rps_dev_flow_table_release_work);
+	schedule_work(&table->free_work);
+}
+
+static ssize_t store_rps_flow_cnt(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t len)
+{
+	struct net_device *net = to_net_dev(dev);
+	struct rps_dev_flow_table *table, *old_table;
+	unsigned long count;
+	char *endp;
+	int i;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	count = simple_strtoul(buf, &endp, 0);
+	if (endp == buf)
+		return -EINVAL;
+
+	table = NULL;
+	if (count) {
+		if (count > 1 << 30)
+			return -EINVAL;
+		count = roundup_pow_of_two(count);
+		/* The table size would overflow on 32-bit */
+		if (count > (ULONG_MAX - sizeof(struct rps_dev_flow_table)) /
+			    sizeof(struct rps_dev_flow))
+			return -EINVAL;
+		table = vmalloc(RPS_DEV_FLOW_TABLE_SIZE(count));
+		if (!table)
+			return -ENOMEM;
+
+		table->mask = count - 1;
+		for (i = 0; i < count; i++)
+			table->flows[i].cpu = RPS_NO_CPU;
+	}
+
+	rtnl_lock();
+	if (!dev_isalive(net)) {
+		rtnl_unlock();
+		vfree(table);
+		return -EINVAL;
+	}
+	old_table = net->rps_flow_table;
+	rcu_assign_pointer(net->rps_flow_table, table);
+	rtnl_unlock();
+
+	if (old_table)
+		call_rcu(&old_table->rcu, rps_dev_flow_table_release);
+	return len;
+}
+#endif /* CONFIG_RPS */
+
 static struct device_attribute net_class_attributes[] = {
 	__ATTR(addr_len, S_IRUGO, show_addr_len, NULL),
 	__ATTR(dev_id, S_IRUGO, show_dev_id, NULL),
@@ -261,6 +428,11 @@ static struct device_attribute net_class_attributes[] = {
 	__ATTR(flags, S_IRUGO | S_IWUSR, show_flags, store_flags),
 	__ATTR(tx_queue_len, S_IRUGO | S_IWUSR, show_tx_queue_len,
 	       store_tx_queue_len),
+#ifdef CONFIG_RPS
+	__ATTR(rps_cpus, S_IRUGO | S_IWUSR, show_rps_cpus, store_rps_cpus),
+	__ATTR(rps_flow_cnt, S_IRUGO | S_IWUSR, show_rps_flow_cnt,
+	       store_rps_flow_cnt),
+#endif
 	{}
 };
 
@@ -443,6 +615,171 @@ exit:
 }
 #endif
 
+#ifdef CONFIG_XPS
+/*
+ * queues/tx-<n>/ of a device, one kobject per TX queue.
+ */
+struct netdev_queue_attribute {
+	struct attribute attr;
+	ssize_t (*show)(struct netdev_queue *queue, char *buf);
+	ssize_t (*store)(struct netdev_queue *queue, const char *buf,
+			 size_t len);
+};
+#define to_netdev_queue_attr(_attr) \
+	container_of(_attr, struct netdev_queue_attribute, attr)
+#define to_netdev_queue(obj) container_of(obj, struct netdev_queue, kobj)
+
+static ssize_t netdev_queue_attr_show(struct kobject *kobj,
+				      struct attribute *attr, char *buf)
+{
+	struct netdev_queue_attribute *attribute = to_netdev_queue_attr(attr);
+
+	if (!attribute->show)
+		return -EIO;
+	return attribute->show(to_netdev_queue(kobj), buf);
+}
+
+static ssize_t netdev_queue_attr_store(struct kobject *kobj,
+				       struct attribute *attr,
+				       const char *buf, size_t count)
+{
+	struct netdev_queue_attribute *attribute = to_netdev_queue_attr(attr);
+
+	if (!attribute->store)
+		return -EIO;
+	return attribute->store(to_netdev_queue(kobj), buf, count);
+}
+
+static struct sysfs_ops netdev_queue_sysfs_ops = {
+	.show = netdev_queue_attr_show,
+	.store = netdev_queue_attr_store,
+};
+
+static inline unsigned int get_netdev_queue_index(struct netdev_queue *queue)
+{
+	return queue - queue->dev->_tx;
+}
+
+/*
+ * The CPUs that transmit on the queue, as a hex mask.  A CPU in the
+ * masks of several queues spreads its flows over them; a CPU in none
+ * has its flows hashed over all queues.
+ */
+static ssize_t show_xps_cpus(struct netdev_queue *queue, char *buf)
+{
+	struct net_device *dev = queue->dev;
+	unsigned int index = get_netdev_queue_index(queue);
+	struct xps_dev_maps *dev_maps;
+	struct xps_map *map;
+	cpumask_t mask;
+	size_t len;
+	int cpu, i;
+
+	cpus_clear(mask);
+	rcu_read_lock();
+	dev_maps = rcu_dereference(dev->xps_maps);
+	if (dev_maps) {
+		for_each_possible_cpu(cpu) {
+			map = dev_maps->cpu_map[cpu];
+			for (i = 0; map && i < map->len; i++) {
+				if (map->queues[i] == index) {
+					cpu_set(cpu, mask);
+					break;
+				}
+			}
+		}
+	}
+	rcu_read_unlock();
+
+	len = cpumask_scnprintf(buf, PAGE_SIZE - 1, mask);
+	buf[len++] = '\n';
+	return len;
+}
+
+static ssize_t store_xps_cpus(struct netdev_queue *queue, const char *buf,
+			      size_t len)
+{
+	struct net_device *dev = queue->dev;
+	cpumask_t mask;
+	int err;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	err = bitmap_parse(buf, len, cpus_addr(mask), NR_CPUS);
+	if (err)
+		return err;
+
+	rtnl_lock();
+	err = -EINVAL;
+	if (dev_isalive(dev))
+		err = netif_set_xps_queue(dev, &mask,
+					  get_netdev_queue_index(queue));
+	rtnl_unlock();
+
+	return err ? : len;
+}
+
+static struct netdev_queue_attribute xps_cpus_attribute =
+	__ATTR(xps_cpus, S_IRUGO | S_IWUSR, show_xps_cpus, store_xps_cpus);
+
+static struct attribute *netdev_queue_default_attrs[] = {
+	&xps_cpus_attribute.attr,
+	NULL
+};
+
+static void netdev_queue_release(struct kobject *kobj)
+{
+	struct netdev_queue *queue = to_netdev_queue(kobj);
+
+	dev_put(queue->dev);
+}
+
+static struct kobj_type netdev_queue_ktype = {
+	.sysfs_ops = &netdev_queue_sysfs_ops,
+	.release = netdev_queue_release,
+	.default_attrs = netdev_queue_default_attrs,
+};
+
+static void netdev_queue_unregister_kobjects(struct net_device *net,
+					     unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		kobject_put(&net->_tx[i].kobj);
+	kset_unregister(net->queues_kset);
+}
+
+static int netdev_queue_register_kobjects(struct net_device *net)
+{
+	struct netdev_queue *queue;
+	unsigned int i;
+	int error;
+
+	net->queues_kset = kset_create_and_add("queues", NULL,
+					       &net->dev.kobj);
+	if (!net->queues_kset)
+		return -ENOMEM;
+
+	for (i = 0; i < net->num_tx_queues; i++) {
+		queue = &net->_tx[i];
+		memset(&queue->kobj, 0, sizeof(queue->kobj));
+		queue->kobj.kset = net->queues_kset;
+		dev_hold(net);
+		error = kobject_init_and_add(&queue->kobj, &netdev_queue_ktype,
+					     NULL, "tx-%u", i);
+		if (error) {
+			kobject_put(&queue->kobj);
+			netdev_queue_unregister_kobjects(net, i);
+			return error;
+		}
+		kobject_uevent(&queue->kobj, KOBJ_ADD);
+	}
+	return 0;
+}
+#endif /* CONFIG_XPS */
+
 /*
  *	netdev_release -- destroy and free a dead device.
  *	Called when last reference to device kobject is gone.
@@ -454,6 +791,10 @@ static void netdev_release(struct device *d)
 	BUG_ON(dev->reg_state != NETREG_RELEASED);
 
 	kfree(dev->ifalias);
+#ifdef CONFIG_RPS
+	kfree(dev->rps_map);
+	vfree(dev->rps_flow_table);
+#endif
 	kfree((char *)dev - dev->padded);
 }
 
@@ -476,6 +817,9 @@ void netdev_unregister_kobject(struct net_device * net)
 	struct device *dev = &(net->dev);
 
 	kobject_get(&dev->kobj);
+#ifdef CONFIG_XPS
+	netdev_queue_unregister_kobjects(net, net->num_tx_queues);
+#endif
 	device_del(dev);
 }
 
@@ -484,6 +828,7 @@ int netdev_register_kobject(struct net_device *net)
 {
 	struct device *dev = &(net->dev);
 	struct attribute_group **groups = net->sysfs_groups;
+	int error;
 
 	dev->class = &net_class;
 	dev->platform_data = net;
@@ -501,7 +846,18 @@ int netdev_register_kobject(struct net_device *net)
 #endif
 #endif /* CONFIG_SYSFS */
 
-	return device_add(dev);
+	error = device_add(dev);
+	if (error)
+		return error;
+
+#ifdef CONFIG_XPS
+	error = netdev_queue_register_kobjects(net);
+	if (error) {
+		device_del(dev);
+		return error;
+	}
+#endif
+	return 0;
 }
 
 int netdev_class_create_file(struct class_attribute *class_attr)
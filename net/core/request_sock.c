@@ -34,16 +34,38 @@
  */
 int sysctl_max_syn_backlog = 256;
 
+/*
+ * SYNs are queued from all CPUs at once, without the listener lock, so the
+ * SYN table gets a few locks per CPU; they follow the table in memory.
+ */
+static u32 reqsk_synq_nr_locks(u32 nr_table_entries)
+{
+#if defined(CONFIG_PROVE_LOCKING)
+	u32 nr_locks = 2;
+#else
+	u32 nr_locks = roundup_pow_of_two(4 * num_possible_cpus());
+#endif
+	return min(nr_locks, nr_table_entries);
+}
+
+static size_t reqsk_listen_sock_size(u32 nr_table_entries)
+{
+	return sizeof(struct listen_sock) +
+	       nr_table_entries * sizeof(struct request_sock *) +
+	       reqsk_synq_nr_locks(nr_table_entries) * sizeof(spinlock_t);
+}
+
 int reqsk_queue_alloc(struct request_sock_queue *queue,
 		      unsigned int nr_table_entries)
 {
-	size_t lopt_size = sizeof(struct listen_sock);
 	struct listen_sock *lopt;
+	size_t lopt_size;
+	u32 i, nr_locks;
 
 	nr_table_entries = min_t(u32, nr_table_entries, sysctl_max_syn_backlog);
 	nr_table_entries = max_t(u32, nr_table_entries, 8);
 	nr_table_entries = roundup_pow_of_two(nr_table_entries + 1);
-	lopt_size += nr_table_entries * sizeof(struct request_sock *);
+	lopt_size = reqsk_listen_sock_size(nr_table_entries);
 	if (lopt_size > PAGE_SIZE)
 		lopt = __vmalloc(lopt_size,
 			GFP_KERNEL | __GFP_HIGHMEM | __GFP_ZERO,
@@ -62,6 +84,12 @@ int reqsk_queue_alloc(struct request_sock_queue *queue,
 	queue->rskq_accept_head = NULL;
 	lopt->nr_table_entries = nr_table_entries;
 
+	nr_locks = reqsk_synq_nr_locks(nr_table_entries);
+	lopt->syn_locks = (spinlock_t *)&lopt->syn_table[nr_table_entries];
+	for (i = 0; i < nr_locks; i++)
+		spin_lock_init(&lopt->syn_locks[i]);
+	lopt->syn_locks_mask = nr_locks - 1;
+
 	write_lock_bh(&queue->syn_wait_lock);
 	queue->listen_opt = lopt;
 	write_unlock_bh(&queue->syn_wait_lock);
@@ -80,8 +108,7 @@ void __reqsk_queue_destroy(struct request_sock_queue *queue)
 	 */
 
 	lopt = queue->listen_opt;
-	lopt_size = sizeof(struct listen_sock) +
-		lopt->nr_table_entries * sizeof(struct request_sock *);
+	lopt_size = reqsk_listen_sock_size(lopt->nr_table_entries);
 
 	if (lopt_size > PAGE_SIZE)
 		vfree(lopt);
@@ -106,10 +133,9 @@ void reqsk_queue_destroy(struct request_sock_queue *queue)
 {
 	/* make all the listen_opt local to us */
 	struct listen_sock *lopt = reqsk_queue_yank_listen_sk(queue);
-	size_t lopt_size = sizeof(struct listen_sock) +
-		lopt->nr_table_entries * sizeof(struct request_sock *);
+	size_t lopt_size = reqsk_listen_sock_size(lopt->nr_table_entries);
 
-	if (lopt->qlen != 0) {
+	if (atomic_read(&lopt->qlen) != 0) {
 		unsigned int i;
 
 		for (i = 0; i < lopt->nr_table_entries; i++) {
@@ -117,13 +143,13 @@ void reqsk_queue_destroy(struct request_sock_queue *queue)
 
 			while ((req = lopt->syn_table[i]) != NULL) {
 				lopt->syn_table[i] = req->dl_next;
-				lopt->qlen--;
+				atomic_dec(&lopt->qlen);
 				reqsk_free(req);
 			}
 		}
 	}
 
-	WARN_ON(lopt->qlen != 0);
+	WARN_ON(atomic_read(&lopt->qlen) != 0);
 	if (lopt_size > PAGE_SIZE)
 		vfree(lopt);
 	else
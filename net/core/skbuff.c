@@ -70,6 +70,24 @@
 static struct kmem_cache *skbuff_head_cache __read_mostly;
 static struct kmem_cache *skbuff_fclone_cache __read_mostly;
 
+/*
+ * Per-CPU cache of receive buffers.  Buffers freed in softirq context
+ * whose data area is the size that the receive path of this CPU last
+ * allocated, typically the device MTU plus headroom, are kept here and
+ * handed out again by the next netdev_alloc_skb() or dev_alloc_skb() of
+ * that size, which saves the slab round trips of both the head and the
+ * data.  The pools are only ever touched from softirq context of their
+ * own CPU.
+ */
+struct skb_recycle_pool {
+	struct sk_buff_head	list;
+	unsigned int		size;	/* of the data area of the buffers */
+};
+
+static DEFINE_PER_CPU(struct skb_recycle_pool, skb_recycle_pool);
+
+int sysctl_skb_recycle_max __read_mostly = 128;
+
 static void sock_pipe_buf_release(struct pipe_inode_info *pipe,
 				  struct pipe_buffer *buf)
 {
@@ -236,6 +254,79 @@ nodata:
 	goto out;
 }
 
+static inline int skb_recycle_context(void)
+{
+	return in_softirq() && !in_irq();
+}
+
+/*
+ * Take a buffer of @length bytes plus NET_SKB_PAD of headroom from the
+ * recycle pool of this CPU.  The pool follows the size asked for last
+ * whenever it runs empty.  Its buffers come from anywhere, so they are
+ * only handed out for plain GFP_ATOMIC allocations.
+ */
+static struct sk_buff *skb_recycle_alloc(unsigned int length, gfp_t gfp_mask)
+{
+	struct skb_recycle_pool *pool;
+	struct sk_buff *skb;
+	unsigned int size;
+
+	if (gfp_mask != GFP_ATOMIC || !skb_recycle_context())
+		return NULL;
+
+	size = SKB_DATA_ALIGN(length + NET_SKB_PAD);
+	pool = &__get_cpu_var(skb_recycle_pool);
+	if (size == pool->size) {
+		skb = __skb_dequeue(&pool->list);
+		if (skb) {
+			__get_cpu_var(netdev_rx_stat).recycle_hits++;
+			return skb;
+		}
+	} else if (skb_queue_empty(&pool->list))
+		pool->size = size;
+
+	__get_cpu_var(netdev_rx_stat).recycle_misses++;
+	return NULL;
+}
+
+/*
+ * Put @skb, whose last reference is being dropped, into the recycle pool
+ * of this CPU instead of freeing it, if it is a receive buffer of the
+ * size the pool holds.  Returns 1 if it did.
+ */
+static int skb_recycle(struct sk_buff *skb)
+{
+	struct skb_recycle_pool *pool;
+
+	if (!skb_recycle_context())
+		return 0;
+
+	pool = &__get_cpu_var(skb_recycle_pool);
+	if (skb_end_pointer(skb) - skb->head != pool->size ||
+	    skb_queue_len(&pool->list) >= sysctl_skb_recycle_max)
+		return 0;
+
+	atomic_set(&skb->users, 1);
+	if (!skb_recycle_check(skb, pool->size - NET_SKB_PAD))
+		return 0;
+
+	skb->truesize = pool->size + sizeof(struct sk_buff);
+	__skb_queue_head(&pool->list, skb);
+	return 1;
+}
+
+/**
+ *	skb_recycle_purge - free the recycled buffers of a CPU
+ *	@cpu: CPU whose pool to empty
+ *
+ *	Called once @cpu is dead, so that its pool is not touched by anyone
+ *	else.
+ */
+void skb_recycle_purge(int cpu)
+{
+	__skb_queue_purge(&per_cpu(skb_recycle_pool, cpu).list);
+}
+
 /**
  *	__netdev_alloc_skb - allocate an skbuff for rx on a specific device
  *	@dev: network device to receive on
@@ -255,6 +346,12 @@ struct sk_buff *__netdev_alloc_skb(struct net_device *dev,
 	int node = dev->dev.parent ? dev_to_node(dev->dev.parent) : -1;
 	struct sk_buff *skb;
 
+	skb = skb_recycle_alloc(length, gfp_mask);
+	if (skb) {
+		skb->dev = dev;
+		return skb;
+	}
+
 	skb = __alloc_skb(length + NET_SKB_PAD, gfp_mask, 0, node);
 	if (likely(skb)) {
 		skb_reserve(skb, NET_SKB_PAD);
@@ -297,6 +394,10 @@ EXPORT_SYMBOL(skb_add_rx_frag);
  */
 struct sk_buff *dev_alloc_skb(unsigned int length)
 {
+	struct sk_buff *skb = skb_recycle_alloc(length, GFP_ATOMIC);
+
+	if (skb)
+		return skb;
 	/*
 	 * There is more code here than it seems:
 	 * __dev_alloc_skb is an inline
@@ -427,6 +528,8 @@ static void skb_release_all(struct sk_buff *skb)
 
 void __kfree_skb(struct sk_buff *skb)
 {
+	if (skb_recycle(skb))
+		return;
 	skb_release_all(skb);
 	kfree_skbmem(skb);
 }
@@ -517,6 +620,7 @@ static void __copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 #endif
 	new->protocol		= old->protocol;
 	new->mark		= old->mark;
+	new->rxhash		= old->rxhash;
 	__nf_copy(new, old);
 #if defined(CONFIG_NETFILTER_XT_TARGET_TRACE) || \
     defined(CONFIG_NETFILTER_XT_TARGET_TRACE_MODULE)
@@ -2280,11 +2384,15 @@ EXPORT_SYMBOL_GPL(skb_pull_rcsum);
  *	This function performs segmentation on the given skb.  It returns
  *	a pointer to the first in a list of new skbs for the segments.
  *	In case of error it returns ERR_PTR(err).
+ *
+ *	The payload may continue on the frag_list, as in packets that GRO
+ *	merged, as long as each buffer there holds a whole segment.
  */
 struct sk_buff *skb_segment(struct sk_buff *skb, int features)
 {
 	struct sk_buff *segs = NULL;
 	struct sk_buff *tail = NULL;
+	struct sk_buff *fskb = skb_shinfo(skb)->frag_list;
 	unsigned int mss = skb_shinfo(skb)->gso_size;
 	unsigned int doffset = skb->data - skb_mac_header(skb);
 	unsigned int offset = doffset;
@@ -2304,7 +2412,6 @@ struct sk_buff *skb_segment(struct sk_buff *skb, int features)
 		struct sk_buff *nskb;
 		skb_frag_t *frag;
 		int hsize;
-		int k;
 		int size;
 
 		len = skb->len - offset;
@@ -2317,9 +2424,37 @@ struct sk_buff *skb_segment(struct sk_buff *skb, int features)
 		if (hsize > len || !sg)
 			hsize = len;
 
-		nskb = alloc_skb(hsize + doffset + headroom, GFP_ATOMIC);
-		if (unlikely(!nskb))
-			goto err;
+		if (!hsize && i >= nfrags) {
+			/* The segment is a buffer of the frag_list */
+			BUG_ON(fskb->len != len);
+
+			pos += len;
+			nskb = skb_clone(fskb, GFP_ATOMIC);
+			fskb = fskb->next;
+
+			if (unlikely(!nskb))
+				goto err;
+
+			hsize = skb_end_pointer(nskb) - nskb->head;
+			if (skb_cow_head(nskb, doffset + headroom)) {
+				kfree_skb(nskb);
+				goto err;
+			}
+
+			nskb->truesize += skb_end_pointer(nskb) - nskb->head -
+					  hsize;
+			skb_release_head_state(nskb);
+			__skb_push(nskb, doffset);
+		} else {
+			nskb = alloc_skb(hsize + doffset + headroom,
+					 GFP_ATOMIC);
+
+			if (unlikely(!nskb))
+				goto err;
+
+			skb_reserve(nskb, headroom);
+			__skb_put(nskb, doffset);
+		}
 
 		if (segs)
 			tail->next = nskb;
@@ -2330,13 +2465,15 @@ struct sk_buff *skb_segment(struct sk_buff *skb, int features)
 		__copy_skb_header(nskb, skb);
 		nskb->mac_len = skb->mac_len;
 
-		skb_reserve(nskb, headroom);
 		skb_reset_mac_header(nskb);
 		skb_set_network_header(nskb, skb->mac_len);
 		nskb->transport_header = (nskb->network_header +
 					  skb_network_header_len(skb));
-		skb_copy_from_linear_data(skb, skb_put(nskb, doffset),
-					  doffset);
+		skb_copy_from_linear_data(skb, nskb->data, doffset);
+
+		if (pos >= offset + len)
+			continue;
+
 		if (!sg) {
 			nskb->ip_summed = CHECKSUM_NONE;
 			nskb->csum = skb_copy_and_csum_bits(skb, offset,
@@ -2346,14 +2483,11 @@ struct sk_buff *skb_segment(struct sk_buff *skb, int features)
 		}
 
 		frag = skb_shinfo(nskb)->frags;
-		k = 0;
 
 		skb_copy_from_linear_data_offset(skb, offset,
 						 skb_put(nskb, hsize), hsize);
 
-		while (pos < offset + len) {
-			BUG_ON(i >= nfrags);
-
+		while (pos < offset + len && i < nfrags) {
 			*frag = skb_shinfo(skb)->frags[i];
 			get_page(frag->page);
 			size = frag->size;
@@ -2363,20 +2497,39 @@ struct sk_buff *skb_segment(struct sk_buff *skb, int features)
 				frag->size -= offset - pos;
 			}
 
-			k++;
+			skb_shinfo(nskb)->nr_frags++;
 
 			if (pos + size <= offset + len) {
 				i++;
 				pos += size;
 			} else {
 				frag->size -= pos + size - (offset + len);
-				break;
+				goto skip_fraglist;
 			}
 
 			frag++;
 		}
 
-		skb_shinfo(nskb)->nr_frags = k;
+		if (pos < offset + len) {
+			struct sk_buff *fskb2 = fskb;
+
+			BUG_ON(pos + fskb->len != offset + len);
+
+			pos += fskb->len;
+			fskb = fskb->next;
+
+			if (fskb2->next) {
+				fskb2 = skb_clone(fskb2, GFP_ATOMIC);
+				if (!fskb2)
+					goto err;
+			} else
+				skb_get(fskb2);
+
+			BUG_ON(skb_shinfo(nskb)->frag_list);
+			skb_shinfo(nskb)->frag_list = fskb2;
+		}
+
+skip_fraglist:
 		nskb->data_len = len - hsize;
 		nskb->len += nskb->data_len;
 		nskb->truesize += nskb->data_len;
@@ -2394,8 +2547,101 @@ err:
 
 EXPORT_SYMBOL_GPL(skb_segment);
 
+/**
+ *	skb_gro_receive - append a packet to one GRO holds
+ *	@head: list position of the held packet
+ *	@skb: packet to append, pulled to its payload
+ *
+ *	Moves the page fragments of @skb to the held packet if both keep
+ *	their payload in pages.  Otherwise the held packet is put behind a
+ *	new header buffer and @skb chained on its frag_list, each keeping
+ *	exactly one segment as skb_segment() expects.  Returns 0 once @skb
+ *	was merged, or an error if it cannot be.
+ */
+int skb_gro_receive(struct sk_buff **head, struct sk_buff *skb)
+{
+	struct sk_buff *p = *head;
+	struct sk_buff *nskb;
+	unsigned int headroom;
+	unsigned int hlen = p->data - skb_mac_header(p);
+
+	if (hlen + p->len + skb->len >= 65536)
+		return -E2BIG;
+
+	if (skb_shinfo(p)->frag_list)
+		goto merge;
+	else if (!skb_headlen(p) && !skb_headlen(skb)) {
+		if (skb_shinfo(p)->nr_frags + skb_shinfo(skb)->nr_frags >
+		    MAX_SKB_FRAGS)
+			return -E2BIG;
+
+		memcpy(skb_shinfo(p)->frags + skb_shinfo(p)->nr_frags,
+		       skb_shinfo(skb)->frags,
+		       skb_shinfo(skb)->nr_frags * sizeof(skb_frag_t));
+
+		skb_shinfo(p)->nr_frags += skb_shinfo(skb)->nr_frags;
+		skb_shinfo(skb)->nr_frags = 0;
+
+		skb->truesize -= skb->data_len;
+		skb->len -= skb->data_len;
+		skb->data_len = 0;
+
+		NAPI_GRO_CB(skb)->free = 1;
+		goto done;
+	}
+
+	headroom = skb_headroom(p);
+	nskb = netdev_alloc_skb(p->dev, headroom);
+	if (unlikely(!nskb))
+		return -ENOMEM;
+
+	__copy_skb_header(nskb, p);
+	nskb->mac_len = p->mac_len;
+
+	skb_reserve(nskb, headroom);
+
+	skb_set_mac_header(nskb, -hlen);
+	skb_set_network_header(nskb, skb_network_offset(p));
+	skb_set_transport_header(nskb, skb_transport_offset(p));
+
+	memcpy(skb_mac_header(nskb), skb_mac_header(p), hlen);
+
+	*NAPI_GRO_CB(nskb) = *NAPI_GRO_CB(p);
+	skb_shinfo(nskb)->frag_list = p;
+	skb_shinfo(nskb)->gso_size = skb_shinfo(p)->gso_size;
+	skb_header_release(p);
+	nskb->prev = p;
+
+	nskb->data_len += p->len;
+	nskb->truesize += p->len;
+	nskb->len += p->len;
+
+	*head = nskb;
+	nskb->next = p->next;
+	p->next = NULL;
+
+	p = nskb;
+
+merge:
+	p->prev->next = skb;
+	p->prev = skb;
+	skb_header_release(skb);
+
+done:
+	NAPI_GRO_CB(p)->count++;
+	p->data_len += skb->len;
+	p->truesize += skb->len;
+	p->len += skb->len;
+
+	NAPI_GRO_CB(skb)->same_flow = 1;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(skb_gro_receive);
+
 void __init skb_init(void)
 {
+	int cpu;
+
 	skbuff_head_cache = kmem_cache_create("skbuff_head_cache",
 					      sizeof(struct sk_buff),
 					      0,
@@ -2407,6 +2653,8 @@ void __init skb_init(void)
 						0,
 						SLAB_HWCACHE_ALIGN|SLAB_PANIC,
 						NULL);
+	for_each_possible_cpu(cpu)
+		skb_queue_head_init(&per_cpu(skb_recycle_pool, cpu).list);
 }
 
 /**
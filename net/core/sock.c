@@ -345,6 +345,7 @@ struct dst_entry *__sk_dst_check(struct sock *sk, u32 cookie)
 	struct dst_entry *dst = sk->sk_dst_cache;
 
 	if (dst && dst->obsolete && dst->ops->check(dst, cookie) == NULL) {
+		sk_tx_queue_clear(sk);
 		sk->sk_dst_cache = NULL;
 		dst_release(dst);
 		return NULL;
@@ -473,6 +474,9 @@ int sock_setsockopt(struct socket *sock, int level, int optname,
 	case SO_REUSEADDR:
 		sk->sk_reuse = valbool;
 		break;
+	case SO_REUSEPORT:
+		sk->sk_reuseport = valbool;
+		break;
 	case SO_TYPE:
 	case SO_ERROR:
 		ret = -ENOPROTOOPT;
@@ -721,6 +725,10 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 		v.val = sk->sk_reuse;
 		break;
 
+	case SO_REUSEPORT:
+		v.val = sk->sk_reuseport;
+		break;
+
 	case SO_KEEPALIVE:
 		v.val = !!sock_flag(sk, SOCK_KEEPOPEN);
 		break;
@@ -866,13 +874,23 @@ static inline void sock_lock_init(struct sock *sk)
 			af_family_keys + sk->sk_family);
 }
 
+/*
+ * Copy all of @osk but the hash linkage and reference count, which a
+ * lockless lookup may be looking at if @nsk was freed only an RCU grace
+ * period ago (see SLAB_DESTROY_BY_RCU).
+ */
 static void sock_copy(struct sock *nsk, const struct sock *osk)
 {
 #ifdef CONFIG_SECURITY_NETWORK
 	void *sptr = nsk->sk_security;
 #endif
+	const size_t skip_start = offsetof(struct sock, sk_node);
+	const size_t skip_end = offsetof(struct sock, sk_refcnt) +
+				sizeof(nsk->sk_refcnt);
 
-	memcpy(nsk, osk, osk->sk_prot->obj_size);
+	memcpy(nsk, osk, skip_start);
+	memcpy((char *)nsk + skip_end, (const char *)osk + skip_end,
+	       osk->sk_prot->obj_size - skip_end);
 #ifdef CONFIG_SECURITY_NETWORK
 	nsk->sk_security = sptr;
 	security_sk_clone(osk, nsk);
@@ -886,7 +904,22 @@ static struct sock *sk_prot_alloc(struct proto *prot, gfp_t priority,
 	struct kmem_cache *slab;
 
 	slab = prot->slab;
-	if (slab != NULL)
+	if (slab != NULL && (prot->slab_flags & SLAB_DESTROY_BY_RCU)) {
+		/*
+		 * Zero all of it but the hash linkage and reference count,
+		 * which a lockless lookup may still be looking at.
+		 */
+		sk = kmem_cache_alloc(slab, priority & ~__GFP_ZERO);
+		if (sk && (priority & __GFP_ZERO)) {
+			const size_t start = offsetof(struct sock, sk_node);
+			const size_t end = offsetof(struct sock, sk_refcnt) +
+					   sizeof(sk->sk_refcnt);
+
+			memset(sk, 0, start);
+			memset((char *)sk + end, 0, prot->obj_size - end);
+			sk_node_init(&sk->sk_node);
+		}
+	} else if (slab != NULL)
 		sk = kmem_cache_alloc(slab, priority);
 	else
 		sk = kmalloc(prot->obj_size, priority);
@@ -1053,6 +1086,7 @@ struct sock *sk_clone(const struct sock *sk, const gfp_t priority)
 
 		newsk->sk_err	   = 0;
 		newsk->sk_priority = 0;
+		sk_tx_queue_clear(newsk);
 		atomic_set(&newsk->sk_refcnt, 2);
 
 		/*
@@ -1738,6 +1772,7 @@ void sock_init_data(struct socket *sock, struct sock *sk)
 	sk->sk_sndtimeo		=	MAX_SCHEDULE_TIMEOUT;
 
 	sk->sk_stamp = ktime_set(-1L, 0);
+	sk_tx_queue_clear(sk);
 
 	atomic_set(&sk->sk_refcnt, 1);
 	atomic_set(&sk->sk_drops, 0);
@@ -2037,7 +2072,8 @@ int proto_register(struct proto *prot, int alloc_slab)
 {
 	if (alloc_slab) {
 		prot->slab = kmem_cache_create(prot->name, prot->obj_size, 0,
-					       SLAB_HWCACHE_ALIGN, NULL);
+					SLAB_HWCACHE_ALIGN | prot->slab_flags,
+					NULL);
 
 		if (prot->slab == NULL) {
 			printk(KERN_CRIT "%s: Can't create sock SLAB cache!\n",
@@ -2076,7 +2112,9 @@ int proto_register(struct proto *prot, int alloc_slab)
 			prot->twsk_prot->twsk_slab =
 				kmem_cache_create(prot->twsk_prot->twsk_slab_name,
 						  prot->twsk_prot->twsk_obj_size,
-						  0, SLAB_HWCACHE_ALIGN,
+						  0,
+						  SLAB_HWCACHE_ALIGN |
+							prot->slab_flags,
 						  NULL);
 			if (prot->twsk_prot->twsk_slab == NULL)
 				goto out_free_timewait_sock_slab_name;
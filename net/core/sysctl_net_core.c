@@ -11,9 +11,74 @@
 #include <linux/socket.h>
 #include <linux/netdevice.h>
 #include <linux/init.h>
+#include <linux/log2.h>
+#include <linux/vmalloc.h>
+#include <linux/filter.h>
 #include <net/sock.h>
 #include <net/xfrm.h>
 
+static int zero;
+
+#ifdef CONFIG_RPS
+/*
+ * Size the table of the CPUs flows were last read on, rounded up to a
+ * power of two.  Resizing forgets all flows.
+ */
+static int rps_sock_flow_sysctl(ctl_table *table, int write,
+				struct file *filp, void __user *buffer,
+				size_t *lenp, loff_t *ppos)
+{
+	static DEFINE_MUTEX(sock_flow_mutex);
+	struct rps_sock_flow_table *orig_sock_table, *sock_table;
+	unsigned int orig_size, size;
+	ctl_table tmp = {
+		.data = &size,
+		.maxlen = sizeof(size),
+		.mode = table->mode
+	};
+	int ret, i;
+
+	mutex_lock(&sock_flow_mutex);
+
+	orig_sock_table = rps_sock_flow_table;
+	size = orig_size = orig_sock_table ? orig_sock_table->mask + 1 : 0;
+
+	ret = proc_dointvec(&tmp, write, filp, buffer, lenp, ppos);
+	if (!write || ret)
+		goto out;
+
+	sock_table = NULL;
+	if (size) {
+		if (size > 1 << 30) {
+			ret = -EINVAL;
+			goto out;
+		}
+		size = roundup_pow_of_two(size);
+		if (size != orig_size) {
+			sock_table = vmalloc(RPS_SOCK_FLOW_TABLE_SIZE(size));
+			if (!sock_table) {
+				ret = -ENOMEM;
+				goto out;
+			}
+			sock_table->mask = size - 1;
+		} else
+			sock_table = orig_sock_table;
+
+		for (i = 0; i < size; i++)
+			sock_table->ents[i] = RPS_NO_CPU;
+	}
+
+	if (sock_table != orig_sock_table) {
+		rcu_assign_pointer(rps_sock_flow_table, sock_table);
+		synchronize_rcu();
+		vfree(orig_sock_table);
+	}
+out:
+	mutex_unlock(&sock_flow_mutex);
+	return ret;
+}
+#endif /* CONFIG_RPS */
+
 static struct ctl_table net_core_table[] = {
 #ifdef CONFIG_NET
 	{
@@ -64,6 +129,34 @@ static struct ctl_table net_core_table[] = {
 		.mode		= 0644,
 		.proc_handler	= &proc_dointvec
 	},
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "skb_recycle_max",
+		.data		= &sysctl_skb_recycle_max,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec_minmax,
+		.extra1		= &zero
+	},
+#ifdef CONFIG_RPS
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "rps_sock_flow_entries",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &rps_sock_flow_sysctl
+	},
+#endif
+#ifdef CONFIG_BPF_JIT
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "bpf_jit_enable",
+		.data		= &bpf_jit_enable,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec
+	},
+#endif
 	{
 		.ctl_name	= NET_CORE_MSG_COST,
 		.procname	= "message_cost",
@@ -56,6 +56,8 @@ int inet_csk_bind_conflict(const struct sock *sk,
 	struct sock *sk2;
 	struct hlist_node *node;
 	int reuse = sk->sk_reuse;
+	int reuseport = sk->sk_reuseport;
+	int uid = sock_i_uid((struct sock *)sk);
 
 	/*
 	 * Unlike other sk lookup places we do not check
@@ -70,8 +72,11 @@ int inet_csk_bind_conflict(const struct sock *sk,
 		    (!sk->sk_bound_dev_if ||
 		     !sk2->sk_bound_dev_if ||
 		     sk->sk_bound_dev_if == sk2->sk_bound_dev_if)) {
-			if (!reuse || !sk2->sk_reuse ||
-			    sk2->sk_state == TCP_LISTEN) {
+			if ((!reuse || !sk2->sk_reuse ||
+			     sk2->sk_state == TCP_LISTEN) &&
+			    (!reuseport || !sk2->sk_reuseport ||
+			     (sk2->sk_state != TCP_TIME_WAIT &&
+			      uid != sock_i_uid(sk2)))) {
 				const __be32 sk2_rcv_saddr = inet_rcv_saddr(sk2);
 				if (!sk2_rcv_saddr || !sk_rcv_saddr ||
 				    sk2_rcv_saddr == sk_rcv_saddr)
@@ -95,6 +100,7 @@ int inet_csk_get_port(struct sock *sk, unsigned short snum)
 	struct inet_bind_bucket *tb;
 	int ret;
 	struct net *net = sock_net(sk);
+	int uid = sock_i_uid(sk);
 
 	local_bh_disable();
 	if (!snum) {
@@ -147,6 +153,9 @@ tb_found:
 		if (tb->fastreuse > 0 &&
 		    sk->sk_reuse && sk->sk_state != TCP_LISTEN) {
 			goto success;
+		} else if (tb->fastreuseport > 0 &&
+			   sk->sk_reuseport && tb->fastuid == uid) {
+			goto success;
 		} else {
 			ret = 1;
 			if (inet_csk(sk)->icsk_af_ops->bind_conflict(sk, tb))
@@ -163,9 +172,19 @@ tb_not_found:
 			tb->fastreuse = 1;
 		else
 			tb->fastreuse = 0;
-	} else if (tb->fastreuse &&
-		   (!sk->sk_reuse || sk->sk_state == TCP_LISTEN))
-		tb->fastreuse = 0;
+		if (sk->sk_reuseport) {
+			tb->fastreuseport = 1;
+			tb->fastuid = uid;
+		} else
+			tb->fastreuseport = 0;
+	} else {
+		if (tb->fastreuse &&
+		    (!sk->sk_reuse || sk->sk_state == TCP_LISTEN))
+			tb->fastreuse = 0;
+		if (tb->fastreuseport &&
+		    (!sk->sk_reuseport || tb->fastuid != uid))
+			tb->fastreuseport = 0;
+	}
 success:
 	if (!inet_csk(sk)->icsk_bind_hash)
 		inet_bind_hash(sk, tb, snum);
@@ -261,8 +280,8 @@ struct sock *inet_csk_accept(struct sock *sk, int flags, int *err)
 			goto out_err;
 	}
 
+	/* A TCP Fast Open child may still be in SYN_RECV here */
 	newsk = reqsk_queue_get_child(&icsk->icsk_accept_queue, sk);
-	WARN_ON(newsk->sk_state == TCP_SYN_RECV);
 out:
 	release_sock(sk);
 	return newsk;
@@ -370,17 +389,15 @@ static inline u32 inet_synq_hash(const __be32 raddr, const __be16 rport,
 #define AF_INET_FAMILY(fam) 1
 #endif
 
-struct request_sock *inet_csk_search_req(const struct sock *sk,
-					 struct request_sock ***prevp,
-					 const __be16 rport, const __be32 raddr,
-					 const __be32 laddr)
+static struct request_sock **__inet_csk_search_req(struct listen_sock *lopt,
+						   const u32 h,
+						   const __be16 rport,
+						   const __be32 raddr,
+						   const __be32 laddr)
 {
-	const struct inet_connection_sock *icsk = inet_csk(sk);
-	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
 	struct request_sock *req, **prev;
 
-	for (prev = &lopt->syn_table[inet_synq_hash(raddr, rport, lopt->hash_rnd,
-						    lopt->nr_table_entries)];
+	for (prev = &lopt->syn_table[h];
 	     (req = *prev) != NULL;
 	     prev = &req->dl_next) {
 		const struct inet_request_sock *ireq = inet_rsk(req);
@@ -388,11 +405,31 @@ struct request_sock *inet_csk_search_req(const struct sock *sk,
 		if (ireq->rmt_port == rport &&
 		    ireq->rmt_addr == raddr &&
 		    ireq->loc_addr == laddr &&
-		    AF_INET_FAMILY(req->rsk_ops->family)) {
-			WARN_ON(req->sk);
-			*prevp = prev;
+		    AF_INET_FAMILY(req->rsk_ops->family))
 			break;
-		}
+	}
+
+	return prev;
+}
+
+/* Caller must hold the listener lock. */
+struct request_sock *inet_csk_search_req(const struct sock *sk,
+					 struct request_sock ***prevp,
+					 const __be16 rport, const __be32 raddr,
+					 const __be32 laddr)
+{
+	const struct inet_connection_sock *icsk = inet_csk(sk);
+	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
+	struct request_sock *req, **prev;
+
+	prev = __inet_csk_search_req(lopt,
+				     inet_synq_hash(raddr, rport, lopt->hash_rnd,
+						    lopt->nr_table_entries),
+				     rport, raddr, laddr);
+	req = *prev;
+	if (req != NULL) {
+		WARN_ON(req->sk);
+		*prevp = prev;
 	}
 
 	return req;
@@ -400,6 +437,30 @@ struct request_sock *inet_csk_search_req(const struct sock *sk,
 
 EXPORT_SYMBOL_GPL(inet_csk_search_req);
 
+/*
+ * Whether a request is queued for this peer, for a SYN processed without
+ * the listener lock: no request can be looked at once the slice lock is
+ * dropped, the listener lock is needed for that.
+ */
+int inet_csk_reqsk_queued(const struct sock *sk, const __be16 rport,
+			  const __be32 raddr, const __be32 laddr)
+{
+	const struct inet_connection_sock *icsk = inet_csk(sk);
+	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
+	const u32 h = inet_synq_hash(raddr, rport, lopt->hash_rnd,
+				     lopt->nr_table_entries);
+	spinlock_t *lock = reqsk_synq_lockp(lopt, h);
+	int queued;
+
+	spin_lock(lock);
+	queued = *__inet_csk_search_req(lopt, h, rport, raddr, laddr) != NULL;
+	spin_unlock(lock);
+
+	return queued;
+}
+
+EXPORT_SYMBOL_GPL(inet_csk_reqsk_queued);
+
 void inet_csk_reqsk_queue_hash_add(struct sock *sk, struct request_sock *req,
 				   unsigned long timeout)
 {
@@ -408,10 +469,64 @@ void inet_csk_reqsk_queue_hash_add(struct sock *sk, struct request_sock *req,
 	const u32 h = inet_synq_hash(inet_rsk(req)->rmt_addr, inet_rsk(req)->rmt_port,
 				     lopt->hash_rnd, lopt->nr_table_entries);
 
+	/* Counted before it is published, a removal could take qlen below 0 */
+	inet_csk_reqsk_queue_added(sk, timeout);
 	reqsk_queue_hash_req(&icsk->icsk_accept_queue, h, req, timeout);
+}
+
+/*
+ * Queues req like inet_csk_reqsk_queue_hash_add(), but returns with its slice
+ * of the SYN table still locked.  A request queued without the listener lock
+ * goes in before its SYN-ACK is sent, or the ACK could be processed on another
+ * CPU before there is a request for it; the slice lock then keeps the request
+ * from being dropped and freed under the SYN-ACK until
+ * inet_csk_reqsk_queue_hash_unlock().
+ */
+spinlock_t *__inet_csk_reqsk_queue_hash_lock(struct sock *sk,
+					     struct request_sock *req,
+					     const u32 hash,
+					     unsigned long timeout)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	spinlock_t *lock = reqsk_synq_lockp(queue->listen_opt, hash);
+
 	inet_csk_reqsk_queue_added(sk, timeout);
+	spin_lock(lock);
+	__reqsk_queue_hash_req(queue, hash, req, timeout);
+	return lock;
 }
 
+EXPORT_SYMBOL_GPL(__inet_csk_reqsk_queue_hash_lock);
+
+spinlock_t *inet_csk_reqsk_queue_hash_lock(struct sock *sk,
+					   struct request_sock *req,
+					   unsigned long timeout)
+{
+	struct listen_sock *lopt = inet_csk(sk)->icsk_accept_queue.listen_opt;
+	const u32 h = inet_synq_hash(inet_rsk(req)->rmt_addr, inet_rsk(req)->rmt_port,
+				     lopt->hash_rnd, lopt->nr_table_entries);
+
+	return __inet_csk_reqsk_queue_hash_lock(sk, req, h, timeout);
+}
+
+EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_hash_lock);
+
+/*
+ * Unlocks the slice locked by inet_csk_reqsk_queue_hash_lock(), first taking
+ * req back out of the queue if unhash is set, for the caller to free it.
+ */
+void inet_csk_reqsk_queue_hash_unlock(struct sock *sk, struct request_sock *req,
+				      spinlock_t *lock, const int unhash)
+{
+	if (unhash) {
+		__reqsk_queue_unhash_req(&inet_csk(sk)->icsk_accept_queue, req);
+		inet_csk_reqsk_queue_removed(sk, req);
+	}
+	spin_unlock(lock);
+}
+
+EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_hash_unlock);
+
 /* Only thing we need from tcp.h */
 extern int sysctl_tcp_synack_retries;
 
@@ -429,9 +544,10 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 	int thresh = max_retries;
 	unsigned long now = jiffies;
 	struct request_sock **reqp, *req;
-	int i, budget;
+	int i, budget, qlen;
 
-	if (lopt == NULL || lopt->qlen == 0)
+	qlen = lopt != NULL ? atomic_read(&lopt->qlen) : 0;
+	if (qlen == 0)
 		return;
 
 	/* Normally all the openreqs are young and become mature
@@ -451,11 +567,11 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 	 * embrions; and abort old ones without pity, if old
 	 * ones are about to clog our table.
 	 */
-	if (lopt->qlen>>(lopt->max_qlen_log-1)) {
-		int young = (lopt->qlen_young<<1);
+	if (qlen>>(lopt->max_qlen_log-1)) {
+		int young = (atomic_read(&lopt->qlen_young)<<1);
 
 		while (thresh > 2) {
-			if (lopt->qlen < young)
+			if (qlen < young)
 				break;
 			thresh--;
 			young <<= 1;
@@ -478,7 +594,7 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 					unsigned long timeo;
 
 					if (req->retrans++ == 0)
-						lopt->qlen_young--;
+						atomic_dec(&lopt->qlen_young);
 					timeo = min((timeout << req->retrans), max_rto);
 					req->expires = now + timeo;
 					reqp = &req->dl_next;
@@ -500,7 +616,7 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 
 	lopt->clock_hand = i;
 
-	if (lopt->qlen)
+	if (atomic_read(&lopt->qlen))
 		inet_csk_reset_keepalive_timer(parent, interval);
 }
 
@@ -612,6 +728,16 @@ void inet_csk_listen_stop(struct sock *sk)
 	struct request_sock *acc_req;
 	struct request_sock *req;
 
+	/* SYNs may be queueing requests without the listener lock.  The
+	 * listener has left the LISTEN state and the listening hash by now,
+	 * so wait for those that still found it before tearing down the
+	 * queue and its timer.  They mark the queue before checking the
+	 * state, listeners that never saw one need not wait.
+	 */
+	smp_mb();
+	if (icsk->icsk_accept_queue.rskq_syn_lockless)
+		synchronize_net();
+
 	inet_csk_delete_keepalive_timer(sk);
 
 	/* make all the listen_opt local to us */
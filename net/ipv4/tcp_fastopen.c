@@ -0,0 +1,339 @@
+/*
+ * TCP Fast Open: data in the SYN of a connection to a server which handed
+ * the client a cookie on an earlier connection.
+ *
+ * The server side issues and checks the cookies and creates the child
+ * socket straight from the SYN; the client side remembers the cookies
+ * (and MSS) servers gave it.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/random.h>
+#include <linux/jhash.h>
+#include <linux/seqlock.h>
+#include <linux/cryptohash.h>
+#include <linux/sysctl.h>
+#include <net/tcp.h>
+#include <net/ipv6.h>
+
+int sysctl_tcp_fastopen __read_mostly = TFO_CLIENT_ENABLE;
+
+/* Server cookie keys. The cookie of a client is a MAC of its address
+ * under the current key; a cookie made under the previous key is still
+ * honoured, so that replacing the key through sysctl does not cost
+ * every client a round trip at once.
+ */
+static struct {
+	seqlock_t	lock;
+	u32		key[2][TCP_FASTOPEN_KEY_LENGTH / 4];	/* current, previous */
+} tcp_fastopen_keys = {
+	.lock = __SEQLOCK_UNLOCKED(tcp_fastopen_keys.lock),
+};
+
+static DEFINE_PER_CPU(__u32, tcp_fastopen_scratch)[16 + 5 + SHA_WORKSPACE_WORDS];
+
+static void tcp_fastopen_reset_key(const u32 *key)
+{
+	write_seqlock_bh(&tcp_fastopen_keys.lock);
+	memcpy(tcp_fastopen_keys.key[1], tcp_fastopen_keys.key[0],
+	       TCP_FASTOPEN_KEY_LENGTH);
+	memcpy(tcp_fastopen_keys.key[0], key, TCP_FASTOPEN_KEY_LENGTH);
+	write_sequnlock_bh(&tcp_fastopen_keys.lock);
+}
+
+static void tcp_fastopen_get_key(int prev, u32 *key)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&tcp_fastopen_keys.lock);
+		memcpy(key, tcp_fastopen_keys.key[prev],
+		       TCP_FASTOPEN_KEY_LENGTH);
+	} while (read_seqretry(&tcp_fastopen_keys.lock, seq));
+}
+
+/* Generate the cookie of the client of req.  Called with BHs disabled. */
+static void tcp_fastopen_cookie_gen(const struct request_sock *req, int prev,
+				    struct tcp_fastopen_cookie *foc)
+{
+	__u32 *tmp = __get_cpu_var(tcp_fastopen_scratch);
+
+	memset(tmp, 0, 16 * sizeof(__u32));
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	if (req->rsk_ops->family == AF_INET6)
+		memcpy(tmp, &inet6_rsk(req)->rmt_addr, sizeof(struct in6_addr));
+	else
+#endif
+		tmp[0] = (__force u32)inet_rsk(req)->rmt_addr;
+	tcp_fastopen_get_key(prev, tmp + 4);
+
+	sha_init(tmp + 16);
+	sha_transform(tmp + 16, (char *)tmp, tmp + 16 + 5);
+
+	memcpy(foc->val, tmp + 16, TCP_FASTOPEN_COOKIE_SIZE);
+	foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+}
+
+/* Fill valid_foc with the current cookie of the client of req and check
+ * the one it sent against it.  Returns 1 for a match under the current
+ * key, 2 under the previous key and 0 otherwise.
+ */
+static int tcp_fastopen_cookie_match(const struct request_sock *req,
+				     const struct tcp_fastopen_cookie *foc,
+				     struct tcp_fastopen_cookie *valid_foc)
+{
+	struct tcp_fastopen_cookie prev_foc;
+
+	tcp_fastopen_cookie_gen(req, 0, valid_foc);
+	if (foc->len != TCP_FASTOPEN_COOKIE_SIZE)
+		return 0;
+	if (!memcmp(foc->val, valid_foc->val, TCP_FASTOPEN_COOKIE_SIZE))
+		return 1;
+
+	tcp_fastopen_cookie_gen(req, 1, &prev_foc);
+	if (!memcmp(foc->val, prev_foc.val, TCP_FASTOPEN_COOKIE_SIZE))
+		return 2;
+	return 0;
+}
+
+/**
+ * tcp_fastopen_check - decide whether a SYN may open a Fast Open child
+ * @sk: listening socket
+ * @skb: the SYN
+ * @req: request built from the SYN
+ * @foc: Fast Open option of the SYN, -1 in len if it had none
+ *
+ * Returns 1 if the data in the SYN is to be accepted right away through
+ * tcp_fastopen_create_child(), before the SYN-ACK goes out; the SYN-ACK
+ * then acknowledges the data as well.  On return @foc holds the cookie
+ * to echo in the SYN-ACK, or -1 in len for none.
+ */
+int tcp_fastopen_check(struct sock *sk, struct sk_buff *skb,
+		       struct request_sock *req,
+		       struct tcp_fastopen_cookie *foc)
+{
+	struct tcp_fastopen_cookie valid_foc;
+	int match;
+
+	if (foc->len < 0)
+		return 0;
+
+	if (!(sysctl_tcp_fastopen & TFO_SERVER_ENABLE) ||
+	    !tcp_sk(sk)->fastopen_qlen) {
+		foc->len = -1;
+		return 0;
+	}
+
+	if (foc->len == 0)
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENCOOKIEREQD);
+
+	match = tcp_fastopen_cookie_match(req, foc, &valid_foc);
+	if (match &&
+	    TCP_SKB_CB(skb)->end_seq != TCP_SKB_CB(skb)->seq + 1 &&
+	    !tcp_hdr(skb)->fin &&
+	    sk->sk_ack_backlog < tcp_sk(sk)->fastopen_qlen &&
+	    !sk_acceptq_is_full(sk)) {
+		tcp_rsk(req)->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+		/* Hand out a fresh cookie if it was made under the old key */
+		if (match == 1)
+			foc->len = -1;
+		else
+			*foc = valid_foc;
+		return 1;
+	}
+
+	if (foc->len > 0)
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
+	*foc = valid_foc;
+	return 0;
+}
+
+/**
+ * tcp_fastopen_create_child - open a connection straight from its SYN
+ * @sk: listening socket
+ * @skb: the SYN, carrying data
+ * @req: request built from the SYN
+ * @dst: route of the SYN-ACK
+ *
+ * The child is created in SYN_RECV, gets the data in the SYN queued for
+ * reading and goes onto the accept queue of @sk at once.  It owns @req
+ * until the handshake completes, to retransmit the SYN-ACK from its own
+ * retransmit timer.  The caller sends the first SYN-ACK once the child is
+ * there, as it acknowledges the data.  Returns 0 on success; on failure
+ * the caller still owns @req.
+ */
+int tcp_fastopen_create_child(struct sock *sk, struct sk_buff *skb,
+			      struct request_sock *req, struct dst_entry *dst)
+{
+	struct request_sock *carrier;
+	struct tcp_sock *tp;
+	struct sock *child;
+
+	/* The accept queue frees its entry when the child is accepted,
+	 * so it gets one of its own rather than req.
+	 */
+	carrier = reqsk_alloc(req->rsk_ops);
+	if (carrier == NULL)
+		goto fail;
+
+	/* The child takes its window from the request */
+	tcp_openreq_init_rwin(req, sk, dst);
+	child = inet_csk(sk)->icsk_af_ops->syn_recv_sock(sk, skb, req, NULL);
+	if (child == NULL) {
+		__reqsk_free(carrier);
+		goto fail;
+	}
+
+	req->retrans = 0;
+	req->sk = NULL;
+	tp = tcp_sk(child);
+	tp->fastopen_rsk = req;
+
+	/* RFC1323: The window in SYN & SYN/ACK segments is never scaled. */
+	tp->snd_wnd = ntohs(tcp_hdr(skb)->window);
+	tp->max_window = tp->snd_wnd;
+
+	/* The child may be read from and written to before the final ACK
+	 * of the handshake arrives, so set it up for data transfer now.
+	 */
+	tcp_init_transfer(child);
+
+	/* Queue the data carried in the SYN; the caller frees its own
+	 * reference to the skb.
+	 */
+	skb = skb_get(skb);
+	__skb_pull(skb, tcp_hdr(skb)->doff * 4);
+	skb_set_owner_r(skb, child);
+	__skb_queue_tail(&child->sk_receive_queue, skb);
+	tp->rcv_nxt = tp->rcv_wup = TCP_SKB_CB(skb)->end_seq;
+
+	inet_csk_reset_xmit_timer(child, ICSK_TIME_RETRANS,
+				  TCP_TIMEOUT_INIT, TCP_RTO_MAX);
+
+	inet_csk_reqsk_queue_add(sk, carrier, child);
+	sk->sk_data_ready(sk, 0);
+
+	bh_unlock_sock(child);
+	sock_put(child);
+	NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVE);
+	return 0;
+
+fail:
+	NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
+	return -1;
+}
+
+/* Client side cache of the cookies and MSS servers gave us.  Direct
+ * mapped on the server address; a collision simply evicts the entry.
+ */
+#define TCP_FASTOPEN_CACHE_SIZE	256
+
+struct tcp_fastopen_cache_entry {
+	struct net			*net;
+	struct in6_addr			daddr;	/* IPv4 is v4-mapped */
+	u16				mss;
+	struct tcp_fastopen_cookie	cookie;
+};
+
+static struct tcp_fastopen_cache_entry tcp_fastopen_cache[TCP_FASTOPEN_CACHE_SIZE];
+static DEFINE_SPINLOCK(tcp_fastopen_cache_lock);
+static u32 tcp_fastopen_cache_rnd __read_mostly;
+
+static struct tcp_fastopen_cache_entry *
+tcp_fastopen_cache_find(struct sock *sk, struct in6_addr *daddr)
+{
+	u32 hash;
+
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	if (sk->sk_family == AF_INET6)
+		ipv6_addr_copy(daddr, &inet6_sk(sk)->daddr);
+	else
+#endif
+		ipv6_addr_set(daddr, 0, 0, htonl(0x0000FFFF),
+			      inet_sk(sk)->daddr);
+
+	hash = jhash2((u32 *)daddr, 4, tcp_fastopen_cache_rnd);
+	return &tcp_fastopen_cache[hash & (TCP_FASTOPEN_CACHE_SIZE - 1)];
+}
+
+void tcp_fastopen_cache_get(struct sock *sk, u16 *mss,
+			    struct tcp_fastopen_cookie *cookie)
+{
+	struct tcp_fastopen_cache_entry *e;
+	struct in6_addr daddr;
+
+	e = tcp_fastopen_cache_find(sk, &daddr);
+
+	spin_lock_bh(&tcp_fastopen_cache_lock);
+	if (e->net == sock_net(sk) && ipv6_addr_equal(&e->daddr, &daddr)) {
+		if (e->mss)
+			*mss = e->mss;
+		*cookie = e->cookie;
+	}
+	spin_unlock_bh(&tcp_fastopen_cache_lock);
+}
+
+void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+			    struct tcp_fastopen_cookie *cookie)
+{
+	struct tcp_fastopen_cache_entry *e;
+	struct in6_addr daddr;
+
+	e = tcp_fastopen_cache_find(sk, &daddr);
+
+	spin_lock_bh(&tcp_fastopen_cache_lock);
+	if (e->net != sock_net(sk) || !ipv6_addr_equal(&e->daddr, &daddr)) {
+		e->net = sock_net(sk);
+		ipv6_addr_copy(&e->daddr, &daddr);
+		e->mss = 0;
+		e->cookie.len = 0;
+	}
+	if (mss)
+		e->mss = mss;
+	if (cookie->len > 0)
+		e->cookie = *cookie;
+	spin_unlock_bh(&tcp_fastopen_cache_lock);
+}
+
+/* The key is read and written as four dash separated 32 bit hex words */
+int proc_tcp_fastopen_key(struct ctl_table *ctl, int write,
+			  struct file *filp, void __user *buffer,
+			  size_t *lenp, loff_t *ppos)
+{
+	ctl_table tbl = { .maxlen = (TCP_FASTOPEN_KEY_LENGTH * 2 + 10) };
+	u32 key[TCP_FASTOPEN_KEY_LENGTH / 4];
+	int ret;
+
+	tbl.data = kmalloc(tbl.maxlen, GFP_KERNEL);
+	if (!tbl.data)
+		return -ENOMEM;
+
+	tcp_fastopen_get_key(0, key);
+	snprintf(tbl.data, tbl.maxlen, "%08x-%08x-%08x-%08x",
+		 key[0], key[1], key[2], key[3]);
+	ret = proc_dostring(&tbl, write, filp, buffer, lenp, ppos);
+
+	if (write && ret == 0) {
+		if (sscanf(tbl.data, "%x-%x-%x-%x",
+			   key, key + 1, key + 2, key + 3) != 4)
+			ret = -EINVAL;
+		else
+			tcp_fastopen_reset_key(key);
+	}
+
+	kfree(tbl.data);
+	return ret;
+}
+
+void __init tcp_fastopen_init(void)
+{
+	get_random_bytes(tcp_fastopen_keys.key, sizeof(tcp_fastopen_keys.key));
+	get_random_bytes(&tcp_fastopen_cache_rnd, sizeof(tcp_fastopen_cache_rnd));
+}
@@ -31,6 +31,9 @@ int inet6_csk_bind_conflict(const struct sock *sk,
 {
 	const struct sock *sk2;
 	const struct hlist_node *node;
+	int reuse = sk->sk_reuse;
+	int reuseport = sk->sk_reuseport;
+	int uid = sock_i_uid((struct sock *)sk);
 
 	/* We must walk the whole port owner list in this case. -DaveM */
 	/*
@@ -42,9 +45,12 @@ int inet6_csk_bind_conflict(const struct sock *sk,
 		    (!sk->sk_bound_dev_if ||
 		     !sk2->sk_bound_dev_if ||
 		     sk->sk_bound_dev_if == sk2->sk_bound_dev_if) &&
-		    (!sk->sk_reuse || !sk2->sk_reuse ||
+		    (!reuse || !sk2->sk_reuse ||
 		     sk2->sk_state == TCP_LISTEN) &&
-		     ipv6_rcv_saddr_equal(sk, sk2))
+		    (!reuseport || !sk2->sk_reuseport ||
+		     (sk2->sk_state != TCP_TIME_WAIT &&
+		      uid != sock_i_uid((struct sock *)sk2))) &&
+		    ipv6_rcv_saddr_equal(sk, sk2))
 			break;
 	}
 
@@ -75,20 +81,16 @@ static u32 inet6_synq_hash(const struct in6_addr *raddr, const __be16 rport,
 	return c & (synq_hsize - 1);
 }
 
-struct request_sock *inet6_csk_search_req(const struct sock *sk,
-					  struct request_sock ***prevp,
-					  const __be16 rport,
-					  const struct in6_addr *raddr,
-					  const struct in6_addr *laddr,
-					  const int iif)
+static struct request_sock **__inet6_csk_search_req(struct listen_sock *lopt,
+						    const u32 h,
+						    const __be16 rport,
+						    const struct in6_addr *raddr,
+						    const struct in6_addr *laddr,
+						    const int iif)
 {
-	const struct inet_connection_sock *icsk = inet_csk(sk);
-	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
 	struct request_sock *req, **prev;
 
-	for (prev = &lopt->syn_table[inet6_synq_hash(raddr, rport,
-						     lopt->hash_rnd,
-						     lopt->nr_table_entries)];
+	for (prev = &lopt->syn_table[h];
 	     (req = *prev) != NULL;
 	     prev = &req->dl_next) {
 		const struct inet6_request_sock *treq = inet6_rsk(req);
@@ -97,18 +99,63 @@ struct request_sock *inet6_csk_search_req(const struct sock *sk,
 		    req->rsk_ops->family == AF_INET6 &&
 		    ipv6_addr_equal(&treq->rmt_addr, raddr) &&
 		    ipv6_addr_equal(&treq->loc_addr, laddr) &&
-		    (!treq->iif || treq->iif == iif)) {
-			WARN_ON(req->sk != NULL);
-			*prevp = prev;
-			return req;
-		}
+		    (!treq->iif || treq->iif == iif))
+			break;
 	}
 
-	return NULL;
+	return prev;
+}
+
+/* Caller must hold the listener lock. */
+struct request_sock *inet6_csk_search_req(const struct sock *sk,
+					  struct request_sock ***prevp,
+					  const __be16 rport,
+					  const struct in6_addr *raddr,
+					  const struct in6_addr *laddr,
+					  const int iif)
+{
+	const struct inet_connection_sock *icsk = inet_csk(sk);
+	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
+	struct request_sock *req, **prev;
+
+	prev = __inet6_csk_search_req(lopt,
+				      inet6_synq_hash(raddr, rport,
+						      lopt->hash_rnd,
+						      lopt->nr_table_entries),
+				      rport, raddr, laddr, iif);
+	req = *prev;
+	if (req != NULL) {
+		WARN_ON(req->sk != NULL);
+		*prevp = prev;
+	}
+
+	return req;
 }
 
 EXPORT_SYMBOL_GPL(inet6_csk_search_req);
 
+/* See inet_csk_reqsk_queued() */
+int inet6_csk_reqsk_queued(const struct sock *sk, const __be16 rport,
+			   const struct in6_addr *raddr,
+			   const struct in6_addr *laddr, const int iif)
+{
+	const struct inet_connection_sock *icsk = inet_csk(sk);
+	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
+	const u32 h = inet6_synq_hash(raddr, rport, lopt->hash_rnd,
+				      lopt->nr_table_entries);
+	spinlock_t *lock = reqsk_synq_lockp(lopt, h);
+	int queued;
+
+	spin_lock(lock);
+	queued = *__inet6_csk_search_req(lopt, h, rport, raddr, laddr,
+					 iif) != NULL;
+	spin_unlock(lock);
+
+	return queued;
+}
+
+EXPORT_SYMBOL_GPL(inet6_csk_reqsk_queued);
+
 void inet6_csk_reqsk_queue_hash_add(struct sock *sk,
 				    struct request_sock *req,
 				    const unsigned long timeout)
@@ -119,12 +166,28 @@ void inet6_csk_reqsk_queue_hash_add(struct sock *sk,
 				      inet_rsk(req)->rmt_port,
 				      lopt->hash_rnd, lopt->nr_table_entries);
 
-	reqsk_queue_hash_req(&icsk->icsk_accept_queue, h, req, timeout);
+	/* Counted before it is published, a removal could take qlen below 0 */
 	inet_csk_reqsk_queue_added(sk, timeout);
+	reqsk_queue_hash_req(&icsk->icsk_accept_queue, h, req, timeout);
 }
 
 EXPORT_SYMBOL_GPL(inet6_csk_reqsk_queue_hash_add);
 
+/* See inet_csk_reqsk_queue_hash_lock() */
+spinlock_t *inet6_csk_reqsk_queue_hash_lock(struct sock *sk,
+					    struct request_sock *req,
+					    const unsigned long timeout)
+{
+	struct listen_sock *lopt = inet_csk(sk)->icsk_accept_queue.listen_opt;
+	const u32 h = inet6_synq_hash(&inet6_rsk(req)->rmt_addr,
+				      inet_rsk(req)->rmt_port,
+				      lopt->hash_rnd, lopt->nr_table_entries);
+
+	return __inet_csk_reqsk_queue_hash_lock(sk, req, h, timeout);
+}
+
+EXPORT_SYMBOL_GPL(inet6_csk_reqsk_queue_hash_lock);
+
 void inet6_csk_addr2sockaddr(struct sock *sk, struct sockaddr * uaddr)
 {
 	struct ipv6_pinfo *np = inet6_sk(sk);
@@ -168,6 +231,7 @@ struct dst_entry *__inet6_csk_dst_check(struct sock *sk, u32 cookie)
 	if (dst) {
 		struct rt6_info *rt = (struct rt6_info *)dst;
 		if (rt->rt6i_flow_cache_genid != atomic_read(&flow_cache_genid)) {
+			sk_tx_queue_clear(sk);
 			sk->sk_dst_cache = NULL;
 			dst_release(dst);
 			dst = NULL;
@@ -458,44 +458,58 @@ out:
 }
 
 
-static int tcp_v6_send_synack(struct sock *sk, struct request_sock *req)
+/* Route the SYN-ACK of @req, filling in @fl */
+static struct dst_entry *tcp_v6_route_req(struct sock *sk,
+					  struct request_sock *req,
+					  struct flowi *fl)
 {
 	struct inet6_request_sock *treq = inet6_rsk(req);
-	struct ipv6_pinfo *np = inet6_sk(sk);
-	struct sk_buff * skb;
-	struct ipv6_txoptions *opt = NULL;
+	struct ipv6_txoptions *opt = inet6_sk(sk)->opt;
 	struct in6_addr * final_p = NULL, final;
-	struct flowi fl;
 	struct dst_entry *dst;
-	int err = -1;
 
-	memset(&fl, 0, sizeof(fl));
-	fl.proto = IPPROTO_TCP;
-	ipv6_addr_copy(&fl.fl6_dst, &treq->rmt_addr);
-	ipv6_addr_copy(&fl.fl6_src, &treq->loc_addr);
-	fl.fl6_flowlabel = 0;
-	fl.oif = treq->iif;
-	fl.fl_ip_dport = inet_rsk(req)->rmt_port;
-	fl.fl_ip_sport = inet_rsk(req)->loc_port;
-	security_req_classify_flow(req, &fl);
+	memset(fl, 0, sizeof(*fl));
+	fl->proto = IPPROTO_TCP;
+	ipv6_addr_copy(&fl->fl6_dst, &treq->rmt_addr);
+	ipv6_addr_copy(&fl->fl6_src, &treq->loc_addr);
+	fl->fl6_flowlabel = 0;
+	fl->oif = treq->iif;
+	fl->fl_ip_dport = inet_rsk(req)->rmt_port;
+	fl->fl_ip_sport = inet_rsk(req)->loc_port;
+	security_req_classify_flow(req, fl);
 
-	opt = np->opt;
 	if (opt && opt->srcrt) {
 		struct rt0_hdr *rt0 = (struct rt0_hdr *) opt->srcrt;
-		ipv6_addr_copy(&final, &fl.fl6_dst);
-		ipv6_addr_copy(&fl.fl6_dst, rt0->addr);
+		ipv6_addr_copy(&final, &fl->fl6_dst);
+		ipv6_addr_copy(&fl->fl6_dst, rt0->addr);
 		final_p = &final;
 	}
 
-	err = ip6_dst_lookup(sk, &dst, &fl);
-	if (err)
-		goto done;
+	if (ip6_dst_lookup(sk, &dst, fl))
+		return NULL;
 	if (final_p)
-		ipv6_addr_copy(&fl.fl6_dst, final_p);
-	if ((err = xfrm_lookup(&dst, &fl, sk, 0)) < 0)
+		ipv6_addr_copy(&fl->fl6_dst, final_p);
+	if (xfrm_lookup(&dst, fl, sk, 0) < 0)
+		return NULL;
+	return dst;
+}
+
+static int __tcp_v6_send_synack(struct sock *sk, struct request_sock *req,
+				struct tcp_fastopen_cookie *foc)
+{
+	struct inet6_request_sock *treq = inet6_rsk(req);
+	struct ipv6_pinfo *np = inet6_sk(sk);
+	struct sk_buff * skb;
+	struct ipv6_txoptions *opt = np->opt;
+	struct flowi fl;
+	struct dst_entry *dst;
+	int err = -1;
+
+	dst = tcp_v6_route_req(sk, req, &fl);
+	if (dst == NULL)
 		goto done;
 
-	skb = tcp_make_synack(sk, dst, req);
+	skb = tcp_make_synack(sk, dst, req, foc);
 	if (skb) {
 		struct tcphdr *th = tcp_hdr(skb);
 
@@ -515,6 +529,11 @@ done:
 	return err;
 }
 
+static int tcp_v6_send_synack(struct sock *sk, struct request_sock *req)
+{
+	return __tcp_v6_send_synack(sk, req, NULL);
+}
+
 static inline void syn_flood_warning(struct sk_buff *skb)
 {
 #ifdef CONFIG_SYN_COOKIES
@@ -942,6 +961,40 @@ static int tcp_v6_gso_send_check(struct sk_buff *skb)
 	return 0;
 }
 
+static struct sk_buff **tcp6_gro_receive(struct sk_buff **head,
+					 struct sk_buff *skb)
+{
+	struct ipv6hdr *iph = ipv6_hdr(skb);
+
+	switch (skb->ip_summed) {
+	case CHECKSUM_COMPLETE:
+		if (!tcp_v6_check(tcp_hdr(skb), skb->len, &iph->saddr,
+				  &iph->daddr, skb->csum)) {
+			skb->ip_summed = CHECKSUM_UNNECESSARY;
+			break;
+		}
+
+		/* fall through */
+	case CHECKSUM_NONE:
+		NAPI_GRO_CB(skb)->flush = 1;
+		return NULL;
+	}
+
+	return tcp_gro_receive(head, skb);
+}
+
+static int tcp6_gro_complete(struct sk_buff *skb)
+{
+	struct ipv6hdr *iph = ipv6_hdr(skb);
+	struct tcphdr *th = tcp_hdr(skb);
+
+	th->check = ~tcp_v6_check(th, skb->len - skb_transport_offset(skb),
+				  &iph->saddr, &iph->daddr, 0);
+	skb_shinfo(skb)->gso_type = SKB_GSO_TCPV6;
+
+	return tcp_gro_complete(skb);
+}
+
 static void tcp_v6_send_response(struct sk_buff *skb, u32 seq, u32 ack, u32 win,
 				 u32 ts, struct tcp_md5sig_key *key, int rst)
 {
@@ -1125,9 +1178,12 @@ static int tcp_v6_conn_request(struct sock *sk, struct sk_buff *skb)
 	struct inet6_request_sock *treq;
 	struct ipv6_pinfo *np = inet6_sk(sk);
 	struct tcp_options_received tmp_opt;
+	struct tcp_fastopen_cookie foc = { .len = -1 };
 	struct tcp_sock *tp = tcp_sk(sk);
 	struct request_sock *req = NULL;
 	__u32 isn = TCP_SKB_CB(skb)->when;
+	spinlock_t *lock;
+	int fastopen, err;
 #ifdef CONFIG_SYN_COOKIES
 	int want_cookie = 0;
 #else
@@ -1166,7 +1222,7 @@ static int tcp_v6_conn_request(struct sock *sk, struct sk_buff *skb)
 	tmp_opt.mss_clamp = IPV6_MIN_MTU - sizeof(struct tcphdr) - sizeof(struct ipv6hdr);
 	tmp_opt.user_mss = tp->rx_opt.user_mss;
 
-	tcp_parse_options(skb, &tmp_opt, 0);
+	tcp_parse_options(skb, &tmp_opt, 0, want_cookie ? NULL : &foc);
 
 	if (want_cookie && !tmp_opt.saw_tstamp)
 		tcp_clear_options(&tmp_opt);
@@ -1180,6 +1236,8 @@ static int tcp_v6_conn_request(struct sock *sk, struct sk_buff *skb)
 	if (!want_cookie)
 		TCP_ECN_create_request(req, tcp_hdr(skb));
 
+	fastopen = !want_cookie && tcp_fastopen_check(sk, skb, req, &foc);
+
 	if (want_cookie) {
 		isn = cookie_v6_init_sequence(sk, skb, &req->mss);
 		req->cookie_ts = tmp_opt.tstamp_ok;
@@ -1204,13 +1262,34 @@ static int tcp_v6_conn_request(struct sock *sk, struct sk_buff *skb)
 
 	security_inet_conn_request(sk, skb, req);
 
-	if (tcp_v6_send_synack(sk, req))
+	/* The child comes before the SYN-ACK, see tcp_v4_conn_request() */
+	if (fastopen) {
+		struct dst_entry *dst;
+		struct flowi fl;
+
+		dst = tcp_v6_route_req(sk, req, &fl);
+		if (dst == NULL)
+			goto drop;
+		err = tcp_fastopen_create_child(sk, skb, req, dst);
+		dst_release(dst);
+		if (!err) {
+			__tcp_v6_send_synack(sk, req, &foc);
+			return 0;
+		}
+		tcp_rsk(req)->rcv_nxt = tcp_rsk(req)->rcv_isn + 1;
+	}
+
+	if (want_cookie) {
+		__tcp_v6_send_synack(sk, req, &foc);
 		goto drop;
+	}
 
-	if (!want_cookie) {
-		inet6_csk_reqsk_queue_hash_add(sk, req, TCP_TIMEOUT_INIT);
+	/* Queued before the SYN-ACK, see inet_csk_reqsk_queue_hash_lock() */
+	lock = inet6_csk_reqsk_queue_hash_lock(sk, req, TCP_TIMEOUT_INIT);
+	err = __tcp_v6_send_synack(sk, req, &foc);
+	inet_csk_reqsk_queue_hash_unlock(sk, req, lock, err);
+	if (!err)
 		return 0;
-	}
 
 drop:
 	if (req)
@@ -1446,6 +1525,28 @@ static __sum16 tcp_v6_checksum_init(struct sk_buff *skb)
 	return 0;
 }
 
+/* A SYN to a listener needs no listener lock, see tcp_v4_rcv_syn() */
+static int tcp_v6_rcv_syn(struct sock *sk, struct sk_buff *skb)
+{
+	const struct tcphdr *th = tcp_hdr(skb);
+	int handled = 0;
+
+	rcu_read_lock();
+	if (tcp_syn_lockless(sk, skb) &&
+	    !inet6_csk_reqsk_queued(sk, th->source, &ipv6_hdr(skb)->saddr,
+				    &ipv6_hdr(skb)->daddr, inet6_iif(skb))) {
+		if (tcp_checksum_complete(skb))
+			TCP_INC_STATS_BH(sock_net(sk), TCP_MIB_INERRS);
+		else if (tcp_v6_conn_request(sk, skb) < 0)
+			tcp_v6_send_reset(sk, skb);
+		kfree_skb(skb);
+		handled = 1;
+	}
+	rcu_read_unlock();
+
+	return handled;
+}
+
 /* The socket must have it's spinlock held when we get
  * here.
  *
@@ -1501,6 +1602,7 @@ static int tcp_v6_do_rcv(struct sock *sk, struct sk_buff *skb)
 		opt_skb = skb_clone(skb, GFP_ATOMIC);
 
 	if (sk->sk_state == TCP_ESTABLISHED) { /* Fast path */
+		sock_rps_save_rxhash(sk, skb->rxhash);
 		TCP_CHECK_TIMER(sk);
 		if (tcp_rcv_established(sk, skb, tcp_hdr(skb), skb->len))
 			goto reset;
@@ -1634,6 +1736,11 @@ process:
 
 	skb->dev = NULL;
 
+	if (tcp_v6_rcv_syn(sk, skb)) {
+		sock_put(sk);
+		return 0;
+	}
+
 	bh_lock_sock_nested(sk);
 	ret = 0;
 	if (!sock_owned_by_user(sk)) {
@@ -1698,6 +1805,7 @@ do_time_wait:
 		struct sock *sk2;
 
 		sk2 = inet6_lookup_listener(dev_net(skb->dev), &tcp_hashinfo,
+					    &ipv6_hdr(skb)->saddr, th->source,
 					    &ipv6_hdr(skb)->daddr,
 					    ntohs(th->dest), inet6_iif(skb));
 		if (sk2 != NULL) {
@@ -2045,6 +2153,7 @@ struct proto tcpv6_prot = {
 	.sysctl_rmem		= sysctl_tcp_rmem,
 	.max_header		= MAX_TCP_HEADER,
 	.obj_size		= sizeof(struct tcp6_sock),
+	.slab_flags		= SLAB_DESTROY_BY_RCU,
 	.twsk_prot		= &tcp6_timewait_sock_ops,
 	.rsk_prot		= &tcp6_request_sock_ops,
 	.h.hashinfo		= &tcp_hashinfo,
@@ -2059,6 +2168,8 @@ static struct inet6_protocol tcpv6_protocol = {
 	.err_handler	=	tcp_v6_err,
 	.gso_send_check	=	tcp_v6_gso_send_check,
 	.gso_segment	=	tcp_tso_segment,
+	.gro_receive	=	tcp6_gro_receive,
+	.gro_complete	=	tcp6_gro_complete,
 	.flags		=	INET6_PROTO_NOPOLICY|INET6_PROTO_FINAL,
 };
 
@@ -0,0 +1,379 @@
+/*
+ * Name-oriented sockets (AF_NAME)
+ *
+ * An AF_NAME socket is addressed by a host name and port instead of by a
+ * network address.  The kernel resolves the name and carries the data
+ * over an ordinary TCP or UDP socket of the matching address family.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/completion.h>
+#include <linux/in.h>
+#include <linux/in6.h>
+#include <linux/inet.h>
+#include <linux/slab.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include <net/sock.h>
+
+#include "af_name.h"
+
+int name_net_id;
+
+/*
+ * Check a socket address passed in by the user: it has to be an AF_NAME
+ * address whose name is a non-empty, NUL-terminated string.
+ */
+int name_check_sockaddr(const struct sockaddr_name *sname, int len)
+{
+	int maxlen;
+
+	if (len < offsetof(struct sockaddr_name, sname_addr) + 2)
+		return -EINVAL;
+	if (sname->sname_family != AF_NAME)
+		return -EAFNOSUPPORT;
+
+	maxlen = min_t(int, len - offsetof(struct sockaddr_name, sname_addr),
+		       sizeof(sname->sname_addr.name));
+	if (strnlen(sname->sname_addr.name, maxlen) == maxlen)
+		return -EINVAL;
+	if (sname->sname_addr.name[0] == '\0')
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * A name that is an IPv4 or IPv6 address literal resolves to itself.
+ * Returns 0 and fills in @rr if @name is such a literal.
+ */
+int name_parse_literal(const char *name, struct name_rr *rr)
+{
+	int len = strlen(name);
+	const char *end;
+
+	if (in4_pton(name, len, (u8 *)&rr->addr.a4, -1, &end) &&
+	    end == name + len) {
+		rr->family = AF_INET;
+		rr->weight = 1;
+		return 0;
+	}
+	if (in6_pton(name, len, rr->addr.a6.s6_addr, -1, &end) &&
+	    end == name + len) {
+		rr->family = AF_INET6;
+		rr->weight = 1;
+		return 0;
+	}
+	return -EINVAL;
+}
+
+/*
+ * Build the transport address for @rr and @port.  Returns its length.
+ */
+int name_rr_to_sockaddr(const struct name_rr *rr, __be16 port,
+			struct sockaddr_storage *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+
+	if (rr->family == AF_INET) {
+		struct sockaddr_in *sin = (struct sockaddr_in *)addr;
+
+		sin->sin_family = AF_INET;
+		sin->sin_port = port;
+		sin->sin_addr.s_addr = rr->addr.a4;
+		return sizeof(*sin);
+	} else {
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)addr;
+
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port = port;
+		sin6->sin6_addr = rr->addr.a6;
+		return sizeof(*sin6);
+	}
+}
+
+/**
+ * name_resolve - resolve a name to addresses
+ * @net: network namespace to resolve in
+ * @name: NUL-terminated name
+ * @rr: where to store the addresses
+ * @max: room in @rr
+ * @req: request to queue if the name has to be looked up
+ *
+ * Returns the number of addresses stored in @rr if @name is an address
+ * literal or cached, or the cached error if it recently failed to
+ * resolve.  Otherwise @req is queued to the resolver and 0 is returned,
+ * or a negative error if the name cannot be looked up.
+ */
+int name_resolve(struct net *net, const char *name, struct name_rr *rr,
+		 int max, struct name_resolve_req *req)
+{
+	int n;
+
+	if (!name_parse_literal(name, rr))
+		return 1;
+
+	n = name_cache_get(net, name, rr, max);
+	if (n != -ENOENT)
+		return n;
+
+	return name_resolver_query(net, name, req);
+}
+
+struct name_resolve_wait {
+	struct name_resolve_req	req;
+	struct completion	done;
+	struct name_rr		*rr;
+	int			max;
+	int			err;
+};
+
+static void name_resolve_wait_done(struct name_resolve_req *req, int err,
+				   const struct name_rr *addrs, int naddrs)
+{
+	struct name_resolve_wait *w;
+
+	w = container_of(req, struct name_resolve_wait, req);
+	if (!err) {
+		err = min(naddrs, w->max);
+		memcpy(w->rr, addrs, err * sizeof(*addrs));
+	}
+	w->err = err;
+	complete(&w->done);
+}
+
+/**
+ * name_resolve_wait - resolve a name to addresses, sleeping if need be
+ * @net: network namespace to resolve in
+ * @name: NUL-terminated name
+ * @rr: where to store the addresses
+ * @max: room in @rr
+ *
+ * Like name_resolve(), but waits for the resolver instead of queueing a
+ * request.  Returns the number of addresses stored in @rr or a negative
+ * error, -EINTR if the caller was killed while waiting.
+ */
+int name_resolve_wait(struct net *net, const char *name, struct name_rr *rr,
+		      int max)
+{
+	struct name_resolve_wait w;
+	int n;
+
+	init_completion(&w.done);
+	w.req.done = name_resolve_wait_done;
+	w.rr = rr;
+	w.max = max;
+
+	n = name_resolve(net, name, rr, max, &w.req);
+	if (n)
+		return n;
+
+	if (wait_for_completion_killable(&w.done)) {
+		if (name_resolver_cancel(&w.req))
+			return -EINTR;
+		/* Too late, the resolver is completing it */
+		wait_for_completion(&w.done);
+	}
+	return w.err;
+}
+
+/**
+ * name_resolve_nowait - resolve a name to addresses without sleeping
+ * @net: network namespace to resolve in
+ * @name: NUL-terminated name
+ * @rr: where to store the addresses
+ * @max: room in @rr
+ *
+ * Like name_resolve(), but returns -EAGAIN when @name has to be looked
+ * up.  The lookup goes on in the background and its answer is cached for
+ * a later call to find.  Calls made while it goes on share it and add
+ * nothing to it.
+ */
+int name_resolve_nowait(struct net *net, const char *name, struct name_rr *rr,
+			int max)
+{
+	int n;
+
+	if (!name_parse_literal(name, rr))
+		return 1;
+
+	n = name_cache_get(net, name, rr, max);
+	if (n != -ENOENT)
+		return n;
+
+	n = name_resolver_query(net, name, NULL);
+	return n ? n : -EAGAIN;
+}
+
+static int name_create(struct net *net, struct socket *sock, int protocol)
+{
+	const struct proto_ops *ops;
+	struct proto *prot;
+	struct sock *sk;
+
+	switch (sock->type) {
+	case SOCK_STREAM:
+		if (protocol && protocol != IPPROTO_TCP)
+			return -EPROTONOSUPPORT;
+		protocol = IPPROTO_TCP;
+		prot = &name_stream_proto;
+		ops = &name_stream_ops;
+		break;
+	case SOCK_DGRAM:
+		if (protocol && protocol != IPPROTO_UDP)
+			return -EPROTONOSUPPORT;
+		protocol = IPPROTO_UDP;
+		prot = &name_dgram_proto;
+		ops = &name_dgram_ops;
+		break;
+	default:
+		return -ESOCKTNOSUPPORT;
+	}
+
+	sock->state = SS_UNCONNECTED;
+
+	sk = sk_alloc(net, PF_NAME, GFP_KERNEL, prot);
+	if (!sk)
+		return -ENOMEM;
+
+	sock_init_data(sock, sk);
+	sock->ops = ops;
+	sk->sk_protocol = protocol;
+
+	if (sk->sk_prot->init)
+		sk->sk_prot->init(sk);
+	return 0;
+}
+
+static struct net_proto_family name_family_ops = {
+	.family = PF_NAME,
+	.create = name_create,
+	.owner	= THIS_MODULE,
+};
+
+static int name_net_init(struct net *net)
+{
+	struct name_net *nn;
+	int err;
+
+	err = -ENOMEM;
+	nn = kzalloc(sizeof(*nn), GFP_KERNEL);
+	if (!nn)
+		goto err_alloc;
+	nn->net = net;
+	nn->sysctl_connect_stagger = NAME_CONNECT_STAGGER;
+	nn->sysctl_negative_ttl = NAME_CACHE_NEGATIVE_TTL;
+	nn->sysctl_stale_ttl = NAME_CACHE_STALE_TTL;
+	nn->sysctl_pool_idle_ttl = NAME_POOL_IDLE_TTL;
+	name_policy_init(nn);
+	name_pool_init(nn);
+
+	err = net_assign_generic(net, name_net_id, nn);
+	if (err < 0)
+		goto err_assign;
+
+	err = name_cache_init(nn);
+	if (err < 0)
+		goto err_cache;
+
+	err = name_diag_init(nn);
+	if (err < 0)
+		goto err_diag;
+
+	err = name_sysctl_register(nn);
+	if (err < 0)
+		goto err_sysctl;
+
+	return 0;
+
+err_sysctl:
+	name_diag_exit(nn);
+err_diag:
+	name_cache_exit(nn);
+err_cache:
+	net_assign_generic(net, name_net_id, NULL);
+err_assign:
+	kfree(nn);
+err_alloc:
+	return err;
+}
+
+static void name_net_exit(struct net *net)
+{
+	struct name_net *nn = name_pernet(net);
+
+	name_sysctl_unregister(nn);
+	name_pool_exit(nn);
+	name_diag_exit(nn);
+	name_cache_exit(nn);
+	kfree(nn);
+}
+
+static struct pernet_operations name_net_ops = {
+	.init = name_net_init,
+	.exit = name_net_exit,
+};
+
+static int __init af_name_init(void)
+{
+	int err;
+
+	BUILD_BUG_ON(sizeof(struct sockaddr_name) >
+		     sizeof(struct sockaddr_storage));
+
+	err = proto_register(&name_stream_proto, 1);
+	if (err)
+		goto out;
+
+	err = proto_register(&name_dgram_proto, 1);
+	if (err)
+		goto out_stream;
+
+	err = register_pernet_gen_subsys(&name_net_id, &name_net_ops);
+	if (err)
+		goto out_proto;
+
+	err = name_resolver_init();
+	if (err)
+		goto out_pernet;
+
+	err = sock_register(&name_family_ops);
+	if (err)
+		goto out_resolver;
+
+	return 0;
+
+out_resolver:
+	name_resolver_exit();
+out_pernet:
+	unregister_pernet_gen_subsys(name_net_id, &name_net_ops);
+out_proto:
+	proto_unregister(&name_dgram_proto);
+out_stream:
+	proto_unregister(&name_stream_proto);
+out:
+	printk(KERN_CRIT "%s: Cannot register AF_NAME family\n", __func__);
+	return err;
+}
+
+static void __exit af_name_exit(void)
+{
+	sock_unregister(PF_NAME);
+	name_resolver_exit();
+	unregister_pernet_gen_subsys(name_net_id, &name_net_ops);
+	proto_unregister(&name_dgram_proto);
+	proto_unregister(&name_stream_proto);
+}
+
+module_init(af_name_init);
+module_exit(af_name_exit);
+
+MODULE_DESCRIPTION("Name-oriented sockets (AF_NAME)");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_NETPROTO(PF_NAME);
@@ -0,0 +1,488 @@
+/*
+ * Name-oriented sockets: definitions shared by the AF_NAME core
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#ifndef _NET_NAME_AF_NAME_H
+#define _NET_NAME_AF_NAME_H
+
+#include <linux/in6.h>
+#include <linux/inname.h>
+#include <linux/ktime.h>
+#include <linux/name_diag.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/net.h>
+#include <linux/rcupdate.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <net/ipv6.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include <net/sock.h>
+
+struct ctl_table_header;
+struct request_sock;
+struct seq_file;
+
+/*
+ * One address a name resolves to.
+ */
+struct name_rr {
+	unsigned short		family;		/* AF_INET or AF_INET6 */
+	unsigned short		weight;		/* for NAME_POLICY_WEIGHTED */
+	union {
+		__be32		a4;
+		struct in6_addr	a6;
+	} addr;
+};
+
+static inline int name_rr_equal(const struct name_rr *a,
+				const struct name_rr *b)
+{
+	if (a->family != b->family)
+		return 0;
+	if (a->family == AF_INET)
+		return a->addr.a4 == b->addr.a4;
+	return ipv6_addr_equal(&a->addr.a6, &b->addr.a6);
+}
+
+/*
+ * Most addresses of a name that are kept.
+ */
+#define NAME_RESOLVE_MAX_ADDRS	16
+
+/*
+ * A request for a name that could not be resolved immediately.  @done is
+ * called in process context with the addresses the name resolved to, or
+ * with a negative error.
+ */
+struct name_resolve_req {
+	struct list_head	list;
+	void			(*done)(struct name_resolve_req *req, int err,
+					const struct name_rr *addrs,
+					int naddrs);
+};
+
+/*
+ * Name cache.  Entries are looked up under rcu_read_lock() and replaced,
+ * never modified but for their flags, by writers holding the cache lock.
+ * Negative entries have no addresses and the error to fail lookups with.
+ */
+#define NAME_CACHE_HASH_BITS	8
+#define NAME_CACHE_HASH_SIZE	(1 << NAME_CACHE_HASH_BITS)
+#define NAME_CACHE_MAX_ENTRIES	4096
+#define NAME_CACHE_MAX_TTL	(24 * 60 * 60)	/* seconds */
+#define NAME_CACHE_GC_INTERVAL	(30 * HZ)
+#define NAME_CACHE_NEGATIVE_TTL	(10 * HZ)	/* sysctl defaults */
+#define NAME_CACHE_STALE_TTL	(60 * HZ)
+
+/* name_cache_entry flags */
+#define NAME_CACHE_REFRESHING	0	/* a refresh has been started */
+
+struct name_cache_entry {
+	struct hlist_node	hlist;
+	struct rcu_head		rcu;
+	unsigned long		expires;	/* jiffies */
+	unsigned long		flags;
+	int			error;		/* of a negative entry */
+	u32			hash;
+	unsigned int		namelen;
+	char			*name;
+	unsigned int		naddrs;
+	struct name_rr		addrs[0];
+};
+
+struct name_cache_stats {
+	unsigned long		hits;
+	unsigned long		misses;
+	unsigned long		expired;
+	unsigned long		stale;		/* served while refreshing */
+	unsigned long		negative;
+};
+
+struct name_cache {
+	struct hlist_head	hash[NAME_CACHE_HASH_SIZE];
+	spinlock_t		lock;
+	unsigned int		count;
+	struct name_cache_stats	*stats;		/* per cpu */
+	struct delayed_work	gc_work;
+};
+
+/*
+ * Outstanding connections to one address, counted by the references the
+ * transports connecting or connected to it hold.  Entries are looked up
+ * under rcu_read_lock() and go when the last transport puts them.
+ */
+#define NAME_LOAD_HASH_BITS	6
+#define NAME_LOAD_HASH_SIZE	(1 << NAME_LOAD_HASH_BITS)
+
+struct name_load {
+	struct hlist_node	hlist;
+	struct rcu_head		rcu;
+	struct name_net		*nn;
+	atomic_t		refcnt;
+	struct name_rr		rr;
+};
+
+/* Round robin positions, shared by the names that hash to the same slot */
+#define NAME_POLICY_RR_SLOTS	64
+
+/*
+ * Connect latency histograms of a name, in log2 microsecond buckets.
+ * Entries are added under the histogram lock, looked up under
+ * rcu_read_lock() and stay until the namespace goes, so that sockets can
+ * keep pointers to them.
+ */
+#define NAME_HIST_HASH_BITS	6
+#define NAME_HIST_HASH_SIZE	(1 << NAME_HIST_HASH_BITS)
+#define NAME_HIST_MAX_ENTRIES	1024
+
+struct name_hist {
+	struct hlist_node	hlist;
+	u32			hash;
+	atomic_t		buckets[NAME_DIAG_PHASES][NAME_DIAG_HIST_BUCKETS];
+	unsigned int		namelen;
+	char			name[0];
+};
+
+/*
+ * Pools of idle connections, see pool.c.
+ */
+#define NAME_POOL_MAX		64	/* connections per pool */
+#define NAME_POOL_MAX_POOLS	256	/* pools per namespace */
+#define NAME_POOL_INTERVAL	HZ	/* of the sweep */
+#define NAME_POOL_IDLE_TTL	(60 * HZ)
+
+/*
+ * Per network namespace state.
+ */
+struct name_net {
+	struct net		*net;
+	struct name_cache	cache;
+
+	/* load spreading */
+	spinlock_t		load_lock;
+	struct hlist_head	load_hash[NAME_LOAD_HASH_SIZE];
+	atomic_t		rr_next[NAME_POLICY_RR_SLOTS];
+
+	/* monitoring */
+	rwlock_t		sklist_lock;
+	struct hlist_head	sklist;
+	struct sock		*diag_nl;
+	spinlock_t		hist_lock;
+	unsigned int		hist_count;
+	struct hlist_head	hist_hash[NAME_HIST_HASH_SIZE];
+
+	/* connection pools */
+	struct mutex		pool_mutex;
+	struct list_head	pools;
+	unsigned int		npools;
+	unsigned long		pool_hits;
+	unsigned long		pool_misses;
+	struct work_struct	pool_fill_work;
+	struct delayed_work	pool_sweep_work;
+
+	/* sysctls */
+	int			sysctl_connect_stagger;	/* jiffies */
+	int			sysctl_negative_ttl;	/* jiffies */
+	int			sysctl_stale_ttl;	/* jiffies */
+	int			sysctl_pool_size;
+	int			sysctl_pool_idle_ttl;	/* jiffies */
+	struct ctl_table_header	*ctl;
+};
+
+/*
+ * Default delay between the connection attempts to successive addresses
+ * of a name (RFC 6555 suggests 150 to 250 ms).
+ */
+#define NAME_CONNECT_STAGGER	(HZ / 4)
+
+extern int name_net_id;
+
+static inline struct name_net *name_pernet(struct net *net)
+{
+	return net_generic(net, name_net_id);
+}
+
+/*
+ * A kernel socket carrying the data of an AF_NAME socket.  Its callbacks
+ * are redirected so that wakeups and errors are reported on the owning
+ * AF_NAME socket, after the owner's name_transport_ops have had a look
+ * at them.  The socket is released when the last reference is put, which
+ * must happen in process context.
+ */
+struct name_transport;
+
+struct name_transport_ops {
+	/* all called in softirq context, before the owner is woken */
+	void			(*state_change)(struct name_transport *nt);
+	void			(*data_ready)(struct name_transport *nt);
+	void			(*write_space)(struct name_transport *nt);
+};
+
+struct name_transport {
+	struct socket		*sock;
+	struct sock		*owner;		/* NULL once detached */
+	atomic_t		refcnt;
+	struct list_head	list;		/* owner's use */
+	struct name_load	*load;		/* owner's use, put on free */
+	const struct name_transport_ops *ops;
+
+	/* callbacks of @sock saved while it is attached */
+	void			(*saved_state_change)(struct sock *sk);
+	void			(*saved_data_ready)(struct sock *sk, int bytes);
+	void			(*saved_write_space)(struct sock *sk);
+};
+
+static inline void name_transport_hold(struct name_transport *nt)
+{
+	atomic_inc(&nt->refcnt);
+}
+
+extern void name_transport_free(struct name_transport *nt);
+
+static inline void name_transport_put(struct name_transport *nt)
+{
+	if (atomic_dec_and_test(&nt->refcnt))
+		name_transport_free(nt);
+}
+
+/*
+ * Connections accepted by the listening transports of an AF_NAME socket
+ * are moved to a queue of the CPU they arrived on, linked through their
+ * request socks, so that accept() on many CPUs does not contend on the
+ * socket lock of one listener.
+ */
+struct name_accept_queue {
+	spinlock_t		lock;
+	struct request_sock	*head;
+	struct request_sock	*tail;
+	int			qlen;
+};
+
+/*
+ * AF_NAME stream socket.  @transport is the TCP socket it is connected
+ * over; it is protected by sk_callback_lock, and users outside the socket
+ * lock take a reference with name_stream_transport().
+ *
+ * While connecting, the addresses of the name are tried in turn, a new
+ * attempt starting whenever the previous one failed or has not completed
+ * within the connect stagger.  The attempts still in progress are kept on
+ * @attempts, also under sk_callback_lock; the first to establish becomes
+ * @transport and the others are closed.
+ *
+ * A mobile connection whose transport fails with an error goes back to
+ * SYN_SENT and connects to what its name resolves to now.  The failed
+ * transport is kept as @stale, under sk_callback_lock, until the data it
+ * had not had acknowledged has been replayed on the new one and the
+ * application has read the data it had received.  The replay does not
+ * block: it goes on whenever the new transport has write space again,
+ * @replayed bytes into the data, and is done without the socket locked,
+ * by one worker at a time.
+ */
+struct name_stream_sock {
+	/* struct sock has to be the first member of name_stream_sock */
+	struct sock		sk;
+	struct name_addr	dname;		/* peer name */
+	__be16			dport;		/* peer port */
+	struct name_transport	*transport;
+	struct name_resolve_req	resolve;
+
+	/* connection race */
+	struct name_rr		addrs[NAME_RESOLVE_MAX_ADDRS];
+	int			naddrs;
+	int			next;		/* next of @addrs to try */
+	int			attempt_err;	/* of the last failed attempt */
+	struct list_head	attempts;
+	struct work_struct	race_work;
+	struct delayed_work	stagger_work;
+
+	/* mobility */
+	int			mobile;		/* NAME_MOBILITY */
+	int			policy;		/* NAME_POLICY */
+	int			pool;		/* NAME_POOL, -1 for the sysctl */
+	struct name_transport	*stale;		/* transport moved away from */
+	struct work_struct	migrate_work;
+	u32			replayed;	/* bytes of @stale's data resent */
+	int			replaying;	/* a worker is resending */
+	int			replay_again;	/* space came meanwhile */
+
+	/* connect phase timings, see name_diag_phase_done() */
+	ktime_t			phase_start;
+	unsigned int		phases;		/* completed, 1 << NAME_DIAG_* */
+	u32			phase_us[NAME_DIAG_PHASES];
+	struct name_hist	*hist;
+
+	/* bound and listening sockets */
+	struct name_addr	sname;		/* local name */
+	__be16			sport;		/* local port */
+	struct list_head	listeners;	/* transports bound to sname */
+	struct name_accept_queue *accept_queues;	/* per cpu */
+};
+
+static inline struct name_stream_sock *name_stream_sk(const struct sock *sk)
+{
+	return (struct name_stream_sock *)sk;
+}
+
+/*
+ * AF_NAME datagram socket.  It receives on an unconnected UDP transport
+ * per address family, bound to the same port, and sends on a transport
+ * connected to the last destination, which saves the name and route
+ * lookups of further datagrams to it.  @transports is protected by
+ * sk_callback_lock; the other fields by the socket lock.
+ */
+enum {
+	NAME_DGRAM_INET,
+	NAME_DGRAM_INET6,
+	NAME_DGRAM_DEST,
+	NAME_DGRAM_MAX,
+};
+
+struct name_dgram_sock {
+	/* struct sock has to be the first member of name_dgram_sock */
+	struct sock		sk;
+	struct name_transport	*transports[NAME_DGRAM_MAX];
+	__be16			sport;		/* local port */
+	int			bound;
+	int			connected;
+
+	/* destination of the NAME_DGRAM_DEST transport */
+	struct name_addr	dname;
+	__be16			dport;
+	struct name_rr		daddr;
+	unsigned long		expires;	/* look dname up again after */
+};
+
+static inline struct name_dgram_sock *name_dgram_sk(const struct sock *sk)
+{
+	return (struct name_dgram_sock *)sk;
+}
+
+/*
+ * af_name.c
+ */
+extern int name_check_sockaddr(const struct sockaddr_name *sname, int len);
+extern int name_parse_literal(const char *name, struct name_rr *rr);
+extern int name_rr_to_sockaddr(const struct name_rr *rr, __be16 port,
+			       struct sockaddr_storage *addr);
+extern int name_resolve(struct net *net, const char *name,
+			struct name_rr *rr, int max,
+			struct name_resolve_req *req);
+extern int name_resolve_wait(struct net *net, const char *name,
+			     struct name_rr *rr, int max);
+extern int name_resolve_nowait(struct net *net, const char *name,
+			       struct name_rr *rr, int max);
+
+/*
+ * cache.c
+ */
+extern u32 name_hash(const char *name, unsigned int len);
+extern int name_cache_init(struct name_net *nn);
+extern void name_cache_exit(struct name_net *nn);
+extern int name_cache_get(struct net *net, const char *name,
+			  struct name_rr *rr, int max);
+extern int name_cache_insert(struct net *net, const char *name,
+			     const struct name_rr *addrs, unsigned int naddrs,
+			     unsigned int ttl);
+extern int name_cache_insert_negative(struct net *net, const char *name,
+				      int error);
+extern void name_cache_remove(struct net *net, const char *name);
+extern void name_cache_flush(struct name_net *nn);
+
+/*
+ * diag.c
+ */
+extern void name_diag_link(struct sock *sk);
+extern void name_diag_unlink(struct sock *sk);
+extern void name_diag_connect_start(struct sock *sk);
+extern void name_diag_phase_done(struct name_stream_sock *name, int phase);
+extern int name_diag_init(struct name_net *nn);
+extern void name_diag_exit(struct name_net *nn);
+
+/*
+ * dgram.c
+ */
+extern struct proto name_dgram_proto;
+extern const struct proto_ops name_dgram_ops;
+
+/*
+ * listen.c
+ */
+extern int name_stream_bind(struct socket *sock, struct sockaddr *uaddr,
+			    int addr_len);
+extern int name_stream_listen(struct socket *sock, int backlog);
+extern int name_stream_accept(struct socket *sock, struct socket *newsock,
+			      int flags);
+extern unsigned int name_listen_poll(struct sock *sk);
+extern void name_listen_release(struct sock *sk);
+
+/*
+ * policy.c
+ */
+extern void name_policy_init(struct name_net *nn);
+extern void name_policy_order(struct net *net, int policy, const char *name,
+			      struct name_rr *rr, int n);
+extern struct name_load *name_load_get(struct net *net,
+				       const struct name_rr *rr);
+extern void name_load_put(struct name_load *load);
+
+/*
+ * pool.c
+ */
+extern struct socket *name_pool_get(struct net *net, const char *name,
+				    __be16 port, unsigned int size);
+extern void name_pool_seq_show(struct seq_file *seq, struct name_net *nn);
+extern void name_pool_init(struct name_net *nn);
+extern void name_pool_exit(struct name_net *nn);
+
+/*
+ * resolver.c
+ */
+extern int name_resolver_query(struct net *net, const char *name,
+			       struct name_resolve_req *req);
+extern int name_resolver_cancel(struct name_resolve_req *req);
+extern void name_resolver_seq_show(struct seq_file *seq);
+extern int name_resolver_init(void);
+extern void name_resolver_exit(void);
+
+/*
+ * transport.c
+ */
+extern int name_transport_attach(struct sock *owner, struct socket *sock,
+				 const struct name_transport_ops *ops,
+				 struct name_transport **ntp);
+extern int name_transport_create(struct sock *owner, int family, int type,
+				 int protocol,
+				 const struct name_transport_ops *ops,
+				 struct name_transport **ntp);
+extern void name_transport_detach(struct name_transport *nt);
+extern void name_transport_unclone(struct name_transport *nt,
+				   struct sock *child);
+extern int name_transport_replay(struct name_transport *from,
+				 struct name_transport *to, u32 *off);
+
+/*
+ * stream.c
+ */
+extern struct proto name_stream_proto;
+extern const struct proto_ops name_stream_ops;
+extern const struct name_transport_ops name_stream_transport_ops;
+
+/*
+ * sysctl_net_name.c
+ */
+#ifdef CONFIG_SYSCTL
+extern int name_sysctl_register(struct name_net *nn);
+extern void name_sysctl_unregister(struct name_net *nn);
+#else
+static inline int name_sysctl_register(struct name_net *nn) { return 0; }
+static inline void name_sysctl_unregister(struct name_net *nn) {}
+#endif
+
+#endif /* _NET_NAME_AF_NAME_H */
@@ -0,0 +1,488 @@
+/*
+ * Name-oriented sockets: name to address cache
+ *
+ * Each network namespace caches the addresses its names resolved to for
+ * as long as their TTL allows, and the failure of names that did not
+ * resolve for net.name.negative_ttl.  Expired addresses keep being served
+ * for net.name.stale_ttl while the name is looked up again in the
+ * background.  Lookups run under RCU and only touch per-cpu statistics,
+ * so a popular name can be resolved on all CPUs at once without sharing
+ * a lock or a cache line.  Writers serialise on the cache lock and
+ * replace entries as a whole.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/ctype.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+#include <linux/random.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <net/net_namespace.h>
+
+#include "af_name.h"
+
+static u32 name_cache_rnd __read_mostly;
+
+#define NAME_CACHE_STAT_INC(nc, field)				\
+	do {							\
+		per_cpu_ptr((nc)->stats, get_cpu())->field++;	\
+		put_cpu();					\
+	} while (0)
+
+/*
+ * Names compare case-insensitively, so they are hashed in lower case.
+ */
+u32 name_hash(const char *name, unsigned int len)
+{
+	char buf[sizeof(struct name_addr)];
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = tolower(name[i]);
+	return jhash(buf, len, name_cache_rnd);
+}
+
+static inline u32 name_cache_hash(const char *name, unsigned int len)
+{
+	return name_hash(name, len) & (NAME_CACHE_HASH_SIZE - 1);
+}
+
+static struct name_cache_entry *__name_cache_find(struct name_cache *nc,
+						  const char *name,
+						  unsigned int len, u32 hash)
+{
+	struct name_cache_entry *e;
+	struct hlist_node *node;
+
+	hlist_for_each_entry_rcu(e, node, &nc->hash[hash], hlist) {
+		if (e->namelen == len && !strnicmp(e->name, name, len))
+			return e;
+	}
+	return NULL;
+}
+
+/*
+ * Whether @e has addresses that may still be handed out, if need be while
+ * they are being refreshed.
+ */
+static inline int name_cache_servable(struct name_net *nn,
+				      struct name_cache_entry *e)
+{
+	return !e->error &&
+	       time_before(jiffies, e->expires + nn->sysctl_stale_ttl);
+}
+
+static void name_cache_entry_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct name_cache_entry, rcu));
+}
+
+static void name_cache_unlink(struct name_cache *nc, struct name_cache_entry *e)
+{
+	hlist_del_rcu(&e->hlist);
+	nc->count--;
+	call_rcu(&e->rcu, name_cache_entry_free_rcu);
+}
+
+/* A background lookup of a stale entry */
+struct name_cache_refresh {
+	struct name_resolve_req	req;
+	struct net		*net;
+	char			name[sizeof(struct name_addr)];
+};
+
+/*
+ * Allow the entry for @name to be refreshed again, once its refresh is
+ * over or could not be started.
+ */
+static void name_cache_refresh_abort(struct net *net, const char *name)
+{
+	struct name_cache *nc = &name_pernet(net)->cache;
+	struct name_cache_entry *e;
+	unsigned int len = strlen(name);
+
+	spin_lock_bh(&nc->lock);
+	e = __name_cache_find(nc, name, len, name_cache_hash(name, len));
+	if (e)
+		clear_bit(NAME_CACHE_REFRESHING, &e->flags);
+	spin_unlock_bh(&nc->lock);
+}
+
+/*
+ * The resolver holds the namespace until its requests are done.  It may
+ * not have replaced the stale entry, as failures are not cached with a
+ * zero net.name.negative_ttl and no answer is when memory runs out, so
+ * the entry is allowed to be refreshed again whatever the outcome.
+ */
+static void name_cache_refresh_done(struct name_resolve_req *req, int err,
+				    const struct name_rr *addrs, int naddrs)
+{
+	struct name_cache_refresh *r;
+
+	r = container_of(req, struct name_cache_refresh, req);
+	name_cache_refresh_abort(r->net, r->name);
+	kfree(r);
+}
+
+/*
+ * Look @name up again in the background.  The resolver replaces the cache
+ * entry with whatever answer it gets.
+ */
+static void name_cache_refresh(struct net *net, const char *name)
+{
+	struct name_cache_refresh *r;
+
+	r = kmalloc(sizeof(*r), GFP_KERNEL);
+	if (!r)
+		goto abort;
+	r->req.done = name_cache_refresh_done;
+	r->net = net;
+	strlcpy(r->name, name, sizeof(r->name));
+	if (name_resolver_query(net, name, &r->req)) {
+		kfree(r);
+		goto abort;
+	}
+	return;
+
+abort:
+	name_cache_refresh_abort(net, name);
+}
+
+/**
+ * name_cache_get - look up a name in the cache
+ * @net: network namespace
+ * @name: NUL-terminated name
+ * @rr: where to store the addresses
+ * @max: room in @rr
+ *
+ * Copies up to @max of the cached addresses of @name and returns how many
+ * were copied.  Addresses that have expired but are still servable are
+ * returned as well, and a refresh of the name is started.  Returns the
+ * cached error if @name failed to resolve recently, or -ENOENT if the
+ * cache has no usable entry for @name.
+ */
+int name_cache_get(struct net *net, const char *name, struct name_rr *rr,
+		   int max)
+{
+	struct name_net *nn = name_pernet(net);
+	struct name_cache *nc = &nn->cache;
+	struct name_cache_entry *e;
+	unsigned int len = strlen(name);
+	int n = -ENOENT, refresh = 0;
+
+	rcu_read_lock();
+	e = __name_cache_find(nc, name, len, name_cache_hash(name, len));
+	if (!e) {
+		NAME_CACHE_STAT_INC(nc, misses);
+	} else if (time_before(jiffies, e->expires)) {
+		if (e->error) {
+			n = e->error;
+			NAME_CACHE_STAT_INC(nc, negative);
+		} else {
+			n = min_t(int, e->naddrs, max);
+			memcpy(rr, e->addrs, n * sizeof(*rr));
+			NAME_CACHE_STAT_INC(nc, hits);
+		}
+	} else if (name_cache_servable(nn, e)) {
+		n = min_t(int, e->naddrs, max);
+		memcpy(rr, e->addrs, n * sizeof(*rr));
+		refresh = !test_and_set_bit(NAME_CACHE_REFRESHING, &e->flags);
+		NAME_CACHE_STAT_INC(nc, stale);
+	} else {
+		NAME_CACHE_STAT_INC(nc, expired);
+	}
+	rcu_read_unlock();
+
+	if (refresh)
+		name_cache_refresh(net, name);
+	return n;
+}
+
+static void __name_cache_gc(struct name_net *nn)
+{
+	struct name_cache *nc = &nn->cache;
+	struct name_cache_entry *e;
+	struct hlist_node *node, *tmp;
+	int i;
+
+	for (i = 0; i < NAME_CACHE_HASH_SIZE; i++) {
+		hlist_for_each_entry_safe(e, node, tmp, &nc->hash[i], hlist) {
+			if (time_after_eq(jiffies, e->expires) &&
+			    !name_cache_servable(nn, e))
+				name_cache_unlink(nc, e);
+		}
+	}
+}
+
+static struct name_cache_entry *name_cache_entry_alloc(const char *name,
+						unsigned int len,
+						const struct name_rr *addrs,
+						unsigned int naddrs,
+						unsigned long ttl)
+{
+	struct name_cache_entry *e;
+
+	e = kmalloc(sizeof(*e) + naddrs * sizeof(*addrs) + len + 1,
+		    GFP_KERNEL);
+	if (!e)
+		return NULL;
+
+	e->expires = jiffies + ttl;
+	e->flags = 0;
+	e->error = 0;
+	e->hash = name_cache_hash(name, len);
+	e->naddrs = naddrs;
+	memcpy(e->addrs, addrs, naddrs * sizeof(*addrs));
+	e->namelen = len;
+	e->name = (char *)&e->addrs[naddrs];
+	memcpy(e->name, name, len + 1);
+	return e;
+}
+
+/*
+ * Put @e in place of the entry for its name, if any.  A failure does not
+ * replace addresses that can still be served; it only allows them to be
+ * refreshed again.
+ */
+static void name_cache_replace(struct name_net *nn, struct name_cache_entry *e)
+{
+	struct name_cache *nc = &nn->cache;
+	struct name_cache_entry *old;
+
+	spin_lock_bh(&nc->lock);
+	old = __name_cache_find(nc, e->name, e->namelen, e->hash);
+	if (old && e->error && name_cache_servable(nn, old)) {
+		clear_bit(NAME_CACHE_REFRESHING, &old->flags);
+		kfree(e);
+	} else if (old) {
+		hlist_replace_rcu(&old->hlist, &e->hlist);
+		call_rcu(&old->rcu, name_cache_entry_free_rcu);
+	} else {
+		if (nc->count >= NAME_CACHE_MAX_ENTRIES)
+			__name_cache_gc(nn);
+		if (nc->count >= NAME_CACHE_MAX_ENTRIES) {
+			kfree(e);
+		} else {
+			hlist_add_head_rcu(&e->hlist, &nc->hash[e->hash]);
+			nc->count++;
+		}
+	}
+	spin_unlock_bh(&nc->lock);
+}
+
+/**
+ * name_cache_insert - add or replace the addresses of a name
+ * @net: network namespace
+ * @name: NUL-terminated name
+ * @addrs: addresses @name resolved to
+ * @naddrs: number of @addrs
+ * @ttl: time to live in seconds
+ *
+ * An entry with a TTL of zero is not cached, but replaces any older one.
+ */
+int name_cache_insert(struct net *net, const char *name,
+		      const struct name_rr *addrs, unsigned int naddrs,
+		      unsigned int ttl)
+{
+	struct name_cache_entry *e;
+	unsigned int len = strlen(name);
+
+	if (len >= sizeof(struct name_addr) || !naddrs)
+		return -EINVAL;
+
+	if (!ttl) {
+		name_cache_remove(net, name);
+		return 0;
+	}
+
+	ttl = min_t(unsigned int, ttl, NAME_CACHE_MAX_TTL);
+	e = name_cache_entry_alloc(name, len, addrs, naddrs, ttl * HZ);
+	if (!e)
+		return -ENOMEM;
+
+	name_cache_replace(name_pernet(net), e);
+	return 0;
+}
+
+/**
+ * name_cache_insert_negative - remember that a name failed to resolve
+ * @net: network namespace
+ * @name: NUL-terminated name
+ * @error: negative error to fail lookups of @name with
+ *
+ * The failure is cached for net.name.negative_ttl.
+ */
+int name_cache_insert_negative(struct net *net, const char *name, int error)
+{
+	struct name_net *nn = name_pernet(net);
+	struct name_cache_entry *e;
+	unsigned int len = strlen(name);
+
+	if (len >= sizeof(struct name_addr))
+		return -EINVAL;
+	if (!nn->sysctl_negative_ttl)
+		return 0;
+
+	e = name_cache_entry_alloc(name, len, NULL, 0,
+				   nn->sysctl_negative_ttl);
+	if (!e)
+		return -ENOMEM;
+	e->error = error;
+
+	name_cache_replace(nn, e);
+	return 0;
+}
+
+/**
+ * name_cache_remove - forget the addresses of a name
+ * @net: network namespace
+ * @name: NUL-terminated name
+ */
+void name_cache_remove(struct net *net, const char *name)
+{
+	struct name_cache *nc = &name_pernet(net)->cache;
+	struct name_cache_entry *e;
+	unsigned int len = strlen(name);
+
+	spin_lock_bh(&nc->lock);
+	e = __name_cache_find(nc, name, len, name_cache_hash(name, len));
+	if (e)
+		name_cache_unlink(nc, e);
+	spin_unlock_bh(&nc->lock);
+}
+
+void name_cache_flush(struct name_net *nn)
+{
+	struct name_cache *nc = &nn->cache;
+	struct name_cache_entry *e;
+	struct hlist_node *node, *tmp;
+	int i;
+
+	spin_lock_bh(&nc->lock);
+	for (i = 0; i < NAME_CACHE_HASH_SIZE; i++) {
+		hlist_for_each_entry_safe(e, node, tmp, &nc->hash[i], hlist)
+			name_cache_unlink(nc, e);
+	}
+	spin_unlock_bh(&nc->lock);
+}
+
+static void name_cache_gc_worker(struct work_struct *work)
+{
+	struct name_net *nn = container_of(work, struct name_net,
+					   cache.gc_work.work);
+	struct name_cache *nc = &nn->cache;
+
+	spin_lock_bh(&nc->lock);
+	__name_cache_gc(nn);
+	spin_unlock_bh(&nc->lock);
+
+	schedule_delayed_work(&nc->gc_work, NAME_CACHE_GC_INTERVAL);
+}
+
+#ifdef CONFIG_PROC_FS
+static int name_cache_seq_show(struct seq_file *seq, void *v)
+{
+	struct net *net = seq->private;
+	struct name_cache *nc = &name_pernet(net)->cache;
+	struct name_cache_stats sum;
+	int cpu;
+
+	memset(&sum, 0, sizeof(sum));
+	for_each_possible_cpu(cpu) {
+		struct name_cache_stats *st = per_cpu_ptr(nc->stats, cpu);
+
+		sum.hits += st->hits;
+		sum.misses += st->misses;
+		sum.expired += st->expired;
+		sum.stale += st->stale;
+		sum.negative += st->negative;
+	}
+
+	seq_printf(seq, "cache: entries %u hits %lu misses %lu expired %lu "
+		   "stale %lu negative %lu\n", nc->count, sum.hits, sum.misses,
+		   sum.expired, sum.stale, sum.negative);
+	name_resolver_seq_show(seq);
+	name_pool_seq_show(seq, name_pernet(net));
+	return 0;
+}
+
+static int name_cache_seq_open(struct inode *inode, struct file *file)
+{
+	return single_open_net(inode, file, name_cache_seq_show);
+}
+
+static const struct file_operations name_cache_seq_fops = {
+	.owner	 = THIS_MODULE,
+	.open	 = name_cache_seq_open,
+	.read	 = seq_read,
+	.llseek	 = seq_lseek,
+	.release = single_release_net,
+};
+
+static int name_cache_proc_init(struct net *net)
+{
+	if (!proc_net_fops_create(net, "name_cache", S_IRUGO,
+				  &name_cache_seq_fops))
+		return -ENOMEM;
+	return 0;
+}
+
+static void name_cache_proc_exit(struct net *net)
+{
+	proc_net_remove(net, "name_cache");
+}
+#else
+static inline int name_cache_proc_init(struct net *net)
+{
+	return 0;
+}
+
+static inline void name_cache_proc_exit(struct net *net)
+{
+}
+#endif /* CONFIG_PROC_FS */
+
+int name_cache_init(struct name_net *nn)
+{
+	struct name_cache *nc = &nn->cache;
+	int i;
+
+	if (!name_cache_rnd)
+		get_random_bytes(&name_cache_rnd, sizeof(name_cache_rnd));
+
+	for (i = 0; i < NAME_CACHE_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&nc->hash[i]);
+	spin_lock_init(&nc->lock);
+
+	nc->stats = alloc_percpu(struct name_cache_stats);
+	if (!nc->stats)
+		return -ENOMEM;
+
+	if (name_cache_proc_init(nn->net)) {
+		free_percpu(nc->stats);
+		return -ENOMEM;
+	}
+
+	INIT_DELAYED_WORK_DEFERRABLE(&nc->gc_work, name_cache_gc_worker);
+	schedule_delayed_work(&nc->gc_work, NAME_CACHE_GC_INTERVAL);
+	return 0;
+}
+
+void name_cache_exit(struct name_net *nn)
+{
+	struct name_cache *nc = &nn->cache;
+
+	cancel_delayed_work_sync(&nc->gc_work);
+	name_cache_proc_exit(nn->net);
+	name_cache_flush(nn);
+	rcu_barrier();
+	free_percpu(nc->stats);
+}
@@ -0,0 +1,625 @@
+/*
+ * Name-oriented sockets: datagram sockets
+ *
+ * An AF_NAME datagram socket sends and receives through UDP transports:
+ * one unconnected transport per address family, which receives from
+ * anyone, and one connected to the destination last sent to.  Sending to
+ * that destination again goes out on the connected transport, which
+ * skips resolving the name and, as for any connected UDP socket, looking
+ * up the route: the transport keeps it in its dst cache and only looks
+ * it up again once the route changed.  The name itself is looked up
+ * again in the name cache at most once every NAME_DGRAM_REVALIDATE.
+ *
+ * All transports share the local port, so that the peer sees the same
+ * source whichever transport a datagram left on.  They share it with each
+ * other only, as sockets of the same sk_reuse_owner; other sockets bind
+ * to it as the AF_NAME socket's own SO_REUSEADDR allows.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/in.h>
+#include <linux/in6.h>
+#include <linux/net.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/skbuff.h>
+#include <linux/socket.h>
+#include <linux/string.h>
+#include <net/sock.h>
+#include <net/inet_sock.h>
+#include <net/ipv6.h>
+#include <net/tcp_states.h>
+
+#include "af_name.h"
+
+/* How long a destination is used before its name is looked up again */
+#define NAME_DGRAM_REVALIDATE	HZ
+
+/* Datagram transports only need their wakeups passed on to the owner */
+static const struct name_transport_ops name_dgram_transport_ops = { };
+
+static int name_dgram_slot(unsigned short family)
+{
+	return family == AF_INET6 ? NAME_DGRAM_INET6 : NAME_DGRAM_INET;
+}
+
+/*
+ * Get a reference to transport @slot of @sk, or NULL if it has none.
+ */
+static struct name_transport *name_dgram_transport(struct sock *sk, int slot)
+{
+	struct name_transport *nt;
+
+	read_lock_bh(&sk->sk_callback_lock);
+	nt = name_dgram_sk(sk)->transports[slot];
+	if (nt)
+		name_transport_hold(nt);
+	read_unlock_bh(&sk->sk_callback_lock);
+	return nt;
+}
+
+static void name_dgram_set_transport(struct sock *sk, int slot,
+				     struct name_transport *nt)
+{
+	struct name_dgram_sock *dg = name_dgram_sk(sk);
+	struct name_transport *old;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	old = dg->transports[slot];
+	dg->transports[slot] = nt;
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	if (old) {
+		name_transport_detach(old);
+		name_transport_put(old);
+	}
+}
+
+/*
+ * Create a UDP transport for @family that may share its port with the
+ * other transports of @sk, and with other sockets if @sk allows it.
+ */
+static int name_dgram_create(struct sock *sk, unsigned short family,
+			     struct name_transport **ntp)
+{
+	struct name_transport *nt;
+	struct sock *tsk;
+	int one = 1, err;
+
+	err = name_transport_create(sk, family, SOCK_DGRAM, IPPROTO_UDP,
+				    &name_dgram_transport_ops, &nt);
+	if (err)
+		return err;
+
+	tsk = nt->sock->sk;
+	tsk->sk_reuse = sk->sk_reuse;
+	tsk->sk_reuse_owner = sk;
+	tsk->sk_sndbuf = sk->sk_sndbuf;
+	tsk->sk_rcvbuf = sk->sk_rcvbuf;
+
+	/* IPv4 goes through the IPv4 transports */
+	if (family == AF_INET6) {
+		err = kernel_setsockopt(nt->sock, IPPROTO_IPV6, IPV6_V6ONLY,
+					(char *)&one, sizeof(one));
+		if (err) {
+			name_transport_put(nt);
+			return err;
+		}
+	}
+
+	*ntp = nt;
+	return 0;
+}
+
+/*
+ * Open the unconnected transport for the family of @rr, bound to @rr and
+ * the port of @sk.  The first transport opened picks the port for the
+ * others.  Called with the socket locked.
+ */
+static int name_dgram_open(struct sock *sk, const struct name_rr *rr)
+{
+	struct name_dgram_sock *dg = name_dgram_sk(sk);
+	struct sockaddr_storage addr;
+	struct name_transport *nt;
+	int addrlen, err;
+
+	err = name_dgram_create(sk, rr->family, &nt);
+	if (err)
+		return err;
+
+	addrlen = name_rr_to_sockaddr(rr, dg->sport, &addr);
+	err = kernel_bind(nt->sock, (struct sockaddr *)&addr, addrlen);
+	if (err) {
+		name_transport_put(nt);
+		return err;
+	}
+
+	if (!dg->sport)
+		dg->sport = inet_sk(nt->sock->sk)->sport;
+	name_dgram_set_transport(sk, name_dgram_slot(rr->family), nt);
+	return 0;
+}
+
+/*
+ * Connect a new destination transport to @rr and the port of the
+ * destination, from the address and port of the unconnected transport of
+ * its family.  An unbound socket gets that transport on the way; a bound
+ * one only sends from the families it was bound to.  Called with the
+ * socket locked.
+ */
+static int name_dgram_connect_rr(struct sock *sk, const struct name_rr *rr)
+{
+	struct name_dgram_sock *dg = name_dgram_sk(sk);
+	int slot = name_dgram_slot(rr->family);
+	struct sockaddr_storage addr;
+	struct name_transport *nt;
+	int addrlen, err;
+
+	if (!dg->transports[slot]) {
+		struct name_rr any = { .family = rr->family };
+
+		if (dg->bound)
+			return -EAFNOSUPPORT;
+		err = name_dgram_open(sk, &any);
+		if (err)
+			return err;
+	}
+
+	err = kernel_getsockname(dg->transports[slot]->sock,
+				 (struct sockaddr *)&addr, &addrlen);
+	if (err)
+		return err;
+
+	err = name_dgram_create(sk, rr->family, &nt);
+	if (err)
+		return err;
+
+	err = kernel_bind(nt->sock, (struct sockaddr *)&addr, addrlen);
+	if (err)
+		goto out_put;
+
+	addrlen = name_rr_to_sockaddr(rr, dg->dport, &addr);
+	err = kernel_connect(nt->sock, (struct sockaddr *)&addr, addrlen, 0);
+	if (err)
+		goto out_put;
+
+	dg->daddr = *rr;
+	name_dgram_set_transport(sk, NAME_DGRAM_DEST, nt);
+	return 0;
+
+out_put:
+	name_transport_put(nt);
+	return err;
+}
+
+/*
+ * Make @name and @port the destination of @sk, unless they already are
+ * and were looked up recently.  A destination whose name still resolves to the
+ * address it is connected to is kept; otherwise the addresses of the name
+ * are tried in turn until a transport connects to one.  With @nonblock, a
+ * name that has to be looked up fails with -EAGAIN rather than sleeping.
+ * Called with the socket locked.
+ */
+static int name_dgram_set_dest(struct sock *sk, const char *name,
+			       __be16 port, int nonblock)
+{
+	struct name_dgram_sock *dg = name_dgram_sk(sk);
+	struct name_rr rr[NAME_RESOLVE_MAX_ADDRS];
+	int same, i, n, err;
+
+	same = dg->transports[NAME_DGRAM_DEST] && dg->dport == port &&
+	       !strcmp(dg->dname.name, name);
+	if (same && time_before(jiffies, dg->expires))
+		return 0;
+
+	if (nonblock)
+		n = name_resolve_nowait(sock_net(sk), name, rr,
+					NAME_RESOLVE_MAX_ADDRS);
+	else
+		n = name_resolve_wait(sock_net(sk), name, rr,
+				      NAME_RESOLVE_MAX_ADDRS);
+	if (n < 0)
+		return n;
+	dg->expires = jiffies + NAME_DGRAM_REVALIDATE;
+
+	if (same) {
+		for (i = 0; i < n; i++)
+			if (name_rr_equal(&rr[i], &dg->daddr))
+				return 0;
+	} else if (name != dg->dname.name) {
+		memset(&dg->dname, 0, sizeof(dg->dname));
+		strcpy(dg->dname.name, name);
+	}
+	dg->dport = port;
+
+	err = -EHOSTUNREACH;
+	for (i = 0; i < n; i++) {
+		err = name_dgram_connect_rr(sk, &rr[i]);
+		if (!err)
+			return 0;
+	}
+
+	/* Do not leave a destination behind that does not match dname */
+	name_dgram_set_transport(sk, NAME_DGRAM_DEST, NULL);
+	return err;
+}
+
+/*
+ * Asynchronous errors such as ICMP port unreachables are reported on
+ * connected sockets only, as they are for UDP sockets.
+ */
+static void name_dgram_clear_error(struct sock *sk, struct name_transport *nt)
+{
+	if (!name_dgram_sk(sk)->connected)
+		sock_error(nt->sock->sk);
+}
+
+static int name_dgram_release(struct socket *sock)
+{
+	struct sock *sk = sock->sk;
+	int i;
+
+	if (!sk)
+		return 0;
+
+	name_diag_unlink(sk);
+
+	lock_sock(sk);
+	for (i = 0; i < NAME_DGRAM_MAX; i++)
+		name_dgram_set_transport(sk, i, NULL);
+	sk->sk_state = TCP_CLOSE;
+	sock_orphan(sk);
+	release_sock(sk);
+
+	sock->sk = NULL;
+	sock_put(sk);
+	return 0;
+}
+
+/*
+ * Binding to a name binds to the first of its addresses in each family
+ * that is local; binding to the empty name binds to the IPv4 and IPv6
+ * wildcards.  Datagrams are then sent only from the families bound.
+ */
+static int name_dgram_bind(struct socket *sock, struct sockaddr *uaddr,
+			   int addr_len)
+{
+	struct sockaddr_name *sname = (struct sockaddr_name *)uaddr;
+	struct sock *sk = sock->sk;
+	struct name_dgram_sock *dg = name_dgram_sk(sk);
+	struct name_rr rr[NAME_RESOLVE_MAX_ADDRS];
+	int i, n, err;
+
+	if (addr_len < offsetof(struct sockaddr_name, sname_addr) + 1)
+		return -EINVAL;
+	if (sname->sname_family != AF_NAME)
+		return -EAFNOSUPPORT;
+
+	if (sname->sname_addr.name[0] == '\0') {
+		memset(rr, 0, 2 * sizeof(*rr));
+		rr[0].family = AF_INET6;
+		rr[1].family = AF_INET;
+		n = 2;
+	} else {
+		err = name_check_sockaddr(sname, addr_len);
+		if (err)
+			return err;
+		n = name_resolve_wait(sock_net(sk), sname->sname_addr.name,
+				      rr, NAME_RESOLVE_MAX_ADDRS);
+		if (n < 0)
+			return n;
+	}
+
+	lock_sock(sk);
+	err = -EINVAL;
+	if (dg->bound || dg->transports[NAME_DGRAM_INET] ||
+	    dg->transports[NAME_DGRAM_INET6])
+		goto out;
+
+	dg->sport = sname->sname_port;
+	err = -EADDRNOTAVAIL;
+	for (i = 0; i < n; i++) {
+		if (dg->transports[name_dgram_slot(rr[i].family)])
+			continue;
+		err = name_dgram_open(sk, &rr[i]);
+		if (err && err != -EADDRNOTAVAIL && err != -EAFNOSUPPORT)
+			break;
+	}
+
+	if (dg->transports[NAME_DGRAM_INET] ||
+	    dg->transports[NAME_DGRAM_INET6]) {
+		/* Only the first address of a family is bound */
+		dg->bound = 1;
+		err = 0;
+	} else if (!err)
+		err = -EADDRNOTAVAIL;
+	if (err) {
+		for (i = 0; i < NAME_DGRAM_MAX; i++)
+			name_dgram_set_transport(sk, i, NULL);
+		dg->sport = 0;
+	}
+out:
+	release_sock(sk);
+	return err;
+}
+
+/*
+ * Connecting sets the destination of send() and restricts receiving to
+ * datagrams from it; connecting to AF_UNSPEC undoes that.
+ */
+static int name_dgram_connect(struct socket *sock, struct sockaddr *uaddr,
+			      int addr_len, int flags)
+{
+	struct sockaddr_name *sname = (struct sockaddr_name *)uaddr;
+	struct sock *sk = sock->sk;
+	struct name_dgram_sock *dg = name_dgram_sk(sk);
+	int err;
+
+	if (addr_len >= sizeof(sname->sname_family) &&
+	    sname->sname_family == AF_UNSPEC) {
+		lock_sock(sk);
+		dg->connected = 0;
+		sk->sk_state = TCP_CLOSE;
+		sock->state = SS_UNCONNECTED;
+		name_dgram_set_transport(sk, NAME_DGRAM_DEST, NULL);
+		release_sock(sk);
+		return 0;
+	}
+
+	err = name_check_sockaddr(sname, addr_len);
+	if (err)
+		return err;
+
+	lock_sock(sk);
+	dg->connected = 0;
+	dg->expires = jiffies;		/* force a lookup */
+	err = name_dgram_set_dest(sk, sname->sname_addr.name,
+				  sname->sname_port, 0);
+	if (!err) {
+		dg->connected = 1;
+		sk->sk_state = TCP_ESTABLISHED;
+		sock->state = SS_CONNECTED;
+	} else {
+		sk->sk_state = TCP_CLOSE;
+		sock->state = SS_UNCONNECTED;
+	}
+	release_sock(sk);
+	return err;
+}
+
+static int name_dgram_getname(struct socket *sock, struct sockaddr *uaddr,
+			      int *uaddr_len, int peer)
+{
+	struct sockaddr_name *sname = (struct sockaddr_name *)uaddr;
+	struct sock *sk = sock->sk;
+	struct name_dgram_sock *dg = name_dgram_sk(sk);
+	int err = 0;
+
+	memset(sname, 0, sizeof(*sname));
+	sname->sname_family = AF_NAME;
+
+	lock_sock(sk);
+	if (!peer)
+		sname->sname_port = dg->sport;
+	else if (dg->connected) {
+		sname->sname_port = dg->dport;
+		memcpy(&sname->sname_addr, &dg->dname,
+		       sizeof(sname->sname_addr));
+	} else
+		err = -ENOTCONN;
+	release_sock(sk);
+
+	*uaddr_len = sizeof(*sname);
+	return err;
+}
+
+static unsigned int name_dgram_poll(struct file *file, struct socket *sock,
+				    poll_table *wait)
+{
+	struct sock *sk = sock->sk;
+	struct name_transport *nt;
+	unsigned int mask = 0, tmask;
+	int i, any = 0;
+
+	poll_wait(file, sk->sk_sleep, wait);
+
+	for (i = 0; i < NAME_DGRAM_MAX; i++) {
+		nt = name_dgram_transport(sk, i);
+		if (!nt)
+			continue;
+		tmask = nt->sock->ops->poll(file, nt->sock, NULL);
+		if (i == NAME_DGRAM_DEST && !name_dgram_sk(sk)->connected)
+			tmask &= ~POLLERR;
+		mask |= tmask;
+		any = 1;
+		name_transport_put(nt);
+	}
+
+	/* Nothing sent or bound yet */
+	if (!any)
+		mask = POLLOUT | POLLWRNORM | POLLWRBAND;
+	return mask;
+}
+
+static int name_dgram_sendmsg(struct kiocb *iocb, struct socket *sock,
+			      struct msghdr *msg, size_t len)
+{
+	struct sockaddr_name *sname = msg->msg_name;
+	struct sock *sk = sock->sk;
+	struct name_dgram_sock *dg = name_dgram_sk(sk);
+	struct name_transport *nt = NULL;
+	int namelen = msg->msg_namelen;
+	int nonblock = msg->msg_flags & MSG_DONTWAIT;
+	int err;
+
+	if (sname) {
+		err = name_check_sockaddr(sname, namelen);
+		if (err)
+			return err;
+	}
+
+	lock_sock(sk);
+	if (sname) {
+		err = -EISCONN;
+		if (dg->connected &&
+		    (sname->sname_port != dg->dport ||
+		     strcmp(sname->sname_addr.name, dg->dname.name)))
+			goto out_unlock;
+		err = name_dgram_set_dest(sk, sname->sname_addr.name,
+					  sname->sname_port, nonblock);
+	} else if (dg->connected)
+		err = name_dgram_set_dest(sk, dg->dname.name, dg->dport,
+					  nonblock);
+	else
+		err = -EDESTADDRREQ;
+	if (!err) {
+		nt = name_dgram_transport(sk, NAME_DGRAM_DEST);
+		if (!nt)
+			err = -ENOTCONN;
+	}
+out_unlock:
+	release_sock(sk);
+	if (err)
+		return err;
+
+	name_dgram_clear_error(sk, nt);
+	nt->sock->sk->sk_sndtimeo = sk->sk_sndtimeo;
+	msg->msg_name = NULL;
+	msg->msg_namelen = 0;
+	err = nt->sock->ops->sendmsg(iocb, nt->sock, msg, len);
+	msg->msg_name = sname;
+	msg->msg_namelen = namelen;
+	name_transport_put(nt);
+	return err;
+}
+
+/*
+ * Rewrite the address of the sender that UDP put into msg_name as an
+ * AF_NAME address whose name is the literal address.
+ */
+static void name_dgram_sender(struct msghdr *msg)
+{
+	struct sockaddr_name *sname = msg->msg_name;
+	struct sockaddr_storage addr;
+	__be16 port;
+
+	if (!sname || !msg->msg_namelen)
+		return;
+
+	memcpy(&addr, sname, sizeof(addr));
+	memset(sname, 0, sizeof(*sname));
+	sname->sname_family = AF_NAME;
+	if (addr.ss_family == AF_INET) {
+		struct sockaddr_in *sin = (struct sockaddr_in *)&addr;
+
+		port = sin->sin_port;
+		snprintf(sname->sname_addr.name, sizeof(sname->sname_addr.name),
+			 NIPQUAD_FMT, NIPQUAD(sin->sin_addr.s_addr));
+	} else {
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&addr;
+
+		port = sin6->sin6_port;
+		snprintf(sname->sname_addr.name, sizeof(sname->sname_addr.name),
+			 NIP6_FMT, NIP6(sin6->sin6_addr));
+	}
+	sname->sname_port = port;
+	msg->msg_namelen = sizeof(*sname);
+}
+
+/*
+ * Receive a datagram from whichever transport has one queued; connected
+ * sockets receive from the destination transport only.
+ */
+static int name_dgram_recv_any(struct kiocb *iocb, struct sock *sk,
+			       struct msghdr *msg, size_t len, int flags)
+{
+	struct name_transport *nt;
+	int i, err = -EAGAIN;
+
+	for (i = 0; i < NAME_DGRAM_MAX && err == -EAGAIN; i++) {
+		if (i != NAME_DGRAM_DEST && name_dgram_sk(sk)->connected)
+			continue;
+		nt = name_dgram_transport(sk, i);
+		if (!nt)
+			continue;
+		if (i == NAME_DGRAM_DEST)
+			name_dgram_clear_error(sk, nt);
+		if (nt->sock->sk->sk_err ||
+		    !skb_queue_empty(&nt->sock->sk->sk_receive_queue) ||
+		    ((flags & MSG_ERRQUEUE) &&
+		     !skb_queue_empty(&nt->sock->sk->sk_error_queue)))
+			err = nt->sock->ops->recvmsg(iocb, nt->sock, msg, len,
+						     flags | MSG_DONTWAIT);
+		name_transport_put(nt);
+	}
+	return err;
+}
+
+static int name_dgram_recvmsg(struct kiocb *iocb, struct socket *sock,
+			      struct msghdr *msg, size_t len, int flags)
+{
+	struct sock *sk = sock->sk;
+	long timeo = sock_rcvtimeo(sk, flags & MSG_DONTWAIT);
+	DEFINE_WAIT(wait);
+	int err;
+
+	for (;;) {
+		prepare_to_wait(sk->sk_sleep, &wait, TASK_INTERRUPTIBLE);
+		err = name_dgram_recv_any(iocb, sk, msg, len, flags);
+		if (err != -EAGAIN || !timeo || (flags & MSG_ERRQUEUE))
+			break;
+		err = sock_intr_errno(timeo);
+		if (signal_pending(current))
+			break;
+		timeo = schedule_timeout(timeo);
+		err = -EAGAIN;
+		if (!timeo)
+			break;
+	}
+	finish_wait(sk->sk_sleep, &wait);
+
+	if (err >= 0)
+		name_dgram_sender(msg);
+	return err;
+}
+
+static int name_dgram_init_sock(struct sock *sk)
+{
+	sk->sk_state = TCP_CLOSE;
+	name_diag_link(sk);
+	return 0;
+}
+
+struct proto name_dgram_proto = {
+	.name		= "NAME_DGRAM",
+	.owner		= THIS_MODULE,
+	.init		= name_dgram_init_sock,
+	.obj_size	= sizeof(struct name_dgram_sock),
+};
+
+const struct proto_ops name_dgram_ops = {
+	.family		   = PF_NAME,
+	.owner		   = THIS_MODULE,
+	.release	   = name_dgram_release,
+	.bind		   = name_dgram_bind,
+	.connect	   = name_dgram_connect,
+	.socketpair	   = sock_no_socketpair,
+	.accept		   = sock_no_accept,
+	.getname	   = name_dgram_getname,
+	.poll		   = name_dgram_poll,
+	.ioctl		   = sock_no_ioctl,
+	.listen		   = sock_no_listen,
+	.shutdown	   = sock_no_shutdown,
+	.setsockopt	   = sock_no_setsockopt,
+	.getsockopt	   = sock_no_getsockopt,
+	.sendmsg	   = name_dgram_sendmsg,
+	.recvmsg	   = name_dgram_recvmsg,
+	.mmap		   = sock_no_mmap,
+	.sendpage	   = sock_no_sendpage,
+};
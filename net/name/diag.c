@@ -0,0 +1,422 @@
+/*
+ * Name-oriented sockets: monitoring
+ *
+ * Every AF_NAME socket is on the socket list of its namespace, which a
+ * NAME_DIAG_GETSOCK dump over NETLINK_NAME_ORIENTED_STACK walks in the
+ * manner of inet_diag.  Stream sockets time the phases of their connect:
+ * resolving the name, the handshake, and the wait for the first byte.
+ * Each phase is reported with the socket and counted in the log2
+ * latency histograms of the name, which a NAME_DIAG_GETHIST dump lists.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bitops.h>
+#include <linux/mutex.h>
+#include <linux/netlink.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <net/inet_sock.h>
+#include <net/ipv6.h>
+#include <net/netlink.h>
+#include <net/sock.h>
+
+#include "af_name.h"
+
+static DEFINE_MUTEX(name_diag_mutex);
+
+void name_diag_link(struct sock *sk)
+{
+	struct name_net *nn = name_pernet(sock_net(sk));
+
+	write_lock_bh(&nn->sklist_lock);
+	sk_add_node(sk, &nn->sklist);
+	write_unlock_bh(&nn->sklist_lock);
+}
+
+void name_diag_unlink(struct sock *sk)
+{
+	struct name_net *nn = name_pernet(sock_net(sk));
+
+	write_lock_bh(&nn->sklist_lock);
+	sk_del_node_init(sk);
+	write_unlock_bh(&nn->sklist_lock);
+}
+
+static struct name_hist *__name_hist_find(struct name_net *nn,
+					  const char *name,
+					  unsigned int len, u32 hash)
+{
+	struct name_hist *h;
+	struct hlist_node *node;
+
+	hlist_for_each_entry_rcu(h, node,
+			&nn->hist_hash[hash & (NAME_HIST_HASH_SIZE - 1)], hlist) {
+		if (h->hash == hash && h->namelen == len &&
+		    !strnicmp(h->name, name, len))
+			return h;
+	}
+	return NULL;
+}
+
+/*
+ * Find or add the histograms of @name.  Returns NULL once the namespace
+ * has NAME_HIST_MAX_ENTRIES names, or if there is no memory.
+ */
+static struct name_hist *name_hist_get(struct name_net *nn, const char *name)
+{
+	unsigned int len = strlen(name);
+	u32 hash = name_hash(name, len);
+	struct name_hist *h, *new;
+
+	rcu_read_lock();
+	h = __name_hist_find(nn, name, len, hash);
+	rcu_read_unlock();
+	if (h || nn->hist_count >= NAME_HIST_MAX_ENTRIES)
+		return h;
+
+	new = kzalloc(sizeof(*new) + len + 1, GFP_KERNEL);
+	if (!new)
+		return NULL;
+	new->hash = hash;
+	new->namelen = len;
+	memcpy(new->name, name, len + 1);
+
+	spin_lock_bh(&nn->hist_lock);
+	h = __name_hist_find(nn, name, len, hash);
+	if (!h && nn->hist_count < NAME_HIST_MAX_ENTRIES) {
+		hlist_add_head_rcu(&new->hlist,
+			&nn->hist_hash[hash & (NAME_HIST_HASH_SIZE - 1)]);
+		nn->hist_count++;
+		h = new;
+		new = NULL;
+	}
+	spin_unlock_bh(&nn->hist_lock);
+
+	kfree(new);
+	return h;
+}
+
+/*
+ * A stream socket starts connecting to name->dname.  Called with the
+ * socket locked.
+ */
+void name_diag_connect_start(struct sock *sk)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+
+	name->phases = 0;
+	name->phase_start = ktime_get();
+	/* Looked up every time, dname may differ from the last connect's */
+	name->hist = name_hist_get(name_pernet(sock_net(sk)), name->dname.name);
+}
+
+static int name_diag_bucket(u32 us)
+{
+	return min_t(int, fls(us), NAME_DIAG_HIST_BUCKETS - 1);
+}
+
+/**
+ * name_diag_phase_done - a phase of a connect completed
+ * @name: the connecting socket
+ * @phase: NAME_DIAG_*
+ *
+ * Records the time since the previous phase completed, unless @phase was
+ * already recorded or the previous one was not, so that the phases of a
+ * connection that moves, or of an accepted one, are not counted.  The
+ * phases complete in order, resolving in process context and the others
+ * in softirq context, so they do not race with each other.
+ */
+void name_diag_phase_done(struct name_stream_sock *name, int phase)
+{
+	ktime_t now;
+	s64 us;
+
+	if (name->phases & (1 << phase))
+		return;
+	if (phase > 0 && !(name->phases & (1 << (phase - 1))))
+		return;
+
+	now = ktime_get();
+	us = ktime_us_delta(now, name->phase_start);
+	us = clamp_t(s64, us, 0, NAME_DIAG_NOTIME - 1);
+	name->phase_us[phase] = us;
+	name->phase_start = now;
+	smp_wmb();	/* phase_us before phases, for name_diag_fill() */
+	name->phases |= 1 << phase;
+
+	if (name->hist)
+		atomic_inc(&name->hist->buckets[phase][name_diag_bucket(us)]);
+}
+
+static void name_diag_rr(struct name_diag_msg *r, const struct name_rr *rr)
+{
+	r->ndiag_family = rr->family;
+	if (rr->family == AF_INET)
+		r->ndiag_dst[0] = rr->addr.a4;
+	else
+		memcpy(r->ndiag_dst, &rr->addr.a6, sizeof(r->ndiag_dst));
+}
+
+static void name_diag_transport(struct name_diag_msg *r,
+				struct name_transport *nt)
+{
+	struct sock *tsk = nt->sock->sk;
+
+	r->ndiag_family = tsk->sk_family;
+	r->ndiag_sport = inet_sk(tsk)->sport;
+	if (tsk->sk_family == AF_INET)
+		r->ndiag_dst[0] = inet_sk(tsk)->daddr;
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	else
+		memcpy(r->ndiag_dst, &inet6_sk(tsk)->daddr,
+		       sizeof(r->ndiag_dst));
+#endif
+}
+
+static void name_diag_fill_stream(struct sock *sk, struct name_diag_msg *r,
+				  const char **dname, const char **sname)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	unsigned int phases;
+	int i;
+
+	r->ndiag_sport = name->sport;
+	r->ndiag_dport = name->dport;
+	read_lock_bh(&sk->sk_callback_lock);
+	if (name->transport)
+		name_diag_transport(r, name->transport);
+	read_unlock_bh(&sk->sk_callback_lock);
+
+	phases = name->phases;
+	smp_rmb();
+	for (i = 0; i < NAME_DIAG_PHASES; i++)
+		r->ndiag_phase_us[i] = phases & (1 << i) ?
+				       name->phase_us[i] : NAME_DIAG_NOTIME;
+
+	*dname = name->dname.name;
+	*sname = name->sname.name;
+}
+
+static void name_diag_fill_dgram(struct sock *sk, struct name_diag_msg *r,
+				 const char **dname)
+{
+	struct name_dgram_sock *dg = name_dgram_sk(sk);
+	int i;
+
+	r->ndiag_sport = dg->sport;
+	read_lock_bh(&sk->sk_callback_lock);
+	if (dg->transports[NAME_DGRAM_DEST]) {
+		r->ndiag_dport = dg->dport;
+		name_diag_rr(r, &dg->daddr);
+		*dname = dg->dname.name;
+	}
+	read_unlock_bh(&sk->sk_callback_lock);
+
+	for (i = 0; i < NAME_DIAG_PHASES; i++)
+		r->ndiag_phase_us[i] = NAME_DIAG_NOTIME;
+}
+
+/*
+ * The socket is not locked: like inet_diag, this reports a snapshot that
+ * may be inconsistent while the socket changes.
+ */
+static int name_diag_fill(struct sk_buff *skb, struct sock *sk, u32 pid,
+			  u32 seq, int flags)
+{
+	const char *dname = NULL, *sname = NULL;
+	struct name_diag_msg *r;
+	struct nlmsghdr *nlh;
+
+	nlh = nlmsg_put(skb, pid, seq, NAME_DIAG_GETSOCK, sizeof(*r), flags);
+	if (!nlh)
+		return -EMSGSIZE;
+
+	r = nlmsg_data(nlh);
+	memset(r, 0, sizeof(*r));
+	r->ndiag_type = sk->sk_type;
+	r->ndiag_state = sk->sk_state;
+	r->ndiag_protocol = sk->sk_protocol;
+	r->ndiag_uid = sock_i_uid(sk);
+	r->ndiag_inode = sock_i_ino(sk);
+
+	if (sk->sk_type == SOCK_STREAM)
+		name_diag_fill_stream(sk, r, &dname, &sname);
+	else
+		name_diag_fill_dgram(sk, r, &dname);
+
+	if (dname && dname[0])
+		NLA_PUT_STRING(skb, NAME_DIAG_NAME, dname);
+	if (sname && sname[0])
+		NLA_PUT_STRING(skb, NAME_DIAG_LOCAL_NAME, sname);
+
+	return nlmsg_end(skb, nlh);
+
+nla_put_failure:
+	nlmsg_cancel(skb, nlh);
+	return -EMSGSIZE;
+}
+
+static int name_diag_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct name_net *nn = name_pernet(sock_net(skb->sk));
+	struct name_diag_req *req = nlmsg_data(cb->nlh);
+	struct hlist_node *node;
+	struct sock *sk;
+	int idx = 0, s_idx = cb->args[0];
+
+	read_lock_bh(&nn->sklist_lock);
+	sk_for_each(sk, node, &nn->sklist) {
+		if (idx < s_idx)
+			goto next;
+		if (req->ndiag_type && sk->sk_type != req->ndiag_type)
+			goto next;
+		if (req->ndiag_states &&
+		    !(req->ndiag_states & (1 << sk->sk_state)))
+			goto next;
+		if (name_diag_fill(skb, sk, NETLINK_CB(cb->skb).pid,
+				   cb->nlh->nlmsg_seq, NLM_F_MULTI) < 0)
+			break;
+next:
+		idx++;
+	}
+	read_unlock_bh(&nn->sklist_lock);
+
+	cb->args[0] = idx;
+	return skb->len;
+}
+
+static int name_diag_fill_hist(struct sk_buff *skb, struct name_hist *h,
+			       u32 pid, u32 seq, int flags)
+{
+	struct name_diag_hist *r;
+	struct nlmsghdr *nlh;
+	struct nlattr *nla;
+	u32 *buckets;
+	int phase, i;
+
+	nlh = nlmsg_put(skb, pid, seq, NAME_DIAG_GETHIST, sizeof(*r), flags);
+	if (!nlh)
+		return -EMSGSIZE;
+
+	r = nlmsg_data(nlh);
+	memset(r, 0, sizeof(*r));
+	NLA_PUT_STRING(skb, NAME_DIAG_HIST_NAME, h->name);
+
+	for (phase = 0; phase < NAME_DIAG_PHASES; phase++) {
+		nla = nla_reserve(skb, NAME_DIAG_HIST_RESOLVE + phase,
+				  NAME_DIAG_HIST_BUCKETS * sizeof(u32));
+		if (!nla)
+			goto nla_put_failure;
+		buckets = nla_data(nla);
+		for (i = 0; i < NAME_DIAG_HIST_BUCKETS; i++) {
+			buckets[i] = atomic_read(&h->buckets[phase][i]);
+			r->ndiag_count[phase] += buckets[i];
+		}
+	}
+
+	return nlmsg_end(skb, nlh);
+
+nla_put_failure:
+	nlmsg_cancel(skb, nlh);
+	return -EMSGSIZE;
+}
+
+static int name_diag_dump_hist(struct sk_buff *skb,
+			       struct netlink_callback *cb)
+{
+	struct name_net *nn = name_pernet(sock_net(skb->sk));
+	struct hlist_node *node;
+	struct name_hist *h;
+	int b, idx = 0, s_b = cb->args[0], s_idx = cb->args[1];
+
+	rcu_read_lock();
+	for (b = s_b; b < NAME_HIST_HASH_SIZE; b++, s_idx = 0) {
+		idx = 0;
+		hlist_for_each_entry_rcu(h, node, &nn->hist_hash[b], hlist) {
+			if (idx < s_idx)
+				goto next;
+			if (name_diag_fill_hist(skb, h,
+						NETLINK_CB(cb->skb).pid,
+						cb->nlh->nlmsg_seq,
+						NLM_F_MULTI) < 0)
+				goto done;
+next:
+			idx++;
+		}
+	}
+done:
+	rcu_read_unlock();
+
+	cb->args[0] = b;
+	cb->args[1] = idx;
+	return skb->len;
+}
+
+static int name_diag_rcv_msg(struct sk_buff *skb, struct nlmsghdr *nlh)
+{
+	struct name_net *nn = name_pernet(sock_net(skb->sk));
+
+	if (!(nlh->nlmsg_flags & NLM_F_DUMP))
+		return -EOPNOTSUPP;
+
+	switch (nlh->nlmsg_type) {
+	case NAME_DIAG_GETSOCK:
+		if (nlmsg_len(nlh) < sizeof(struct name_diag_req))
+			return -EINVAL;
+		return netlink_dump_start(nn->diag_nl, skb, nlh,
+					  name_diag_dump, NULL);
+	case NAME_DIAG_GETHIST:
+		return netlink_dump_start(nn->diag_nl, skb, nlh,
+					  name_diag_dump_hist, NULL);
+	default:
+		return -EINVAL;
+	}
+}
+
+static void name_diag_rcv(struct sk_buff *skb)
+{
+	mutex_lock(&name_diag_mutex);
+	netlink_rcv_skb(skb, &name_diag_rcv_msg);
+	mutex_unlock(&name_diag_mutex);
+}
+
+int name_diag_init(struct name_net *nn)
+{
+	int i;
+
+	rwlock_init(&nn->sklist_lock);
+	INIT_HLIST_HEAD(&nn->sklist);
+	spin_lock_init(&nn->hist_lock);
+	for (i = 0; i < NAME_HIST_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&nn->hist_hash[i]);
+
+	nn->diag_nl = netlink_kernel_create(nn->net,
+					    NETLINK_NAME_ORIENTED_STACK, 0,
+					    name_diag_rcv, NULL, THIS_MODULE);
+	if (!nn->diag_nl)
+		return -ENOMEM;
+	return 0;
+}
+
+void name_diag_exit(struct name_net *nn)
+{
+	struct hlist_node *node, *tmp;
+	struct name_hist *h;
+	int i;
+
+	netlink_kernel_release(nn->diag_nl);
+
+	/* No socket of the namespace is left to point to the histograms */
+	for (i = 0; i < NAME_HIST_HASH_SIZE; i++)
+		hlist_for_each_entry_safe(h, node, tmp, &nn->hist_hash[i],
+					  hlist)
+			kfree(h);
+}
+
+MODULE_ALIAS_NET_PF_PROTO(PF_NETLINK, NETLINK_NAME_ORIENTED_STACK);
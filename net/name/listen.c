@@ -0,0 +1,500 @@
+/*
+ * Name-oriented sockets: listening SOCK_STREAM sockets
+ *
+ * bind() resolves a name to the local addresses it stands for and binds a
+ * kernel TCP socket to each of them, and listen() makes them all listen.
+ * Established connections are taken off the listeners' accept queues as
+ * soon as they are reported, onto a queue of the CPU they arrived on.
+ * accept() serves the queue of its own CPU first and then the others, so
+ * that many accepting threads take neither the AF_NAME socket lock nor
+ * that of a listener.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/in.h>
+#include <linux/in6.h>
+#include <linux/ipv6.h>
+#include <linux/net.h>
+#include <linux/percpu.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <net/inet_connection_sock.h>
+#include <net/inet_sock.h>
+#include <net/request_sock.h>
+#include <net/sock.h>
+#include <net/tcp_states.h>
+
+#include "af_name.h"
+
+/*
+ * Move the connections waiting on the accept queue of the listening
+ * transport @nt to the queue of this CPU.  Called in softirq context with
+ * the listener locked.
+ */
+static void name_listen_data_ready(struct name_transport *nt)
+{
+	struct sock *tsk = nt->sock->sk;
+	struct sock *sk = nt->owner;
+	struct request_sock_queue *queue = &inet_csk(tsk)->icsk_accept_queue;
+	struct name_accept_queue *aq;
+	struct request_sock *req;
+
+	if (tsk->sk_state != TCP_LISTEN)
+		return;
+
+	aq = per_cpu_ptr(name_stream_sk(sk)->accept_queues, smp_processor_id());
+	spin_lock(&aq->lock);
+	while (!reqsk_queue_empty(queue) && aq->qlen < sk->sk_max_ack_backlog) {
+		req = reqsk_queue_remove(queue);
+		sk_acceptq_removed(tsk);
+		name_transport_unclone(nt, req->sk);
+
+		req->dl_next = NULL;
+		if (aq->tail)
+			aq->tail->dl_next = req;
+		else
+			aq->head = req;
+		aq->tail = req;
+		aq->qlen++;
+	}
+	spin_unlock(&aq->lock);
+}
+
+static const struct name_transport_ops name_listen_transport_ops = {
+	.data_ready	= name_listen_data_ready,
+};
+
+static struct request_sock *name_accept_queue_pop(struct name_accept_queue *aq)
+{
+	struct request_sock *req;
+
+	spin_lock_bh(&aq->lock);
+	req = aq->head;
+	if (req) {
+		aq->head = req->dl_next;
+		if (!aq->head)
+			aq->tail = NULL;
+		aq->qlen--;
+	}
+	spin_unlock_bh(&aq->lock);
+	return req;
+}
+
+/*
+ * Take a connection off the queue of this CPU, failing that off those of
+ * the other CPUs, and finally off the listeners if their connections did
+ * not fit on the queues.
+ */
+static struct request_sock *name_accept_dequeue(struct sock *sk)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	struct name_accept_queue *aq;
+	struct request_sock_queue *queue;
+	struct name_transport *nt;
+	struct request_sock *req;
+	int this, cpu;
+
+	this = raw_smp_processor_id();
+	aq = per_cpu_ptr(name->accept_queues, this);
+	if (aq->head) {
+		req = name_accept_queue_pop(aq);
+		if (req)
+			return req;
+	}
+
+	for_each_possible_cpu(cpu) {
+		if (cpu == this)
+			continue;
+		aq = per_cpu_ptr(name->accept_queues, cpu);
+		if (aq->head) {
+			req = name_accept_queue_pop(aq);
+			if (req)
+				return req;
+		}
+	}
+
+	list_for_each_entry(nt, &name->listeners, list) {
+		queue = &inet_csk(nt->sock->sk)->icsk_accept_queue;
+		if (reqsk_queue_empty(queue))
+			continue;
+
+		req = NULL;
+		lock_sock(nt->sock->sk);
+		if (!reqsk_queue_empty(queue)) {
+			req = reqsk_queue_remove(queue);
+			sk_acceptq_removed(nt->sock->sk);
+			name_transport_unclone(nt, req->sk);
+		}
+		release_sock(nt->sock->sk);
+		if (req)
+			return req;
+	}
+	return NULL;
+}
+
+static int name_accept_pending(struct sock *sk)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	struct name_transport *nt;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (per_cpu_ptr(name->accept_queues, cpu)->head)
+			return 1;
+	}
+	list_for_each_entry(nt, &name->listeners, list) {
+		if (!reqsk_queue_empty(&inet_csk(nt->sock->sk)->icsk_accept_queue))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Close a connection that was accepted by a listener but will not be
+ * handed out, as inet_csk_listen_stop() does.
+ */
+static void name_accept_drop(struct sock *child)
+{
+	local_bh_disable();
+	bh_lock_sock(child);
+	WARN_ON(sock_owned_by_user(child));
+	sock_hold(child);
+
+	child->sk_prot->disconnect(child, O_NONBLOCK);
+	sock_orphan(child);
+	atomic_inc(child->sk_prot->orphan_count);
+	inet_csk_destroy_sock(child);
+
+	bh_unlock_sock(child);
+	local_bh_enable();
+	sock_put(child);
+}
+
+/*
+ * An accepted connection has no name; its peer is named by its address.
+ */
+static void name_accept_peer(struct sock *child, struct name_addr *dname)
+{
+	struct inet_sock *inet = inet_sk(child);
+
+	memset(dname, 0, sizeof(*dname));
+	if (child->sk_family == AF_INET)
+		snprintf(dname->name, sizeof(dname->name), NIPQUAD_FMT,
+			 NIPQUAD(inet->daddr));
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	else
+		snprintf(dname->name, sizeof(dname->name), NIP6_FMT,
+			 NIP6(inet6_sk(child)->daddr));
+#endif
+}
+
+/*
+ * Make @child, a connection accepted by one of the listeners of @sk, the
+ * transport of a new AF_NAME socket grafted onto @newsock.  @child is
+ * closed if that fails.
+ */
+static int name_accept_graft(struct sock *sk, struct sock *child,
+			     struct socket *newsock)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	struct name_stream_sock *newname;
+	struct name_transport *lnt, *nt;
+	struct socket *tsock;
+	struct sock *newsk;
+	int err;
+
+	/* The transport gets the ops of the listener it came from */
+	list_for_each_entry(lnt, &name->listeners, list) {
+		if (lnt->sock->sk->sk_family == child->sk_family)
+			break;
+	}
+
+	err = sock_create_lite(child->sk_family, SOCK_STREAM, IPPROTO_TCP,
+			       &tsock);
+	if (err < 0)
+		goto drop;
+	tsock->ops = lnt->sock->ops;
+	__module_get(tsock->ops->owner);
+
+	err = -ENOMEM;
+	newsk = sk_alloc(sock_net(sk), PF_NAME, GFP_KERNEL, &name_stream_proto);
+	if (!newsk) {
+		sock_release(tsock);
+		goto drop;
+	}
+	sock_init_data(newsock, newsk);
+	newsk->sk_protocol = IPPROTO_TCP;
+	newsk->sk_prot->init(newsk);
+
+	lock_sock(child);
+	sock_graft(child, tsock);
+	tsock->state = SS_CONNECTED;
+	release_sock(child);
+
+	err = name_transport_attach(newsk, tsock, &name_stream_transport_ops,
+				    &nt);
+	if (err) {
+		sock_release(tsock);
+		return err;
+	}
+
+	newname = name_stream_sk(newsk);
+	newname->sname = name->sname;
+	newname->sport = name->sport;
+	name_accept_peer(child, &newname->dname);
+	newname->dport = inet_sk(child)->dport;
+	newname->transport = nt;
+
+	newsk->sk_state = TCP_ESTABLISHED;
+	if (child->sk_state == TCP_CLOSE)
+		newsk->sk_state = TCP_CLOSE;
+	newsock->state = SS_CONNECTED;
+	return 0;
+
+drop:
+	name_accept_drop(child);
+	return err;
+}
+
+static int name_accept_wait(struct sock *sk, long timeo,
+			    struct request_sock **reqp)
+{
+	DEFINE_WAIT(wait);
+	int err;
+
+	for (;;) {
+		prepare_to_wait_exclusive(sk->sk_sleep, &wait,
+					  TASK_INTERRUPTIBLE);
+		*reqp = name_accept_dequeue(sk);
+		err = 0;
+		if (*reqp)
+			break;
+		err = -EINVAL;
+		if (sk->sk_state != TCP_LISTEN)
+			break;
+		err = sock_intr_errno(timeo);
+		if (signal_pending(current))
+			break;
+		err = -EAGAIN;
+		if (!timeo)
+			break;
+		timeo = schedule_timeout(timeo);
+	}
+	finish_wait(sk->sk_sleep, &wait);
+	return err;
+}
+
+/*
+ * Unlike inet_csk_accept(), this does not lock the socket: the per-cpu
+ * queues have locks of their own, and the listeners only change while
+ * the socket is not listening.
+ */
+int name_stream_accept(struct socket *sock, struct socket *newsock, int flags)
+{
+	struct sock *sk = sock->sk;
+	struct request_sock *req;
+	struct sock *child;
+	int err;
+
+	if (sk->sk_state != TCP_LISTEN)
+		return -EINVAL;
+
+	req = name_accept_dequeue(sk);
+	if (!req) {
+		err = name_accept_wait(sk, sock_rcvtimeo(sk, flags & O_NONBLOCK),
+				       &req);
+		if (err)
+			return err;
+	}
+
+	child = req->sk;
+	__reqsk_free(req);
+	return name_accept_graft(sk, child, newsock);
+}
+
+unsigned int name_listen_poll(struct sock *sk)
+{
+	return name_accept_pending(sk) ? POLLIN | POLLRDNORM : 0;
+}
+
+/*
+ * Bind a listener to the local address @rr and the port of @sk.
+ * Called with the socket locked.
+ */
+static int name_listen_bind_rr(struct sock *sk, const struct name_rr *rr)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	struct sockaddr_storage addr;
+	struct name_transport *nt;
+	int addrlen, one = 1, err;
+
+	err = name_transport_create(sk, rr->family, SOCK_STREAM, IPPROTO_TCP,
+				    &name_listen_transport_ops, &nt);
+	if (err)
+		return err;
+	nt->sock->sk->sk_reuse = sk->sk_reuse;
+
+	/* Leave IPv4 to the IPv4 listeners */
+	if (rr->family == AF_INET6) {
+		err = kernel_setsockopt(nt->sock, IPPROTO_IPV6, IPV6_V6ONLY,
+					(char *)&one, sizeof(one));
+		if (err)
+			goto out_put;
+	}
+
+	addrlen = name_rr_to_sockaddr(rr, name->sport, &addr);
+	err = kernel_bind(nt->sock, (struct sockaddr *)&addr, addrlen);
+	if (err)
+		goto out_put;
+
+	/* The other addresses get the port the first one was given */
+	if (!name->sport)
+		name->sport = inet_sk(nt->sock->sk)->sport;
+
+	list_add_tail(&nt->list, &name->listeners);
+	return 0;
+
+out_put:
+	name_transport_put(nt);
+	return err;
+}
+
+/*
+ * Binding to a name binds to those of its addresses that are local;
+ * binding to the empty name binds to the IPv4 and IPv6 wildcards.
+ */
+int name_stream_bind(struct socket *sock, struct sockaddr *uaddr,
+		     int addr_len)
+{
+	struct sockaddr_name *sname = (struct sockaddr_name *)uaddr;
+	struct sock *sk = sock->sk;
+	struct name_stream_sock *name = name_stream_sk(sk);
+	struct name_rr rr[NAME_RESOLVE_MAX_ADDRS];
+	int i, n, bound, err;
+
+	if (addr_len < offsetof(struct sockaddr_name, sname_addr) + 1)
+		return -EINVAL;
+	if (sname->sname_family != AF_NAME)
+		return -EAFNOSUPPORT;
+
+	if (sname->sname_addr.name[0] == '\0') {
+		memset(rr, 0, 2 * sizeof(*rr));
+		rr[0].family = AF_INET6;
+		rr[1].family = AF_INET;
+		n = 2;
+	} else {
+		err = name_check_sockaddr(sname, addr_len);
+		if (err)
+			return err;
+		n = name_resolve_wait(sock_net(sk), sname->sname_addr.name, rr,
+				      NAME_RESOLVE_MAX_ADDRS);
+		if (n < 0)
+			return n;
+	}
+
+	lock_sock(sk);
+	err = -EINVAL;
+	if (sock->state != SS_UNCONNECTED || sk->sk_state != TCP_CLOSE ||
+	    !list_empty(&name->listeners))
+		goto out;
+
+	memset(&name->sname, 0, sizeof(name->sname));
+	strcpy(name->sname.name, sname->sname_addr.name);
+	name->sport = sname->sname_port;
+
+	bound = 0;
+	err = 0;
+	for (i = 0; i < n && !err; i++) {
+		err = name_listen_bind_rr(sk, &rr[i]);
+		if (!err)
+			bound++;
+		else if (err == -EADDRNOTAVAIL || err == -EAFNOSUPPORT)
+			err = 0;	/* not ours, or no such family here */
+	}
+	if (!err && !bound)
+		err = -EADDRNOTAVAIL;
+	if (err) {
+		name_listen_release(sk);
+		name->sport = 0;
+	}
+out:
+	release_sock(sk);
+	return err;
+}
+
+int name_stream_listen(struct socket *sock, int backlog)
+{
+	struct sock *sk = sock->sk;
+	struct name_stream_sock *name = name_stream_sk(sk);
+	struct name_transport *nt;
+	int cpu, err;
+
+	lock_sock(sk);
+	err = -EINVAL;
+	if (sock->state != SS_UNCONNECTED || list_empty(&name->listeners))
+		goto out;
+
+	if (!name->accept_queues) {
+		err = -ENOMEM;
+		name->accept_queues = alloc_percpu(struct name_accept_queue);
+		if (!name->accept_queues)
+			goto out;
+		for_each_possible_cpu(cpu)
+			spin_lock_init(&per_cpu_ptr(name->accept_queues,
+						    cpu)->lock);
+	}
+
+	/* Each per-cpu queue may hold a backlog of its own */
+	sk->sk_max_ack_backlog = backlog;
+	list_for_each_entry(nt, &name->listeners, list) {
+		err = kernel_listen(nt->sock, backlog);
+		if (err)
+			goto out;
+	}
+	sk->sk_state = TCP_LISTEN;
+	err = 0;
+out:
+	release_sock(sk);
+	return err;
+}
+
+/*
+ * Close the listeners of @sk and the connections still queued on it.
+ * Called with the socket locked.
+ */
+void name_listen_release(struct sock *sk)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	struct name_transport *nt, *tmp;
+	struct name_accept_queue *aq;
+	struct request_sock *req;
+	int cpu;
+
+	/* Once detached, the listeners queue no more connections */
+	list_for_each_entry(nt, &name->listeners, list)
+		name_transport_detach(nt);
+
+	if (name->accept_queues) {
+		for_each_possible_cpu(cpu) {
+			aq = per_cpu_ptr(name->accept_queues, cpu);
+			while ((req = aq->head) != NULL) {
+				aq->head = req->dl_next;
+				name_accept_drop(req->sk);
+				__reqsk_free(req);
+			}
+		}
+		free_percpu(name->accept_queues);
+		name->accept_queues = NULL;
+	}
+
+	list_for_each_entry_safe(nt, tmp, &name->listeners, list) {
+		list_del_init(&nt->list);
+		name_transport_put(nt);
+	}
+}
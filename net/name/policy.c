@@ -0,0 +1,235 @@
+/*
+ * Name-oriented sockets: spreading connects over the addresses of a name
+ *
+ * When a name resolves to several addresses, the policy of the socket
+ * decides the order its connect tries them in, and so which of them the
+ * connection most likely ends up on.  Policies are kept in a table indexed
+ * by the NAME_POLICY socket option; each orders the addresses in place,
+ * and the connection race then alternates between address families from
+ * the first address on.
+ *
+ * For NAME_POLICY_LEAST_CONN each network namespace counts the transports
+ * connecting or connected to every address, across all AF_NAME sockets.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/in6.h>
+#include <linux/jhash.h>
+#include <linux/net.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <net/net_namespace.h>
+
+#include "af_name.h"
+
+struct name_policy {
+	void		(*order)(struct name_net *nn, const char *name,
+				 struct name_rr *rr, int n);
+};
+
+static struct hlist_head *name_load_bucket(struct name_net *nn,
+					   const struct name_rr *rr)
+{
+	u32 hash;
+
+	if (rr->family == AF_INET)
+		hash = jhash_1word((__force u32)rr->addr.a4, 0);
+	else
+		hash = jhash2((__force u32 *)rr->addr.a6.s6_addr32, 4, 0);
+	return &nn->load_hash[hash & (NAME_LOAD_HASH_SIZE - 1)];
+}
+
+/*
+ * Number of transports connecting or connected to @rr.
+ */
+static int name_load_count(struct name_net *nn, const struct name_rr *rr)
+{
+	struct name_load *load;
+	struct hlist_node *node;
+	int count = 0;
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(load, node, name_load_bucket(nn, rr), hlist) {
+		if (name_rr_equal(&load->rr, rr)) {
+			count = atomic_read(&load->refcnt);
+			break;
+		}
+	}
+	rcu_read_unlock();
+	return count;
+}
+
+/**
+ * name_load_get - account a transport to an address
+ * @net: network namespace of the transport
+ * @rr: address the transport connects to
+ *
+ * Returns the load entry of @rr with a reference for the transport to put
+ * with name_load_put() when it goes, or NULL if there is no memory to
+ * count it with.
+ */
+struct name_load *name_load_get(struct net *net, const struct name_rr *rr)
+{
+	struct name_net *nn = name_pernet(net);
+	struct hlist_head *head = name_load_bucket(nn, rr);
+	struct name_load *load;
+	struct hlist_node *node;
+
+	spin_lock_bh(&nn->load_lock);
+	hlist_for_each_entry(load, node, head, hlist) {
+		if (name_rr_equal(&load->rr, rr)) {
+			atomic_inc(&load->refcnt);
+			goto out;
+		}
+	}
+
+	load = kmalloc(sizeof(*load), GFP_ATOMIC);
+	if (load) {
+		load->nn = nn;
+		atomic_set(&load->refcnt, 1);
+		load->rr = *rr;
+		hlist_add_head_rcu(&load->hlist, head);
+	}
+out:
+	spin_unlock_bh(&nn->load_lock);
+	return load;
+}
+
+static void name_load_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct name_load, rcu));
+}
+
+void name_load_put(struct name_load *load)
+{
+	struct name_net *nn = load->nn;
+
+	local_bh_disable();
+	if (atomic_dec_and_lock(&load->refcnt, &nn->load_lock)) {
+		hlist_del_rcu(&load->hlist);
+		spin_unlock(&nn->load_lock);
+		call_rcu(&load->rcu, name_load_free_rcu);
+	}
+	local_bh_enable();
+}
+
+static void name_policy_rotate(struct name_rr *rr, int n, int first)
+{
+	struct name_rr tmp[NAME_RESOLVE_MAX_ADDRS];
+
+	memcpy(tmp, rr, n * sizeof(*rr));
+	memcpy(rr, tmp + first, (n - first) * sizeof(*rr));
+	memcpy(rr + n - first, tmp, first * sizeof(*rr));
+}
+
+/*
+ * Successive connects to a name start at successive addresses.  Names
+ * share their position with the others of their hash slot, which keeps
+ * the state small at the price of an occasional skipped address.
+ */
+static void name_policy_round_robin(struct name_net *nn, const char *name,
+				    struct name_rr *rr, int n)
+{
+	atomic_t *next;
+	unsigned int first;
+
+	next = &nn->rr_next[name_hash(name, strlen(name)) %
+			    NAME_POLICY_RR_SLOTS];
+	first = atomic_inc_return(next) - 1;
+	name_policy_rotate(rr, n, first % n);
+}
+
+/*
+ * Draw the addresses at random, each in proportion to its weight among
+ * those not drawn yet.
+ */
+static void name_policy_weighted(struct name_net *nn, const char *name,
+				 struct name_rr *rr, int n)
+{
+	struct name_rr tmp;
+	u32 total = 0, r;
+	int i, k;
+
+	for (i = 0; i < n; i++)
+		total += rr[i].weight ? : 1;
+
+	for (k = 0; k < n - 1; k++) {
+		r = net_random() % total;
+		for (i = k; i < n - 1; i++) {
+			if (r < (rr[i].weight ? : 1))
+				break;
+			r -= rr[i].weight ? : 1;
+		}
+		total -= rr[i].weight ? : 1;
+		tmp = rr[k];
+		rr[k] = rr[i];
+		rr[i] = tmp;
+	}
+}
+
+/*
+ * Try the addresses with the fewest outstanding connections first,
+ * keeping the resolver order among equally loaded ones.
+ */
+static void name_policy_least_conn(struct name_net *nn, const char *name,
+				   struct name_rr *rr, int n)
+{
+	int count[NAME_RESOLVE_MAX_ADDRS];
+	struct name_rr tmp;
+	int i, j, c;
+
+	for (i = 0; i < n; i++)
+		count[i] = name_load_count(nn, &rr[i]);
+
+	for (i = 1; i < n; i++) {
+		tmp = rr[i];
+		c = count[i];
+		for (j = i; j > 0 && count[j - 1] > c; j--) {
+			rr[j] = rr[j - 1];
+			count[j] = count[j - 1];
+		}
+		rr[j] = tmp;
+		count[j] = c;
+	}
+}
+
+static const struct name_policy name_policies[NAME_POLICY_MAX + 1] = {
+	[NAME_POLICY_ORDER] = { },
+	[NAME_POLICY_ROUND_ROBIN] = { .order = name_policy_round_robin },
+	[NAME_POLICY_WEIGHTED] = { .order = name_policy_weighted },
+	[NAME_POLICY_LEAST_CONN] = { .order = name_policy_least_conn },
+};
+
+/**
+ * name_policy_order - order the addresses of a name for a connect
+ * @net: network namespace of the connecting socket
+ * @policy: NAME_POLICY_* of the socket
+ * @name: the name
+ * @rr: its addresses, ordered in place
+ * @n: number of addresses
+ */
+void name_policy_order(struct net *net, int policy, const char *name,
+		       struct name_rr *rr, int n)
+{
+	const struct name_policy *p = &name_policies[policy];
+
+	if (n > 1 && p->order)
+		p->order(name_pernet(net), name, rr, n);
+}
+
+void name_policy_init(struct name_net *nn)
+{
+	int i;
+
+	spin_lock_init(&nn->load_lock);
+	for (i = 0; i < NAME_LOAD_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&nn->load_hash[i]);
+	for (i = 0; i < NAME_POLICY_RR_SLOTS; i++)
+		atomic_set(&nn->rr_next[i], 0);
+}
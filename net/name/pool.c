@@ -0,0 +1,347 @@
+/*
+ * Name-oriented sockets: pools of pre-established connections
+ *
+ * A stream socket that asks for a pool, or any socket when
+ * net.name.pool_size is set, makes its namespace keep that many idle TCP
+ * connections to its name and port.  connect() then takes one of them,
+ * if one is established, instead of resolving the name and waiting for
+ * a handshake, and the pool opens a replacement in the background.
+ *
+ * Idle connections run TCP keepalive, so that tcp_keepalive_timer()
+ * reaps those whose peer went away.  Connections idle for longer than
+ * net.name.pool_idle_ttl are closed by the pool's sweep, and a pool that
+ * no connect used for as long drains and goes away.  Connections hold
+ * their namespace like any socket, so it outlives its last user process
+ * until its pools have drained.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/in.h>
+#include <linux/mutex.h>
+#include <linux/net.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/tcp.h>
+#include <net/sock.h>
+#include <net/tcp_states.h>
+
+#include "af_name.h"
+
+/* Keepalive of idle connections: dead peers go within 30 seconds */
+#define NAME_POOL_KEEPIDLE	15	/* seconds */
+#define NAME_POOL_KEEPINTVL	5	/* seconds */
+#define NAME_POOL_KEEPCNT	3
+
+struct name_pool {
+	struct list_head	list;		/* on nn->pools */
+	struct name_addr	name;
+	__be16			port;
+	unsigned int		target;		/* idle connections to keep */
+	unsigned int		count;		/* connections on @conns */
+	unsigned long		used;		/* by the last connect */
+	unsigned int		next;		/* address to connect next */
+	struct list_head	conns;
+};
+
+struct name_pool_conn {
+	struct list_head	list;
+	struct socket		*sock;
+	unsigned long		since;
+};
+
+struct name_pool_resolve {
+	struct name_resolve_req	req;
+	struct name_net		*nn;
+};
+
+static struct name_pool *name_pool_find(struct name_net *nn, const char *name,
+					__be16 port)
+{
+	struct name_pool *pool;
+
+	list_for_each_entry(pool, &nn->pools, list) {
+		if (pool->port == port && !strnicmp(pool->name.name, name,
+						   sizeof(pool->name.name)))
+			return pool;
+	}
+	return NULL;
+}
+
+/*
+ * Whether an idle connection can be handed to a connect.
+ */
+static int name_pool_usable(struct sock *tsk)
+{
+	return tsk->sk_state == TCP_ESTABLISHED && !tsk->sk_err &&
+	       !(tsk->sk_shutdown & RCV_SHUTDOWN) &&
+	       skb_queue_empty(&tsk->sk_receive_queue);
+}
+
+static void name_pool_setsockopt(struct socket *sock, int level, int optname,
+				 int val)
+{
+	kernel_setsockopt(sock, level, optname, (char *)&val, sizeof(val));
+}
+
+/**
+ * name_pool_get - take an established connection from a pool
+ * @net: namespace of the connecting socket
+ * @name: name connected to
+ * @port: port connected to
+ * @size: number of idle connections the pool is to keep
+ *
+ * Creates the pool of @name and @port if there is none and sets its size
+ * to @size.  Returns an established TCP kernel socket whose callbacks are
+ * its own, or NULL if the pool has none, and has the pool replace it.
+ */
+struct socket *name_pool_get(struct net *net, const char *name, __be16 port,
+			     unsigned int size)
+{
+	struct name_net *nn = name_pernet(net);
+	struct name_pool_conn *conn;
+	struct socket *sock = NULL;
+	struct name_pool *pool;
+
+	mutex_lock(&nn->pool_mutex);
+	pool = name_pool_find(nn, name, port);
+	if (!pool && nn->npools < NAME_POOL_MAX_POOLS) {
+		pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+		if (pool) {
+			strcpy(pool->name.name, name);
+			pool->port = port;
+			INIT_LIST_HEAD(&pool->conns);
+			list_add(&pool->list, &nn->pools);
+			nn->npools++;
+		}
+	}
+	if (!pool)
+		goto out;
+
+	pool->target = min_t(unsigned int, size, NAME_POOL_MAX);
+	pool->used = jiffies;
+	list_for_each_entry(conn, &pool->conns, list) {
+		if (name_pool_usable(conn->sock->sk)) {
+			list_del(&conn->list);
+			pool->count--;
+			sock = conn->sock;
+			kfree(conn);
+			break;
+		}
+	}
+out:
+	if (sock)
+		nn->pool_hits++;
+	else
+		nn->pool_misses++;
+	mutex_unlock(&nn->pool_mutex);
+
+	schedule_work(&nn->pool_fill_work);
+	if (sock)
+		name_pool_setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, 0);
+	return sock;
+}
+
+static void name_pool_resolved(struct name_resolve_req *req, int err,
+			       const struct name_rr *rr, int naddrs)
+{
+	struct name_pool_resolve *r;
+
+	r = container_of(req, struct name_pool_resolve, req);
+	if (!err)
+		schedule_work(&r->nn->pool_fill_work);
+	kfree(r);
+}
+
+/*
+ * Start a connection to @rr for @pool.  Called with the pool mutex held.
+ */
+static int name_pool_open(struct name_net *nn, struct name_pool *pool,
+			  const struct name_rr *rr)
+{
+	struct name_pool_conn *conn;
+	struct sockaddr_storage addr;
+	struct socket *sock;
+	int addrlen, err;
+
+	conn = kmalloc(sizeof(*conn), GFP_KERNEL);
+	if (!conn)
+		return -ENOMEM;
+
+	err = __sock_create(nn->net, rr->family, SOCK_STREAM, IPPROTO_TCP,
+			    &sock, 1);
+	if (err < 0)
+		goto out_free;
+
+	name_pool_setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, 1);
+	name_pool_setsockopt(sock, SOL_TCP, TCP_KEEPIDLE, NAME_POOL_KEEPIDLE);
+	name_pool_setsockopt(sock, SOL_TCP, TCP_KEEPINTVL, NAME_POOL_KEEPINTVL);
+	name_pool_setsockopt(sock, SOL_TCP, TCP_KEEPCNT, NAME_POOL_KEEPCNT);
+
+	addrlen = name_rr_to_sockaddr(rr, pool->port, &addr);
+	err = kernel_connect(sock, (struct sockaddr *)&addr, addrlen,
+			     O_NONBLOCK);
+	if (err && err != -EINPROGRESS)
+		goto out_release;
+
+	conn->sock = sock;
+	conn->since = jiffies;
+	list_add_tail(&conn->list, &pool->conns);
+	pool->count++;
+	return 0;
+
+out_release:
+	sock_release(sock);
+out_free:
+	kfree(conn);
+	return err;
+}
+
+/*
+ * Open connections until @pool has as many as it is to keep, over the
+ * addresses of its name in turn.  Names that are not cached are looked
+ * up in the background, and the pool filled once they are.  Called with
+ * the pool mutex held.
+ */
+static void name_pool_fill(struct name_net *nn, struct name_pool *pool)
+{
+	struct name_rr rr[NAME_RESOLVE_MAX_ADDRS];
+	struct name_pool_resolve *r;
+	int n;
+
+	if (pool->count >= pool->target)
+		return;
+
+	r = kmalloc(sizeof(*r), GFP_KERNEL);
+	if (!r)
+		return;
+	r->req.done = name_pool_resolved;
+	r->nn = nn;
+
+	n = name_resolve(nn->net, pool->name.name, rr, NAME_RESOLVE_MAX_ADDRS,
+			 &r->req);
+	if (n == 0)
+		return;		/* name_pool_resolved() frees r */
+	kfree(r);
+
+	while (n > 0 && pool->count < pool->target) {
+		if (name_pool_open(nn, pool, &rr[pool->next++ % n]))
+			break;
+	}
+}
+
+/*
+ * Close the connections of @pool that failed, that are idle or have been
+ * connecting for too long, or all of them if the pool is no longer used.
+ * Called with the pool mutex held; the connections are moved to @reap.
+ */
+static void name_pool_sweep(struct name_net *nn, struct name_pool *pool,
+			    struct list_head *reap)
+{
+	unsigned long ttl = nn->sysctl_pool_idle_ttl;
+	int used = time_before(jiffies, pool->used + ttl);
+	struct name_pool_conn *conn, *tmp;
+	struct sock *tsk;
+
+	list_for_each_entry_safe(conn, tmp, &pool->conns, list) {
+		tsk = conn->sock->sk;
+		if (used && time_before(jiffies, conn->since + ttl) &&
+		    (name_pool_usable(tsk) || tsk->sk_state == TCP_SYN_SENT))
+			continue;
+		list_move(&conn->list, reap);
+		pool->count--;
+	}
+	if (!used)
+		pool->target = 0;
+}
+
+static void name_pool_run(struct name_net *nn)
+{
+	struct name_pool_conn *conn, *tmp;
+	struct name_pool *pool, *next;
+	LIST_HEAD(reap);
+	int more;
+
+	mutex_lock(&nn->pool_mutex);
+	list_for_each_entry_safe(pool, next, &nn->pools, list) {
+		name_pool_sweep(nn, pool, &reap);
+		if (!pool->target) {
+			if (!pool->count) {
+				list_del(&pool->list);
+				nn->npools--;
+				kfree(pool);
+			}
+			continue;
+		}
+		name_pool_fill(nn, pool);
+	}
+	more = !list_empty(&nn->pools);
+	mutex_unlock(&nn->pool_mutex);
+
+	list_for_each_entry_safe(conn, tmp, &reap, list) {
+		sock_release(conn->sock);
+		kfree(conn);
+	}
+
+	if (more)
+		schedule_delayed_work(&nn->pool_sweep_work, NAME_POOL_INTERVAL);
+}
+
+static void name_pool_fill_worker(struct work_struct *work)
+{
+	name_pool_run(container_of(work, struct name_net, pool_fill_work));
+}
+
+static void name_pool_sweep_worker(struct work_struct *work)
+{
+	name_pool_run(container_of(work, struct name_net,
+				   pool_sweep_work.work));
+}
+
+void name_pool_seq_show(struct seq_file *seq, struct name_net *nn)
+{
+	struct name_pool *pool;
+	unsigned int idle = 0;
+
+	mutex_lock(&nn->pool_mutex);
+	list_for_each_entry(pool, &nn->pools, list)
+		idle += pool->count;
+	seq_printf(seq, "pool: pools %u idle %u hits %lu misses %lu\n",
+		   nn->npools, idle, nn->pool_hits, nn->pool_misses);
+	mutex_unlock(&nn->pool_mutex);
+}
+
+void name_pool_init(struct name_net *nn)
+{
+	mutex_init(&nn->pool_mutex);
+	INIT_LIST_HEAD(&nn->pools);
+	INIT_WORK(&nn->pool_fill_work, name_pool_fill_worker);
+	INIT_DELAYED_WORK(&nn->pool_sweep_work, name_pool_sweep_worker);
+}
+
+/*
+ * No socket of the namespace is left to take from the pools, and no
+ * lookup or connection for them is outstanding as that would hold the
+ * namespace.
+ */
+void name_pool_exit(struct name_net *nn)
+{
+	struct name_pool_conn *conn, *tmp;
+	struct name_pool *pool, *next;
+
+	cancel_work_sync(&nn->pool_fill_work);
+	cancel_delayed_work_sync(&nn->pool_sweep_work);
+
+	list_for_each_entry_safe(pool, next, &nn->pools, list) {
+		list_for_each_entry_safe(conn, tmp, &pool->conns, list) {
+			sock_release(conn->sock);
+			kfree(conn);
+		}
+		kfree(pool);
+	}
+}
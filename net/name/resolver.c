@@ -0,0 +1,633 @@
+/*
+ * Name-oriented sockets: upcall resolver
+ *
+ * Names that are neither address literals nor cached are resolved by
+ * userspace daemons speaking the generic netlink protocol described in
+ * <linux/name_resolver.h>.  Queries are collected and sent to a daemon in
+ * batches by a work item, so that a burst of connects to cold names costs
+ * a few messages rather than one round trip per name, and all requests
+ * for a name share a single outstanding query.  Answers fill the name
+ * cache of the namespace that asked before the waiting requests are
+ * completed.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/netlink.h>
+#include <linux/notifier.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/workqueue.h>
+#include <linux/name_resolver.h>
+#include <net/genetlink.h>
+#include <net/net_namespace.h>
+
+#include "af_name.h"
+
+#define NAME_RESOLVER_TIMEOUT		(5 * HZ)
+#define NAME_RESOLVER_RETRY		(HZ / 10)
+#define NAME_RESOLVER_HASH_BITS		8
+#define NAME_RESOLVER_HASH_SIZE		(1 << NAME_RESOLVER_HASH_BITS)
+
+/*
+ * An outstanding query: unsent until the send worker has put it in a
+ * batch, then sent until answered or timed out.
+ */
+struct name_query {
+	struct list_head	list;		/* unsent or sent queue */
+	struct hlist_node	name_node;
+	struct hlist_node	id_node;
+	u32			id;
+	u32			pid;		/* daemon it was sent to */
+	unsigned long		expires;
+	struct net		*net;
+	struct list_head	reqs;		/* struct name_resolve_req */
+	char			name[sizeof(struct name_addr)];
+};
+
+struct name_resolver_daemon {
+	struct list_head	list;
+	u32			pid;
+};
+
+static DEFINE_SPINLOCK(name_resolver_lock);
+static LIST_HEAD(name_queries_unsent);
+static LIST_HEAD(name_queries_sent);
+static struct hlist_head name_queries_by_name[NAME_RESOLVER_HASH_SIZE];
+static struct hlist_head name_queries_by_id[NAME_RESOLVER_HASH_SIZE];
+static u32 name_query_next_id;
+static LIST_HEAD(name_resolver_daemons);
+
+static struct {
+	unsigned int	daemons;
+	unsigned int	pending;
+	unsigned long	queries;
+	unsigned long	shared;
+	unsigned long	batches;
+	unsigned long	answers;
+	unsigned long	timeouts;
+} name_resolver_stats;
+
+static void name_resolver_send(struct work_struct *work);
+static void name_resolver_expire(struct work_struct *work);
+static DECLARE_DELAYED_WORK(name_resolver_send_work, name_resolver_send);
+static DECLARE_DELAYED_WORK(name_resolver_expire_work, name_resolver_expire);
+
+static struct genl_family name_resolver_family = {
+	.id		= GENL_ID_GENERATE,
+	.name		= NAME_RESOLVER_GENL_NAME,
+	.version	= NAME_RESOLVER_GENL_VERSION,
+	.maxattr	= NAME_RESOLVER_A_MAX,
+};
+
+static inline struct hlist_head *name_query_name_bucket(const char *name)
+{
+	u32 hash = name_hash(name, strlen(name));
+
+	return &name_queries_by_name[hash & (NAME_RESOLVER_HASH_SIZE - 1)];
+}
+
+static inline struct hlist_head *name_query_id_bucket(u32 id)
+{
+	return &name_queries_by_id[id & (NAME_RESOLVER_HASH_SIZE - 1)];
+}
+
+static struct name_query *__name_query_find(struct net *net, const char *name)
+{
+	struct name_query *q;
+	struct hlist_node *node;
+
+	hlist_for_each_entry(q, node, name_query_name_bucket(name), name_node) {
+		if (net_eq(q->net, net) &&
+		    !strnicmp(q->name, name, sizeof(q->name)))
+			return q;
+	}
+	return NULL;
+}
+
+static struct name_query *__name_query_find_id(u32 id)
+{
+	struct name_query *q;
+	struct hlist_node *node;
+
+	hlist_for_each_entry(q, node, name_query_id_bucket(id), id_node) {
+		if (q->id == id)
+			return q;
+	}
+	return NULL;
+}
+
+static void __name_query_unlink(struct name_query *q)
+{
+	list_del(&q->list);
+	hlist_del(&q->name_node);
+	hlist_del(&q->id_node);
+	name_resolver_stats.pending--;
+}
+
+/*
+ * Complete all requests waiting on an unlinked query and free it.
+ * Must be called in process context without the resolver lock.
+ */
+static void name_query_complete(struct name_query *q, int err,
+				const struct name_rr *addrs, int naddrs)
+{
+	struct name_resolve_req *req;
+
+	/* Requests are taken off under the lock, see name_resolver_cancel() */
+	spin_lock_bh(&name_resolver_lock);
+	while (!list_empty(&q->reqs)) {
+		req = list_first_entry(&q->reqs, struct name_resolve_req, list);
+		list_del_init(&req->list);
+		spin_unlock_bh(&name_resolver_lock);
+
+		req->done(req, err, addrs, naddrs);
+
+		spin_lock_bh(&name_resolver_lock);
+	}
+	spin_unlock_bh(&name_resolver_lock);
+
+	put_net(q->net);
+	kfree(q);
+}
+
+static void name_query_complete_list(struct list_head *head, int err)
+{
+	struct name_query *q, *tmp;
+
+	list_for_each_entry_safe(q, tmp, head, list) {
+		list_del(&q->list);
+		name_query_complete(q, err, NULL, 0);
+	}
+}
+
+/**
+ * name_resolver_query - ask the resolver daemons for a name
+ * @net: namespace whose cache the answer goes to
+ * @name: NUL-terminated name
+ * @req: request to complete, or %NULL
+ *
+ * Queues @req on the outstanding query for @name, creating one if there is
+ * none.  @req->done is called in process context once the query has been
+ * answered or has failed; it is never called before this function has
+ * returned.  Without @req the query is only made sure to be outstanding,
+ * for its answer to be cached.  Returns -EHOSTUNREACH if no daemon is
+ * registered.
+ */
+int name_resolver_query(struct net *net, const char *name,
+			struct name_resolve_req *req)
+{
+	struct name_query *q, *new = NULL;
+
+	for (;;) {
+		spin_lock_bh(&name_resolver_lock);
+		if (list_empty(&name_resolver_daemons)) {
+			spin_unlock_bh(&name_resolver_lock);
+			kfree(new);
+			return -EHOSTUNREACH;
+		}
+
+		q = __name_query_find(net, name);
+		if (q) {
+			if (req)
+				list_add_tail(&req->list, &q->reqs);
+			name_resolver_stats.shared++;
+			spin_unlock_bh(&name_resolver_lock);
+			kfree(new);
+			return 0;
+		}
+		if (new)
+			break;
+		spin_unlock_bh(&name_resolver_lock);
+
+		new = kzalloc(sizeof(*new), GFP_KERNEL);
+		if (!new)
+			return -ENOMEM;
+		strlcpy(new->name, name, sizeof(new->name));
+		INIT_LIST_HEAD(&new->reqs);
+	}
+
+	q = new;
+	do {
+		q->id = ++name_query_next_id;
+	} while (!q->id || __name_query_find_id(q->id));
+	q->net = get_net(net);
+	if (req)
+		list_add_tail(&req->list, &q->reqs);
+	list_add_tail(&q->list, &name_queries_unsent);
+	hlist_add_head(&q->name_node, name_query_name_bucket(name));
+	hlist_add_head(&q->id_node, name_query_id_bucket(q->id));
+	name_resolver_stats.pending++;
+	name_resolver_stats.queries++;
+	spin_unlock_bh(&name_resolver_lock);
+
+	schedule_delayed_work(&name_resolver_send_work, 0);
+	return 0;
+}
+
+/**
+ * name_resolver_cancel - take a request off its query
+ * @req: request queued by name_resolver_query()
+ *
+ * Returns 1 if @req was taken off and will not be completed, or 0 if its
+ * query has been answered or has failed and @req->done has been or is
+ * about to be called.
+ */
+int name_resolver_cancel(struct name_resolve_req *req)
+{
+	int cancelled;
+
+	spin_lock_bh(&name_resolver_lock);
+	cancelled = !list_empty(&req->list);
+	if (cancelled)
+		list_del_init(&req->list);
+	spin_unlock_bh(&name_resolver_lock);
+
+	return cancelled;
+}
+
+/*
+ * Build one batch from the head of the unsent queue and move the queries
+ * it carries to @batch.  Called with the resolver lock held.
+ */
+static int __name_resolver_fill(struct sk_buff *skb, struct list_head *batch)
+{
+	struct nlattr *queries, *nest;
+	struct name_query *q, *tmp;
+	void *hdr;
+
+	hdr = genlmsg_put(skb, 0, 0, &name_resolver_family, 0,
+			  NAME_RESOLVER_CMD_QUERY);
+	if (!hdr)
+		return -EMSGSIZE;
+
+	queries = nla_nest_start(skb, NAME_RESOLVER_A_QUERIES);
+	if (!queries)
+		goto nla_put_failure;
+
+	list_for_each_entry_safe(q, tmp, &name_queries_unsent, list) {
+		nest = nla_nest_start(skb, NAME_RESOLVER_A_QUERY);
+		if (!nest)
+			break;
+		if (nla_put_u32(skb, NAME_RESOLVER_Q_ID, q->id) ||
+		    nla_put_string(skb, NAME_RESOLVER_Q_NAME, q->name)) {
+			nla_nest_cancel(skb, nest);
+			break;
+		}
+		nla_nest_end(skb, nest);
+		list_move_tail(&q->list, batch);
+	}
+	if (list_empty(batch))
+		goto nla_put_failure;
+
+	nla_nest_end(skb, queries);
+	return genlmsg_end(skb, hdr);
+
+nla_put_failure:
+	genlmsg_cancel(skb, hdr);
+	return -EMSGSIZE;
+}
+
+static void __name_resolver_remove_daemon(u32 pid)
+{
+	struct name_resolver_daemon *d;
+	struct name_query *q, *tmp;
+
+	list_for_each_entry(d, &name_resolver_daemons, list) {
+		if (d->pid == pid) {
+			list_del(&d->list);
+			kfree(d);
+			name_resolver_stats.daemons--;
+			break;
+		}
+	}
+
+	/* Queries the daemon did not answer are sent again */
+	list_for_each_entry_safe(q, tmp, &name_queries_sent, list) {
+		if (q->pid == pid)
+			list_move_tail(&q->list, &name_queries_unsent);
+	}
+}
+
+static void name_resolver_send(struct work_struct *work)
+{
+	struct name_resolver_daemon *d;
+	struct name_query *q;
+	struct sk_buff *skb;
+	LIST_HEAD(batch);
+	LIST_HEAD(failed);
+	u32 pid;
+	int err, retry = 0;
+
+	for (;;) {
+		skb = nlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+
+		spin_lock_bh(&name_resolver_lock);
+		if (list_empty(&name_queries_unsent))
+			break;
+		if (list_empty(&name_resolver_daemons)) {
+			list_splice_init(&name_queries_unsent, &failed);
+			list_for_each_entry(q, &failed, list) {
+				hlist_del(&q->name_node);
+				hlist_del(&q->id_node);
+				name_resolver_stats.pending--;
+			}
+			break;
+		}
+		if (!skb) {
+			retry = 1;
+			break;
+		}
+
+		/* Spread the batches over the daemons */
+		d = list_first_entry(&name_resolver_daemons,
+				     struct name_resolver_daemon, list);
+		list_move_tail(&d->list, &name_resolver_daemons);
+		pid = d->pid;
+
+		/* A message always has room for at least one query */
+		err = __name_resolver_fill(skb, &batch);
+		if (WARN_ON(err < 0))
+			break;
+		list_for_each_entry(q, &batch, list) {
+			q->pid = pid;
+			q->expires = jiffies + NAME_RESOLVER_TIMEOUT;
+		}
+		list_splice_tail_init(&batch, &name_queries_sent);
+		name_resolver_stats.batches++;
+		spin_unlock_bh(&name_resolver_lock);
+
+		err = genlmsg_unicast(skb, pid);
+		if (err == -ECONNREFUSED) {
+			spin_lock_bh(&name_resolver_lock);
+			__name_resolver_remove_daemon(pid);
+			spin_unlock_bh(&name_resolver_lock);
+		}
+		/* Otherwise unanswered queries are left to time out */
+	}
+	spin_unlock_bh(&name_resolver_lock);
+	kfree_skb(skb);
+
+	name_query_complete_list(&failed, -EHOSTUNREACH);
+
+	/* Out of memory, leave it some time before trying again */
+	if (retry)
+		schedule_delayed_work(&name_resolver_send_work,
+				      NAME_RESOLVER_RETRY);
+	schedule_delayed_work(&name_resolver_expire_work, NAME_RESOLVER_TIMEOUT);
+}
+
+static void name_resolver_expire(struct work_struct *work)
+{
+	struct name_query *q, *tmp;
+	LIST_HEAD(expired);
+	int more;
+
+	spin_lock_bh(&name_resolver_lock);
+	list_for_each_entry_safe(q, tmp, &name_queries_sent, list) {
+		if (time_before(jiffies, q->expires))
+			break;
+		__name_query_unlink(q);
+		list_add_tail(&q->list, &expired);
+		name_resolver_stats.timeouts++;
+	}
+	more = !list_empty(&name_queries_sent);
+	spin_unlock_bh(&name_resolver_lock);
+
+	list_for_each_entry(q, &expired, list)
+		name_cache_insert_negative(q->net, q->name, -ETIMEDOUT);
+	name_query_complete_list(&expired, -ETIMEDOUT);
+
+	if (more)
+		schedule_delayed_work(&name_resolver_expire_work, HZ);
+}
+
+static const struct nla_policy name_resolver_policy[NAME_RESOLVER_A_MAX + 1] = {
+	[NAME_RESOLVER_A_QUERIES]	= { .type = NLA_NESTED },
+	[NAME_RESOLVER_A_ANSWERS]	= { .type = NLA_NESTED },
+};
+
+static const struct nla_policy name_answer_policy[NAME_RESOLVER_ANS_MAX + 1] = {
+	[NAME_RESOLVER_ANS_ID]		= { .type = NLA_U32 },
+	[NAME_RESOLVER_ANS_STATUS]	= { .type = NLA_U32 },
+	[NAME_RESOLVER_ANS_TTL]		= { .type = NLA_U32 },
+	[NAME_RESOLVER_ANS_WEIGHT]	= { .type = NLA_U32 },
+};
+
+static void name_resolver_answer_one(struct nlattr *answer)
+{
+	struct nlattr *tb[NAME_RESOLVER_ANS_MAX + 1];
+	struct name_rr addrs[NAME_RESOLVE_MAX_ADDRS], *last = NULL;
+	struct name_query *q;
+	struct nlattr *nla;
+	u32 status, ttl;
+	int naddrs = 0, rem, err;
+
+	if (nla_parse_nested(tb, NAME_RESOLVER_ANS_MAX, answer,
+			     name_answer_policy) < 0)
+		return;
+	if (!tb[NAME_RESOLVER_ANS_ID] || !tb[NAME_RESOLVER_ANS_STATUS])
+		return;
+
+	status = nla_get_u32(tb[NAME_RESOLVER_ANS_STATUS]);
+	ttl = tb[NAME_RESOLVER_ANS_TTL] ?
+		nla_get_u32(tb[NAME_RESOLVER_ANS_TTL]) : 0;
+
+	nla_for_each_nested(nla, answer, rem) {
+		switch (nla_type(nla)) {
+		case NAME_RESOLVER_ANS_INADDR:
+			last = NULL;
+			if (nla_len(nla) != sizeof(__be32) ||
+			    naddrs == NAME_RESOLVE_MAX_ADDRS)
+				continue;
+			last = &addrs[naddrs++];
+			last->family = AF_INET;
+			last->weight = 1;
+			memcpy(&last->addr.a4, nla_data(nla), sizeof(__be32));
+			break;
+		case NAME_RESOLVER_ANS_IN6ADDR:
+			last = NULL;
+			if (nla_len(nla) != sizeof(struct in6_addr) ||
+			    naddrs == NAME_RESOLVE_MAX_ADDRS)
+				continue;
+			last = &addrs[naddrs++];
+			last->family = AF_INET6;
+			last->weight = 1;
+			memcpy(&last->addr.a6, nla_data(nla),
+			       sizeof(struct in6_addr));
+			break;
+		case NAME_RESOLVER_ANS_WEIGHT:
+			if (last && nla_len(nla) == sizeof(u32))
+				last->weight = clamp_t(u32, nla_get_u32(nla),
+						       1, USHORT_MAX);
+			break;
+		}
+	}
+
+	spin_lock_bh(&name_resolver_lock);
+	q = __name_query_find_id(nla_get_u32(tb[NAME_RESOLVER_ANS_ID]));
+	if (q) {
+		__name_query_unlink(q);
+		name_resolver_stats.answers++;
+	}
+	spin_unlock_bh(&name_resolver_lock);
+	if (!q)
+		return;
+
+	if (status == NAME_RESOLVER_STATUS_OK && naddrs) {
+		name_cache_insert(q->net, q->name, addrs, naddrs, ttl);
+		err = 0;
+	} else {
+		err = -EHOSTUNREACH;
+		name_cache_insert_negative(q->net, q->name, err);
+	}
+
+	name_query_complete(q, err, addrs, err ? 0 : naddrs);
+}
+
+static int name_resolver_answer(struct sk_buff *skb, struct genl_info *info)
+{
+	struct nlattr *answer;
+	int rem;
+
+	if (!info->attrs[NAME_RESOLVER_A_ANSWERS])
+		return -EINVAL;
+
+	nla_for_each_nested(answer, info->attrs[NAME_RESOLVER_A_ANSWERS], rem) {
+		if (nla_type(answer) == NAME_RESOLVER_A_ANSWER)
+			name_resolver_answer_one(answer);
+	}
+	return 0;
+}
+
+static int name_resolver_register(struct sk_buff *skb, struct genl_info *info)
+{
+	struct name_resolver_daemon *d, *new;
+
+	new = kmalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+	new->pid = info->snd_pid;
+
+	spin_lock_bh(&name_resolver_lock);
+	list_for_each_entry(d, &name_resolver_daemons, list) {
+		if (d->pid == new->pid) {
+			spin_unlock_bh(&name_resolver_lock);
+			kfree(new);
+			return -EEXIST;
+		}
+	}
+	list_add_tail(&new->list, &name_resolver_daemons);
+	name_resolver_stats.daemons++;
+	spin_unlock_bh(&name_resolver_lock);
+	return 0;
+}
+
+static struct genl_ops name_resolver_ops[] = {
+	{
+		.cmd	= NAME_RESOLVER_CMD_REGISTER,
+		.flags	= GENL_ADMIN_PERM,
+		.policy	= name_resolver_policy,
+		.doit	= name_resolver_register,
+	},
+	{
+		.cmd	= NAME_RESOLVER_CMD_ANSWER,
+		.flags	= GENL_ADMIN_PERM,
+		.policy	= name_resolver_policy,
+		.doit	= name_resolver_answer,
+	},
+};
+
+static int name_resolver_netlink_event(struct notifier_block *this,
+				       unsigned long event, void *ptr)
+{
+	struct netlink_notify *n = ptr;
+
+	if (event == NETLINK_URELEASE &&
+	    n->protocol == NETLINK_GENERIC && n->pid) {
+		spin_lock_bh(&name_resolver_lock);
+		__name_resolver_remove_daemon(n->pid);
+		if (!list_empty(&name_queries_unsent))
+			schedule_delayed_work(&name_resolver_send_work, 0);
+		spin_unlock_bh(&name_resolver_lock);
+	}
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block name_resolver_notifier = {
+	.notifier_call	= name_resolver_netlink_event,
+};
+
+void name_resolver_seq_show(struct seq_file *seq)
+{
+	spin_lock_bh(&name_resolver_lock);
+	seq_printf(seq, "resolver: daemons %u pending %u queries %lu "
+		   "shared %lu batches %lu answers %lu timeouts %lu\n",
+		   name_resolver_stats.daemons, name_resolver_stats.pending,
+		   name_resolver_stats.queries, name_resolver_stats.shared,
+		   name_resolver_stats.batches, name_resolver_stats.answers,
+		   name_resolver_stats.timeouts);
+	spin_unlock_bh(&name_resolver_lock);
+}
+
+int __init name_resolver_init(void)
+{
+	int i, err;
+
+	for (i = 0; i < NAME_RESOLVER_HASH_SIZE; i++) {
+		INIT_HLIST_HEAD(&name_queries_by_name[i]);
+		INIT_HLIST_HEAD(&name_queries_by_id[i]);
+	}
+
+	err = genl_register_family(&name_resolver_family);
+	if (err)
+		return err;
+
+	for (i = 0; i < ARRAY_SIZE(name_resolver_ops); i++) {
+		err = genl_register_ops(&name_resolver_family,
+					&name_resolver_ops[i]);
+		if (err)
+			goto err_ops;
+	}
+
+	netlink_register_notifier(&name_resolver_notifier);
+	return 0;
+
+err_ops:
+	genl_unregister_family(&name_resolver_family);
+	return err;
+}
+
+void name_resolver_exit(void)
+{
+	struct name_resolver_daemon *d, *tmp;
+	LIST_HEAD(queries);
+	struct name_query *q;
+
+	netlink_unregister_notifier(&name_resolver_notifier);
+	genl_unregister_family(&name_resolver_family);
+	cancel_delayed_work_sync(&name_resolver_send_work);
+	cancel_delayed_work_sync(&name_resolver_expire_work);
+
+	spin_lock_bh(&name_resolver_lock);
+	list_for_each_entry_safe(d, tmp, &name_resolver_daemons, list) {
+		list_del(&d->list);
+		kfree(d);
+	}
+	list_splice_init(&name_queries_unsent, &queries);
+	list_splice_init(&name_queries_sent, &queries);
+	list_for_each_entry(q, &queries, list) {
+		hlist_del(&q->name_node);
+		hlist_del(&q->id_node);
+	}
+	spin_unlock_bh(&name_resolver_lock);
+
+	name_query_complete_list(&queries, -ENETDOWN);
+}
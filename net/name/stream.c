@@ -0,0 +1,1159 @@
+/*
+ * Name-oriented sockets: SOCK_STREAM
+ *
+ * connect() resolves the name in a struct sockaddr_name and connects a
+ * kernel TCP socket of the matching address family to it; from then on
+ * all I/O is forwarded to that transport.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/net.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/in.h>
+#include <linux/skbuff.h>
+#include <linux/socket.h>
+#include <linux/splice.h>
+#include <asm/uaccess.h>
+#include <net/sock.h>
+#include <net/inet_sock.h>
+#include <net/tcp_states.h>
+
+#include "af_name.h"
+
+/*
+ * Get a reference to the transport of @sk, or NULL if it has none.
+ */
+static struct name_transport *name_stream_transport(struct sock *sk)
+{
+	struct name_transport *nt;
+
+	read_lock_bh(&sk->sk_callback_lock);
+	nt = name_stream_sk(sk)->transport;
+	if (nt)
+		name_transport_hold(nt);
+	read_unlock_bh(&sk->sk_callback_lock);
+	return nt;
+}
+
+static void name_stream_set_transport(struct sock *sk,
+				      struct name_transport *nt)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	struct name_transport *old;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	old = name->transport;
+	name->transport = nt;
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	if (old) {
+		name_transport_detach(old);
+		name_transport_put(old);
+	}
+}
+
+/*
+ * Get a reference to the transport @sk moved away from, if it still has
+ * data to be read.
+ */
+static struct name_transport *name_stream_stale(struct sock *sk)
+{
+	struct name_transport *nt;
+
+	read_lock_bh(&sk->sk_callback_lock);
+	nt = name_stream_sk(sk)->stale;
+	if (nt)
+		name_transport_hold(nt);
+	read_unlock_bh(&sk->sk_callback_lock);
+	return nt;
+}
+
+/*
+ * Drop @nt if it is still the transport @sk moved away from.
+ */
+static void name_stream_put_stale(struct sock *sk, struct name_transport *nt)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+
+	write_lock_bh(&sk->sk_callback_lock);
+	if (nt && name->stale == nt)
+		name->stale = NULL;
+	else
+		nt = NULL;
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	if (nt) {
+		name_transport_detach(nt);
+		name_transport_put(nt);
+	}
+}
+
+/*
+ * The application has read all data from the transport @sk moved away
+ * from, which can go unless it is still being replayed.
+ */
+static void name_stream_stale_drained(struct sock *sk,
+				      struct name_transport *nt)
+{
+	lock_sock(sk);
+	if (sk->sk_state != TCP_SYN_SENT)
+		name_stream_put_stale(sk, nt);
+	release_sock(sk);
+}
+
+/*
+ * A connection that fails with an error moves to the current addresses
+ * of its name if the application asked for that, unless it is already
+ * moving or has been shut down.
+ */
+static int name_stream_may_migrate(struct sock *sk, struct sock *tsk)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+
+	return name->mobile && tsk->sk_err && !name->stale &&
+	       sk->sk_state == TCP_ESTABLISHED &&
+	       !(sk->sk_shutdown & SEND_SHUTDOWN);
+}
+
+/*
+ * Called in softirq context when a transport of @nt->owner changes state.
+ * The first connection attempt to establish becomes the transport of the
+ * socket; the work of closing the others and of starting new attempts
+ * after a failure is left to process context.
+ */
+static void name_stream_state_change(struct name_transport *nt)
+{
+	struct sock *tsk = nt->sock->sk;
+	struct sock *sk = nt->owner;
+	struct name_stream_sock *name = name_stream_sk(sk);
+	int race = 0, migrate = 0;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	if (nt == name->transport) {
+		if (tsk->sk_state != TCP_CLOSE)
+			;
+		else if (name_stream_may_migrate(sk, tsk)) {
+			name->stale = nt;
+			name->replayed = 0;
+			name->transport = NULL;
+			sk->sk_state = TCP_SYN_SENT;
+			migrate = 1;
+		} else {
+			if (tsk->sk_err)
+				sk->sk_err = tsk->sk_err;
+			sk->sk_state = TCP_CLOSE;
+		}
+	} else if (tsk->sk_state == TCP_ESTABLISHED) {
+		if (sk->sk_state == TCP_SYN_SENT && !name->transport) {
+			list_del_init(&nt->list);
+			name->transport = nt;
+			/*
+			 * A connection that moved stays in SYN_SENT until
+			 * the unacknowledged data has been replayed.
+			 */
+			if (name->stale)
+				race = 1;
+			else {
+				sk->sk_state = TCP_ESTABLISHED;
+				name_diag_phase_done(name, NAME_DIAG_CONNECT);
+			}
+		}
+		race |= !list_empty(&name->attempts);
+	} else if (tsk->sk_state == TCP_CLOSE)
+		race = 1;
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	if (race && schedule_work(&name->race_work))
+		sock_hold(sk);
+	if (migrate && schedule_work(&name->migrate_work))
+		sock_hold(sk);
+}
+
+/*
+ * Called in softirq context when a transport of @nt->owner has data.
+ */
+static void name_stream_data_ready(struct name_transport *nt)
+{
+	struct name_stream_sock *name = name_stream_sk(nt->owner);
+
+	if (nt == name->transport)
+		name_diag_phase_done(name, NAME_DIAG_FIRST_BYTE);
+}
+
+/*
+ * Called in softirq context when a transport of @nt->owner has write
+ * space: a replay that ran out of it goes on.
+ */
+static void name_stream_write_space(struct name_transport *nt)
+{
+	struct sock *sk = nt->owner;
+	struct name_stream_sock *name = name_stream_sk(sk);
+	int replay;
+
+	read_lock(&sk->sk_callback_lock);
+	replay = nt == name->transport && name->stale &&
+		 sk->sk_state == TCP_SYN_SENT;
+	read_unlock(&sk->sk_callback_lock);
+
+	if (replay && schedule_work(&name->race_work))
+		sock_hold(sk);
+}
+
+const struct name_transport_ops name_stream_transport_ops = {
+	.state_change	= name_stream_state_change,
+	.data_ready	= name_stream_data_ready,
+	.write_space	= name_stream_write_space,
+};
+
+/*
+ * Start a non-blocking TCP connect to the next address of the name.
+ * Called with the socket locked.
+ */
+static int name_stream_start_attempt(struct sock *sk)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	const struct name_rr *rr = &name->addrs[name->next++];
+	struct sockaddr_storage addr;
+	struct name_transport *nt;
+	int addrlen, err;
+
+	err = name_transport_create(sk, rr->family, SOCK_STREAM, IPPROTO_TCP,
+				    &name_stream_transport_ops, &nt);
+	if (err)
+		return err;
+	nt->load = name_load_get(sock_net(sk), rr);
+
+	write_lock_bh(&sk->sk_callback_lock);
+	list_add_tail(&nt->list, &name->attempts);
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	addrlen = name_rr_to_sockaddr(rr, name->dport, &addr);
+	err = kernel_connect(nt->sock, (struct sockaddr *)&addr, addrlen,
+			     O_NONBLOCK);
+	if (err && err != -EINPROGRESS) {
+		write_lock_bh(&sk->sk_callback_lock);
+		list_del_init(&nt->list);
+		write_unlock_bh(&sk->sk_callback_lock);
+		name_transport_detach(nt);
+		name_transport_put(nt);
+		return err;
+	}
+	return 0;
+}
+
+/*
+ * A connection that moved has established its new transport: replay the
+ * data the old one had not had acknowledged before letting the
+ * application write more.  The replay goes on from the write space of the
+ * new transport until it is done.  Called with the socket locked, which
+ * is released while sending.
+ */
+static void name_stream_migrated(struct sock *sk)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	struct name_transport *stale, *nt;
+	int err;
+
+	/* Leave it to the worker already sending, but make it look again */
+	if (name->replaying) {
+		name->replay_again = 1;
+		return;
+	}
+
+	stale = name_stream_stale(sk);
+	nt = name_stream_transport(sk);
+	name->replaying = 1;
+	do {
+		name->replay_again = 0;
+		release_sock(sk);
+		err = name_transport_replay(stale, nt, &name->replayed);
+		lock_sock(sk);
+	} while (!err && name->replay_again);
+	name->replaying = 0;
+
+	if (!err || sock_flag(sk, SOCK_DEAD))
+		goto out;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	if (sk->sk_state != TCP_SYN_SENT || name->transport != nt)
+		;	/* the new transport failed already */
+	else if (err < 0) {
+		sk->sk_err = -err;
+		sk->sk_state = TCP_CLOSE;
+	} else
+		sk->sk_state = TCP_ESTABLISHED;
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	/* The application may still have to read from the old transport */
+	if (skb_queue_empty(&stale->sock->sk->sk_receive_queue))
+		name_stream_put_stale(sk, stale);
+	sk->sk_state_change(sk);
+out:
+	name_transport_put(nt);
+	name_transport_put(stale);
+}
+
+/*
+ * Drive the connection race of @sk: close the attempts that failed, or
+ * all of them once the race is over, and start attempts on further
+ * addresses while none is in progress or when @stagger says it is time.
+ * Fails the connect when no attempt is left.  Called with the socket
+ * locked.
+ */
+static void name_stream_race(struct sock *sk, int stagger)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	struct name_transport *nt, *tmp;
+	LIST_HEAD(reap);
+	int racing, err, done;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	racing = sk->sk_state == TCP_SYN_SENT && !sock_flag(sk, SOCK_DEAD) &&
+		 !name->transport;
+	list_for_each_entry_safe(nt, tmp, &name->attempts, list) {
+		if (racing && nt->sock->sk->sk_state != TCP_CLOSE)
+			continue;
+		if (nt->sock->sk->sk_err)
+			name->attempt_err = nt->sock->sk->sk_err;
+		list_move(&nt->list, &reap);
+	}
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	list_for_each_entry_safe(nt, tmp, &reap, list) {
+		list_del_init(&nt->list);
+		name_transport_detach(nt);
+		name_transport_put(nt);
+	}
+
+	if (!racing) {
+		if (sk->sk_state == TCP_SYN_SENT && !sock_flag(sk, SOCK_DEAD))
+			name_stream_migrated(sk);
+		return;
+	}
+
+	while (name->next < name->naddrs &&
+	       (list_empty(&name->attempts) || stagger)) {
+		err = name_stream_start_attempt(sk);
+		if (err)
+			name->attempt_err = -err;
+		else
+			stagger = 0;
+	}
+
+	write_lock_bh(&sk->sk_callback_lock);
+	done = list_empty(&name->attempts) && !name->transport;
+	if (done) {
+		sk->sk_err = name->attempt_err ? : ECONNREFUSED;
+		sk->sk_state = TCP_CLOSE;
+	}
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	if (done)
+		sk->sk_state_change(sk);
+	else if (name->next < name->naddrs &&
+		 schedule_delayed_work(&name->stagger_work,
+				name_pernet(sock_net(sk))->sysctl_connect_stagger))
+		sock_hold(sk);
+}
+
+static void name_stream_race_worker(struct work_struct *work)
+{
+	struct name_stream_sock *name = container_of(work,
+						     struct name_stream_sock,
+						     race_work);
+	struct sock *sk = &name->sk;
+
+	lock_sock(sk);
+	name_stream_race(sk, 0);
+	release_sock(sk);
+	sock_put(sk);
+}
+
+static void name_stream_stagger_worker(struct work_struct *work)
+{
+	struct name_stream_sock *name = container_of(work,
+						     struct name_stream_sock,
+						     stagger_work.work);
+	struct sock *sk = &name->sk;
+
+	lock_sock(sk);
+	name_stream_race(sk, 1);
+	release_sock(sk);
+	sock_put(sk);
+}
+
+/*
+ * Order the addresses of the name for the race: in the order of the
+ * socket's policy, alternating between the address families so that a
+ * broken path in one family delays the connect by no more than one
+ * stagger.  The default policy starts with IPv6, the others with the
+ * family of the address they put first.
+ */
+static void name_stream_sort_addrs(struct sock *sk)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	struct name_rr rr[NAME_RESOLVE_MAX_ADDRS];
+	int i, j, k, n = name->naddrs;
+	unsigned short first = AF_INET6;
+
+	if (name->policy != NAME_POLICY_ORDER) {
+		name_policy_order(sock_net(sk), name->policy, name->dname.name,
+				  name->addrs, n);
+		first = name->addrs[0].family;
+	}
+
+	memcpy(rr, name->addrs, n * sizeof(*rr));
+	for (i = j = k = 0; k < n; ) {
+		while (i < n && rr[i].family != first)
+			i++;
+		if (i < n)
+			name->addrs[k++] = rr[i++];
+		while (j < n && rr[j].family == first)
+			j++;
+		if (j < n)
+			name->addrs[k++] = rr[j++];
+	}
+}
+
+/*
+ * Start racing connects to the @naddrs addresses in name->addrs.  Called
+ * with the socket locked and in SYN_SENT.
+ */
+static void name_stream_connect_addrs(struct sock *sk, int naddrs)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+
+	name->naddrs = naddrs;
+	name->next = 0;
+	name->attempt_err = 0;
+	name_diag_phase_done(name, NAME_DIAG_RESOLVE);
+	name_stream_sort_addrs(sk);
+	name_stream_race(sk, 0);
+}
+
+/*
+ * Completion of a name the resolver had to look up.
+ */
+static void name_stream_resolved(struct name_resolve_req *req, int err,
+				 const struct name_rr *rr, int naddrs)
+{
+	struct name_stream_sock *name;
+	struct sock *sk;
+
+	name = container_of(req, struct name_stream_sock, resolve);
+	sk = &name->sk;
+
+	lock_sock(sk);
+	if (!sock_flag(sk, SOCK_DEAD) && sk->sk_state == TCP_SYN_SENT) {
+		if (!err) {
+			naddrs = min(naddrs, NAME_RESOLVE_MAX_ADDRS);
+			memcpy(name->addrs, rr, naddrs * sizeof(*rr));
+			name_stream_connect_addrs(sk, naddrs);
+		} else {
+			sk->sk_err = -err;
+			sk->sk_state = TCP_CLOSE;
+			sk->sk_state_change(sk);
+		}
+	}
+	release_sock(sk);
+	sock_put(sk);
+}
+
+/*
+ * Resolve name->dname and start connecting to its addresses.  Called with
+ * the socket locked and in SYN_SENT.
+ */
+static int name_stream_resolve(struct sock *sk)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	int err;
+
+	sock_hold(sk);
+	name->resolve.done = name_stream_resolved;
+	err = name_resolve(sock_net(sk), name->dname.name, name->addrs,
+			   NAME_RESOLVE_MAX_ADDRS, &name->resolve);
+	if (err > 0) {
+		sock_put(sk);
+		name_stream_connect_addrs(sk, err);
+		err = 0;
+	} else if (err < 0)
+		sock_put(sk);
+	return err;
+}
+
+/*
+ * Take an established connection to the name from the pool of the
+ * namespace, if the socket uses one and it has one.  Called with the
+ * socket locked and in SYN_SENT; returns 1 if the socket is now
+ * ESTABLISHED.
+ */
+static int name_stream_pooled(struct sock *sk)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	struct name_transport *nt;
+	struct socket *sock;
+	int size;
+
+	size = name->pool >= 0 ? name->pool :
+	       name_pernet(sock_net(sk))->sysctl_pool_size;
+	if (size <= 0)
+		return 0;
+
+	sock = name_pool_get(sock_net(sk), name->dname.name, name->dport,
+			     size);
+	if (!sock)
+		return 0;
+	if (name_transport_attach(sk, sock, &name_stream_transport_ops, &nt)) {
+		sock_release(sock);
+		return 0;
+	}
+
+	/* The peer may have closed it before the callbacks were ours */
+	write_lock_bh(&sk->sk_callback_lock);
+	if (sock->sk->sk_state == TCP_ESTABLISHED) {
+		name->transport = nt;
+		sk->sk_state = TCP_ESTABLISHED;
+	}
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	if (name->transport != nt) {
+		name_transport_put(nt);
+		return 0;
+	}
+	name_diag_phase_done(name, NAME_DIAG_RESOLVE);
+	name_diag_phase_done(name, NAME_DIAG_CONNECT);
+	return 1;
+}
+
+/*
+ * Resolve the name in @sname and start connecting to its addresses.
+ * Called with the socket locked; on success the socket is in SYN_SENT
+ * while the name is looked up or the handshakes are in progress,
+ * ESTABLISHED if one of them already completed, or CLOSE with sk_err set
+ * if all of them failed straight away.
+ */
+static int name_stream_start_connect(struct sock *sk,
+				     struct sockaddr_name *sname)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	int err;
+
+	memset(&name->dname, 0, sizeof(name->dname));
+	strcpy(name->dname.name, sname->sname_addr.name);
+	name->dport = sname->sname_port;
+	sk->sk_state = TCP_SYN_SENT;
+	name_diag_connect_start(sk);
+
+	if (name_stream_pooled(sk))
+		return 0;
+
+	err = name_stream_resolve(sk);
+	if (err)
+		sk->sk_state = TCP_CLOSE;
+	return err;
+}
+
+/*
+ * A connection failed and is to move: forget the addresses its name
+ * resolved to and connect to what it resolves to now.
+ */
+static void name_stream_migrate_worker(struct work_struct *work)
+{
+	struct name_stream_sock *name = container_of(work,
+						     struct name_stream_sock,
+						     migrate_work);
+	struct sock *sk = &name->sk;
+	int err;
+
+	lock_sock(sk);
+	if (!sock_flag(sk, SOCK_DEAD) && sk->sk_state == TCP_SYN_SENT &&
+	    name->stale && !name->transport) {
+		name_cache_remove(sock_net(sk), name->dname.name);
+		err = name_stream_resolve(sk);
+		if (err) {
+			sk->sk_err = -err;
+			sk->sk_state = TCP_CLOSE;
+			sk->sk_state_change(sk);
+		}
+	}
+	release_sock(sk);
+	sock_put(sk);
+}
+
+static long name_stream_wait_for_connect(struct sock *sk, long timeo)
+{
+	DEFINE_WAIT(wait);
+
+	prepare_to_wait(sk->sk_sleep, &wait, TASK_INTERRUPTIBLE);
+
+	while (sk->sk_state == TCP_SYN_SENT) {
+		release_sock(sk);
+		timeo = schedule_timeout(timeo);
+		lock_sock(sk);
+		if (signal_pending(current) || !timeo)
+			break;
+		prepare_to_wait(sk->sk_sleep, &wait, TASK_INTERRUPTIBLE);
+	}
+	finish_wait(sk->sk_sleep, &wait);
+	return timeo;
+}
+
+static int name_stream_connect(struct socket *sock, struct sockaddr *uaddr,
+			       int addr_len, int flags)
+{
+	struct sockaddr_name *sname = (struct sockaddr_name *)uaddr;
+	struct sock *sk = sock->sk;
+	long timeo;
+	int err;
+
+	lock_sock(sk);
+	switch (sock->state) {
+	default:
+		err = -EINVAL;
+		goto out;
+	case SS_CONNECTED:
+		err = -EISCONN;
+		goto out;
+	case SS_CONNECTING:
+		err = -EALREADY;
+		/* Fall out of switch with err, set for this state */
+		break;
+	case SS_UNCONNECTED:
+		/* Bound sockets are for listening */
+		err = -EINVAL;
+		if (!list_empty(&name_stream_sk(sk)->listeners))
+			goto out;
+
+		err = name_check_sockaddr(sname, addr_len);
+		if (err)
+			goto out;
+
+		err = name_stream_start_connect(sk, sname);
+		if (err)
+			goto out;
+
+		sock->state = SS_CONNECTING;
+		err = -EINPROGRESS;
+		break;
+	}
+
+	timeo = sock_sndtimeo(sk, flags & O_NONBLOCK);
+
+	if (sk->sk_state == TCP_SYN_SENT) {
+		/* Error code is set above */
+		if (!timeo || !name_stream_wait_for_connect(sk, timeo))
+			goto out;
+
+		err = sock_intr_errno(timeo);
+		if (signal_pending(current))
+			goto out;
+	}
+
+	/* Connection was closed by RST, timeout, ICMP error
+	 * or another process disconnected us.
+	 */
+	if (sk->sk_state == TCP_CLOSE)
+		goto sock_error;
+
+	sock->state = SS_CONNECTED;
+	err = 0;
+out:
+	release_sock(sk);
+	return err;
+
+sock_error:
+	err = sock_error(sk) ? : -ECONNABORTED;
+	sock->state = SS_UNCONNECTED;
+	name_stream_set_transport(sk, NULL);
+	goto out;
+}
+
+static int name_stream_release(struct socket *sock)
+{
+	struct sock *sk = sock->sk;
+	struct name_transport *nt;
+
+	if (!sk)
+		return 0;
+
+	name_diag_unlink(sk);
+
+	lock_sock(sk);
+	nt = name_stream_sk(sk)->transport;
+	if (nt && sock_flag(sk, SOCK_LINGER)) {
+		sock_set_flag(nt->sock->sk, SOCK_LINGER);
+		nt->sock->sk->sk_lingertime = sk->sk_lingertime;
+	}
+	name_stream_set_transport(sk, NULL);
+	name_stream_put_stale(sk, name_stream_sk(sk)->stale);
+	name_listen_release(sk);
+	sk->sk_state = TCP_CLOSE;
+	sock_orphan(sk);
+	name_stream_race(sk, 0);
+	release_sock(sk);
+
+	if (cancel_delayed_work(&name_stream_sk(sk)->stagger_work))
+		sock_put(sk);
+
+	sock->sk = NULL;
+	sock_put(sk);
+	return 0;
+}
+
+static int name_stream_getname(struct socket *sock, struct sockaddr *uaddr,
+			       int *uaddr_len, int peer)
+{
+	struct sockaddr_name *sname = (struct sockaddr_name *)uaddr;
+	struct sock *sk = sock->sk;
+	struct name_stream_sock *name = name_stream_sk(sk);
+	struct name_transport *nt;
+
+	memset(sname, 0, sizeof(*sname));
+	sname->sname_family = AF_NAME;
+
+	if (peer) {
+		if (sk->sk_state != TCP_ESTABLISHED)
+			return -ENOTCONN;
+		sname->sname_port = name->dport;
+		memcpy(&sname->sname_addr, &name->dname,
+		       sizeof(sname->sname_addr));
+	} else {
+		memcpy(&sname->sname_addr, &name->sname,
+		       sizeof(sname->sname_addr));
+		sname->sname_port = name->sport;
+		nt = name_stream_transport(sk);
+		if (nt) {
+			sname->sname_port = inet_sk(nt->sock->sk)->sport;
+			name_transport_put(nt);
+		}
+	}
+	*uaddr_len = sizeof(*sname);
+	return 0;
+}
+
+static unsigned int name_stream_poll(struct file *file, struct socket *sock,
+				     poll_table *wait)
+{
+	struct sock *sk = sock->sk;
+	struct name_transport *nt;
+	unsigned int mask;
+
+	poll_wait(file, sk->sk_sleep, wait);
+
+	if (sk->sk_state == TCP_LISTEN)
+		return name_listen_poll(sk);
+
+	nt = name_stream_transport(sk);
+	if (sk->sk_state == TCP_SYN_SENT)
+		mask = 0;	/* resolving, connecting or moving */
+	else if (nt)
+		mask = nt->sock->ops->poll(file, nt->sock, NULL);
+	else
+		mask = POLLHUP;
+	if (nt)
+		name_transport_put(nt);
+
+	/* Data left on the transport the connection moved away from */
+	nt = name_stream_stale(sk);
+	if (nt) {
+		if (!skb_queue_empty(&nt->sock->sk->sk_receive_queue))
+			mask |= POLLIN | POLLRDNORM;
+		name_transport_put(nt);
+	}
+
+	if (sk->sk_err)
+		mask |= POLLERR;
+	return mask;
+}
+
+static int name_stream_ioctl(struct socket *sock, unsigned int cmd,
+			     unsigned long arg)
+{
+	struct name_transport *nt;
+	int err;
+
+	nt = name_stream_transport(sock->sk);
+	if (!nt)
+		return -ENOTCONN;
+	err = nt->sock->ops->ioctl(nt->sock, cmd, arg);
+	name_transport_put(nt);
+	return err;
+}
+
+static int name_stream_shutdown(struct socket *sock, int how)
+{
+	struct name_transport *nt;
+	int err;
+
+	nt = name_stream_transport(sock->sk);
+	if (!nt)
+		return -ENOTCONN;
+	err = nt->sock->ops->shutdown(nt->sock, how);
+	name_transport_put(nt);
+
+	/* A connection shut down for sending is not moved */
+	if (!err && how >= SHUT_RD && how <= SHUT_RDWR)
+		sock->sk->sk_shutdown |= how + 1;
+	return err;
+}
+
+static int name_setsockopt(struct sock *sk, int optname,
+			   char __user *optval, int optlen)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	int val;
+
+	if (optlen < sizeof(int))
+		return -EINVAL;
+	if (get_user(val, (int __user *)optval))
+		return -EFAULT;
+
+	switch (optname) {
+	case NAME_MOBILITY:
+		name->mobile = !!val;
+		return 0;
+	case NAME_POLICY:
+		if (val < 0 || val > NAME_POLICY_MAX)
+			return -EINVAL;
+		name->policy = val;
+		return 0;
+	case NAME_POOL:
+		if (val > NAME_POOL_MAX)
+			return -EINVAL;
+		name->pool = val < 0 ? -1 : val;
+		return 0;
+	default:
+		return -ENOPROTOOPT;
+	}
+}
+
+static int name_getsockopt(struct sock *sk, int optname,
+			   char __user *optval, int __user *optlen)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+	int val, len;
+
+	if (get_user(len, optlen))
+		return -EFAULT;
+	if (len < 0)
+		return -EINVAL;
+	len = min_t(unsigned int, len, sizeof(int));
+
+	switch (optname) {
+	case NAME_MOBILITY:
+		val = name->mobile;
+		break;
+	case NAME_POLICY:
+		val = name->policy;
+		break;
+	case NAME_POOL:
+		val = name->pool;
+		break;
+	default:
+		return -ENOPROTOOPT;
+	}
+
+	if (put_user(len, optlen))
+		return -EFAULT;
+	if (copy_to_user(optval, &val, len))
+		return -EFAULT;
+	return 0;
+}
+
+/*
+ * Options of other levels than SOL_SOCKET and SOL_NAME apply to the
+ * transport.
+ */
+static int name_stream_setsockopt(struct socket *sock, int level, int optname,
+				  char __user *optval, int optlen)
+{
+	struct name_transport *nt;
+	int err;
+
+	if (level == SOL_NAME)
+		return name_setsockopt(sock->sk, optname, optval, optlen);
+
+	nt = name_stream_transport(sock->sk);
+	if (!nt)
+		return -ENOTCONN;
+	err = nt->sock->ops->setsockopt(nt->sock, level, optname, optval,
+					optlen);
+	name_transport_put(nt);
+	return err;
+}
+
+static int name_stream_getsockopt(struct socket *sock, int level, int optname,
+				  char __user *optval, int __user *optlen)
+{
+	struct name_transport *nt;
+	int err;
+
+	if (level == SOL_NAME)
+		return name_getsockopt(sock->sk, optname, optval, optlen);
+
+	nt = name_stream_transport(sock->sk);
+	if (!nt)
+		return -ENOTCONN;
+	err = nt->sock->ops->getsockopt(nt->sock, level, optname, optval,
+					optlen);
+	name_transport_put(nt);
+	return err;
+}
+
+#ifdef CONFIG_COMPAT
+static int name_stream_compat_setsockopt(struct socket *sock, int level,
+					 int optname, char __user *optval,
+					 int optlen)
+{
+	struct name_transport *nt;
+	int err;
+
+	if (level == SOL_NAME)
+		return name_setsockopt(sock->sk, optname, optval, optlen);
+
+	nt = name_stream_transport(sock->sk);
+	if (!nt)
+		return -ENOTCONN;
+	if (nt->sock->ops->compat_setsockopt)
+		err = nt->sock->ops->compat_setsockopt(nt->sock, level,
+						       optname, optval, optlen);
+	else
+		err = nt->sock->ops->setsockopt(nt->sock, level, optname,
+						optval, optlen);
+	name_transport_put(nt);
+	return err;
+}
+
+static int name_stream_compat_getsockopt(struct socket *sock, int level,
+					 int optname, char __user *optval,
+					 int __user *optlen)
+{
+	struct name_transport *nt;
+	int err;
+
+	if (level == SOL_NAME)
+		return name_getsockopt(sock->sk, optname, optval, optlen);
+
+	nt = name_stream_transport(sock->sk);
+	if (!nt)
+		return -ENOTCONN;
+	if (nt->sock->ops->compat_getsockopt)
+		err = nt->sock->ops->compat_getsockopt(nt->sock, level,
+						       optname, optval, optlen);
+	else
+		err = nt->sock->ops->getsockopt(nt->sock, level, optname,
+						optval, optlen);
+	name_transport_put(nt);
+	return err;
+}
+#endif
+
+/*
+ * Wait for up to @timeo while @sk is connecting, or moving to a new
+ * address, as a TCP socket would.
+ */
+static int name_stream_wait_connect(struct sock *sk, long timeo)
+{
+	DEFINE_WAIT(wait);
+	int err = 0;
+
+	while (sk->sk_state == TCP_SYN_SENT) {
+		err = -EAGAIN;
+		if (!timeo)
+			break;
+		err = sock_intr_errno(timeo);
+		if (signal_pending(current))
+			break;
+		prepare_to_wait(sk->sk_sleep, &wait, TASK_INTERRUPTIBLE);
+		if (sk->sk_state == TCP_SYN_SENT)
+			timeo = schedule_timeout(timeo);
+		finish_wait(sk->sk_sleep, &wait);
+		err = 0;
+	}
+	return err;
+}
+
+static int name_stream_sendmsg(struct kiocb *iocb, struct socket *sock,
+			       struct msghdr *msg, size_t len)
+{
+	struct sock *sk = sock->sk;
+	struct name_transport *nt;
+	int err;
+
+	err = name_stream_wait_connect(sk, sock_sndtimeo(sk,
+					msg->msg_flags & MSG_DONTWAIT));
+	if (err)
+		return err;
+
+	nt = name_stream_transport(sk);
+	if (!nt)
+		return -ENOTCONN;
+	nt->sock->sk->sk_sndtimeo = sk->sk_sndtimeo;
+	err = nt->sock->ops->sendmsg(iocb, nt->sock, msg, len);
+	name_transport_put(nt);
+	return err;
+}
+
+static int name_stream_recvmsg(struct kiocb *iocb, struct socket *sock,
+			       struct msghdr *msg, size_t len, int flags)
+{
+	struct sock *sk = sock->sk;
+	struct name_transport *nt;
+	int err;
+
+	err = name_stream_wait_connect(sk, sock_rcvtimeo(sk,
+					flags & MSG_DONTWAIT));
+	if (err)
+		return err;
+
+	/*
+	 * Data received before the connection moved comes first.  Once it
+	 * has all been read, the old transport can go; until then errors
+	 * reading it are the caller's, not a reason to skip what is left.
+	 */
+	nt = name_stream_stale(sk);
+	if (nt) {
+		struct sk_buff_head *queue = &nt->sock->sk->sk_receive_queue;
+
+		err = 0;
+		if (!skb_queue_empty(queue))
+			err = nt->sock->ops->recvmsg(iocb, nt->sock, msg, len,
+						     flags | MSG_DONTWAIT);
+		if (!err && skb_queue_empty(queue)) {
+			name_stream_stale_drained(sk, nt);
+			name_transport_put(nt);
+		} else {
+			name_transport_put(nt);
+			msg->msg_namelen = 0;
+			return err;
+		}
+	}
+
+	nt = name_stream_transport(sk);
+	if (!nt)
+		return -ENOTCONN;
+	nt->sock->sk->sk_rcvtimeo = sk->sk_rcvtimeo;
+	err = nt->sock->ops->recvmsg(iocb, nt->sock, msg, len, flags);
+	msg->msg_namelen = 0;
+	name_transport_put(nt);
+	return err;
+}
+
+/*
+ * sendfile() and splice() go straight to tcp_sendpage() and
+ * tcp_splice_read(), so that pages are not copied on their way.
+ */
+static ssize_t name_stream_sendpage(struct socket *sock, struct page *page,
+				    int offset, size_t size, int flags)
+{
+	struct sock *sk = sock->sk;
+	struct name_transport *nt;
+	ssize_t ret;
+
+	ret = name_stream_wait_connect(sk, sock_sndtimeo(sk,
+					flags & MSG_DONTWAIT));
+	if (ret)
+		return ret;
+
+	nt = name_stream_transport(sk);
+	if (!nt)
+		return -ENOTCONN;
+	nt->sock->sk->sk_sndtimeo = sk->sk_sndtimeo;
+	ret = kernel_sendpage(nt->sock, page, offset, size, flags);
+	name_transport_put(nt);
+	return ret;
+}
+
+static ssize_t name_stream_splice_read(struct socket *sock, loff_t *ppos,
+				       struct pipe_inode_info *pipe,
+				       size_t len, unsigned int flags)
+{
+	struct sock *sk = sock->sk;
+	struct name_transport *nt;
+	ssize_t ret;
+
+	ret = name_stream_wait_connect(sk, sock_rcvtimeo(sk,
+					flags & SPLICE_F_NONBLOCK));
+	if (ret)
+		return ret;
+
+	/* As in recvmsg(), data received before the connection moved first */
+	nt = name_stream_stale(sk);
+	if (nt) {
+		struct sk_buff_head *queue = &nt->sock->sk->sk_receive_queue;
+
+		ret = 0;
+		if (!skb_queue_empty(queue))
+			ret = nt->sock->ops->splice_read(nt->sock, ppos, pipe,
+						len, flags | SPLICE_F_NONBLOCK);
+		if (!ret && skb_queue_empty(queue)) {
+			name_stream_stale_drained(sk, nt);
+			name_transport_put(nt);
+		} else {
+			name_transport_put(nt);
+			return ret;
+		}
+	}
+
+	nt = name_stream_transport(sk);
+	if (!nt)
+		return -ENOTCONN;
+	nt->sock->sk->sk_rcvtimeo = sk->sk_rcvtimeo;
+	ret = nt->sock->ops->splice_read(nt->sock, ppos, pipe, len, flags);
+	name_transport_put(nt);
+	return ret;
+}
+
+static int name_stream_init_sock(struct sock *sk)
+{
+	struct name_stream_sock *name = name_stream_sk(sk);
+
+	INIT_LIST_HEAD(&name->attempts);
+	INIT_LIST_HEAD(&name->listeners);
+	INIT_WORK(&name->race_work, name_stream_race_worker);
+	INIT_WORK(&name->migrate_work, name_stream_migrate_worker);
+	INIT_DELAYED_WORK(&name->stagger_work, name_stream_stagger_worker);
+	name->pool = -1;
+	name_diag_link(sk);
+	return 0;
+}
+
+struct proto name_stream_proto = {
+	.name		= "NAME_STREAM",
+	.owner		= THIS_MODULE,
+	.init		= name_stream_init_sock,
+	.obj_size	= sizeof(struct name_stream_sock),
+};
+
+const struct proto_ops name_stream_ops = {
+	.family		   = PF_NAME,
+	.owner		   = THIS_MODULE,
+	.release	   = name_stream_release,
+	.bind		   = name_stream_bind,
+	.connect	   = name_stream_connect,
+	.socketpair	   = sock_no_socketpair,
+	.accept		   = name_stream_accept,
+	.getname	   = name_stream_getname,
+	.poll		   = name_stream_poll,
+	.ioctl		   = name_stream_ioctl,
+	.listen		   = name_stream_listen,
+	.shutdown	   = name_stream_shutdown,
+	.setsockopt	   = name_stream_setsockopt,
+	.getsockopt	   = name_stream_getsockopt,
+	.sendmsg	   = name_stream_sendmsg,
+	.recvmsg	   = name_stream_recvmsg,
+	.mmap		   = sock_no_mmap,
+	.sendpage	   = name_stream_sendpage,
+	.splice_read	   = name_stream_splice_read,
+#ifdef CONFIG_COMPAT
+	.compat_setsockopt = name_stream_compat_setsockopt,
+	.compat_getsockopt = name_stream_compat_getsockopt,
+#endif
+};
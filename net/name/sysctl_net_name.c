@@ -0,0 +1,131 @@
+/*
+ * Name-oriented sockets: sysctl interface
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/sysctl.h>
+
+#include "af_name.h"
+
+/*
+ * Timeouts in jiffies are compared with time_before() and handed to
+ * schedule_delayed_work(), negative ones are rejected.  The value is
+ * parsed aside so that it is never seen negative.
+ */
+static int name_proc_nonneg(proc_handler *handler, ctl_table *table,
+			    int write, struct file *filp,
+			    void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	ctl_table tmp = *table;
+	int val = *(int *)table->data;
+	int ret;
+
+	tmp.data = &val;
+	ret = handler(&tmp, write, filp, buffer, lenp, ppos);
+	if (write && !ret) {
+		if (val < 0)
+			return -EINVAL;
+		*(int *)table->data = val;
+	}
+	return ret;
+}
+
+static int name_proc_jiffies(ctl_table *table, int write, struct file *filp,
+			     void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	return name_proc_nonneg(proc_dointvec_jiffies, table, write, filp,
+				buffer, lenp, ppos);
+}
+
+static int name_proc_ms_jiffies(ctl_table *table, int write,
+				struct file *filp, void __user *buffer,
+				size_t *lenp, loff_t *ppos)
+{
+	return name_proc_nonneg(proc_dointvec_ms_jiffies, table, write, filp,
+				buffer, lenp, ppos);
+}
+
+static ctl_table name_table[] = {
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "connect_stagger_ms",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &name_proc_ms_jiffies,
+	},
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "negative_ttl",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &name_proc_jiffies,
+	},
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "stale_ttl",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &name_proc_jiffies,
+	},
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "pool_size",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec,
+	},
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "pool_idle_ttl",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &name_proc_jiffies,
+	},
+	{ .ctl_name = 0 }
+};
+
+static struct ctl_path name_path[] = {
+	{ .procname = "net", .ctl_name = CTL_NET, },
+	{ .procname = "name", .ctl_name = CTL_UNNUMBERED, },
+	{ },
+};
+
+int name_sysctl_register(struct name_net *nn)
+{
+	struct ctl_table *table;
+
+	table = kmemdup(name_table, sizeof(name_table), GFP_KERNEL);
+	if (table == NULL)
+		goto err_alloc;
+
+	table[0].data = &nn->sysctl_connect_stagger;
+	table[1].data = &nn->sysctl_negative_ttl;
+	table[2].data = &nn->sysctl_stale_ttl;
+	table[3].data = &nn->sysctl_pool_size;
+	table[4].data = &nn->sysctl_pool_idle_ttl;
+	nn->ctl = register_net_sysctl_table(nn->net, name_path, table);
+	if (nn->ctl == NULL)
+		goto err_reg;
+
+	return 0;
+
+err_reg:
+	kfree(table);
+err_alloc:
+	return -ENOMEM;
+}
+
+void name_sysctl_unregister(struct name_net *nn)
+{
+	struct ctl_table *table;
+
+	table = nn->ctl->ctl_table_arg;
+	unregister_sysctl_table(nn->ctl);
+	kfree(table);
+}
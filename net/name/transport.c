@@ -0,0 +1,273 @@
+/*
+ * Name-oriented sockets: kernel transport sockets
+ *
+ * The data of an AF_NAME socket travels over an ordinary kernel socket of
+ * the address family its name resolved to.  The transport's callbacks are
+ * chained so that state changes, errors and wakeups show up on the
+ * AF_NAME socket the application is waiting on.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/net.h>
+#include <net/sock.h>
+#include <net/tcp.h>
+
+#include "af_name.h"
+
+/*
+ * Sockets cloned from a listening transport inherit its callbacks and
+ * user data until name_transport_unclone() is called on them; they only
+ * get the original callbacks.
+ */
+static void name_transport_state_change(struct sock *tsk)
+{
+	struct name_transport *nt;
+	struct sock *sk;
+
+	read_lock(&tsk->sk_callback_lock);
+	nt = tsk->sk_user_data;
+	if (!nt)
+		goto out;
+
+	nt->saved_state_change(tsk);
+	if (tsk != nt->sock->sk)
+		goto out;
+
+	sk = nt->owner;
+	if (nt->ops->state_change)
+		nt->ops->state_change(nt);
+	sk->sk_state_change(sk);
+out:
+	read_unlock(&tsk->sk_callback_lock);
+}
+
+static void name_transport_data_ready(struct sock *tsk, int bytes)
+{
+	struct name_transport *nt;
+
+	read_lock(&tsk->sk_callback_lock);
+	nt = tsk->sk_user_data;
+	if (nt) {
+		nt->saved_data_ready(tsk, bytes);
+		if (tsk == nt->sock->sk) {
+			if (nt->ops->data_ready)
+				nt->ops->data_ready(nt);
+			nt->owner->sk_data_ready(nt->owner, bytes);
+		}
+	}
+	read_unlock(&tsk->sk_callback_lock);
+}
+
+static void name_transport_write_space(struct sock *tsk)
+{
+	struct name_transport *nt;
+
+	read_lock(&tsk->sk_callback_lock);
+	nt = tsk->sk_user_data;
+	if (nt) {
+		nt->saved_write_space(tsk);
+		if (tsk == nt->sock->sk) {
+			if (nt->ops->write_space)
+				nt->ops->write_space(nt);
+			nt->owner->sk_write_space(nt->owner);
+		}
+	}
+	read_unlock(&tsk->sk_callback_lock);
+}
+
+/*
+ * Make @sock a transport of @owner by redirecting its callbacks to it.
+ * The transport is returned with one reference, and releases @sock when
+ * the last one is put.
+ */
+int name_transport_attach(struct sock *owner, struct socket *sock,
+			  const struct name_transport_ops *ops,
+			  struct name_transport **ntp)
+{
+	struct name_transport *nt;
+	struct sock *tsk = sock->sk;
+
+	nt = kzalloc(sizeof(*nt), GFP_KERNEL);
+	if (!nt)
+		return -ENOMEM;
+
+	nt->sock = sock;
+	atomic_set(&nt->refcnt, 1);
+	INIT_LIST_HEAD(&nt->list);
+	nt->owner = owner;
+	nt->ops = ops;
+
+	write_lock_bh(&tsk->sk_callback_lock);
+	tsk->sk_user_data = nt;
+	nt->saved_state_change = tsk->sk_state_change;
+	nt->saved_data_ready = tsk->sk_data_ready;
+	nt->saved_write_space = tsk->sk_write_space;
+	tsk->sk_state_change = name_transport_state_change;
+	tsk->sk_data_ready = name_transport_data_ready;
+	tsk->sk_write_space = name_transport_write_space;
+	write_unlock_bh(&tsk->sk_callback_lock);
+
+	*ntp = nt;
+	return 0;
+}
+
+/*
+ * Create a kernel socket in the namespace of @owner and attach it to
+ * @owner as a transport.
+ */
+int name_transport_create(struct sock *owner, int family, int type,
+			  int protocol, const struct name_transport_ops *ops,
+			  struct name_transport **ntp)
+{
+	struct socket *sock;
+	int err;
+
+	err = __sock_create(sock_net(owner), family, type, protocol, &sock, 1);
+	if (err < 0)
+		return err;
+
+	err = name_transport_attach(owner, sock, ops, ntp);
+	if (err)
+		sock_release(sock);
+	return err;
+}
+
+/*
+ * Stop reporting events of @nt to its owner.  Users still holding a
+ * reference may keep using the socket until they put it.
+ */
+void name_transport_detach(struct name_transport *nt)
+{
+	struct sock *tsk = nt->sock->sk;
+
+	write_lock_bh(&tsk->sk_callback_lock);
+	if (tsk->sk_user_data == nt) {
+		tsk->sk_user_data = NULL;
+		tsk->sk_state_change = nt->saved_state_change;
+		tsk->sk_data_ready = nt->saved_data_ready;
+		tsk->sk_write_space = nt->saved_write_space;
+	}
+	nt->owner = NULL;
+	write_unlock_bh(&tsk->sk_callback_lock);
+}
+
+/*
+ * Give @child, a connection accepted by the listening transport @nt, the
+ * callbacks it would have had if the listener were not a transport.
+ */
+void name_transport_unclone(struct name_transport *nt, struct sock *child)
+{
+	write_lock_bh(&child->sk_callback_lock);
+	if (child->sk_user_data == nt) {
+		child->sk_user_data = NULL;
+		child->sk_state_change = nt->saved_state_change;
+		child->sk_data_ready = nt->saved_data_ready;
+		child->sk_write_space = nt->saved_write_space;
+	}
+	write_unlock_bh(&child->sk_callback_lock);
+}
+
+/*
+ * Copy up to @size bytes of the data retained on the write queue of the
+ * TCP socket @tsk but not acknowledged, starting @off bytes into it.
+ * Returns the number of bytes copied.  Called with @tsk locked.
+ */
+static int name_transport_copy_unacked(struct sock *tsk, u32 off, char *buf,
+				       int size)
+{
+	u32 una = tcp_sk(tsk)->snd_una;
+	struct sk_buff *skb;
+	int start, len, copied = 0;
+
+	skb_queue_walk(&tsk->sk_write_queue, skb) {
+		/* The head may have been acknowledged in part */
+		start = after(una, TCP_SKB_CB(skb)->seq) ?
+			una - TCP_SKB_CB(skb)->seq : 0;
+		if (start >= skb->len)
+			continue;
+		len = skb->len - start;
+		if (off >= len) {
+			off -= len;
+			continue;
+		}
+		start += off;
+		len -= off;
+		off = 0;
+
+		len = min(len, size - copied);
+		if (skb_copy_bits(skb, start, buf + copied, len))
+			break;
+		copied += len;
+		if (copied == size)
+			break;
+	}
+	return copied;
+}
+
+/**
+ * name_transport_replay - resend unacknowledged data on another transport
+ * @from: TCP transport that failed
+ * @to: transport to send over
+ * @off: bytes of the data replayed so far
+ *
+ * Sends the data that was written to @from but never acknowledged, as
+ * retained on its write queue, over @to, from @off on.  Does not block:
+ * @off is advanced by what @to took, and once it has no room for more the
+ * rest is left for a later call when @to has write space again.  Neither
+ * socket is locked while the other is.  Returns 1 once all the data has
+ * been sent, 0 if some is left, or a negative error.
+ */
+int name_transport_replay(struct name_transport *from,
+			  struct name_transport *to, u32 *off)
+{
+	struct sock *tsk = from->sock->sk;
+	struct msghdr msg = { .msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL };
+	struct kvec iov;
+	char *buf;
+	int len, err;
+
+	buf = (char *)__get_free_page(GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	for (;;) {
+		lock_sock(tsk);
+		len = name_transport_copy_unacked(tsk, *off, buf, PAGE_SIZE);
+		release_sock(tsk);
+		if (!len) {
+			err = 1;
+			break;
+		}
+
+		iov.iov_base = buf;
+		iov.iov_len = len;
+		err = kernel_sendmsg(to->sock, &msg, &iov, 1, len);
+		if (err == -EAGAIN)
+			err = 0;
+		if (err < 0)
+			break;
+		*off += err;
+		if (err < len) {
+			err = 0;
+			break;
+		}
+	}
+
+	free_page((unsigned long)buf);
+	return err;
+}
+
+void name_transport_free(struct name_transport *nt)
+{
+	name_transport_detach(nt);
+	sock_release(nt->sock);
+	if (nt->load)
+		name_load_put(nt->load);
+	kfree(nt);
+}